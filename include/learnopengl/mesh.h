@@ -7,9 +7,12 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <learnopengl/shader.h>
+#include <rg/Bounds.h>
+#include <rg/GLState.h>
 
 #include <string>
 #include <vector>
+#include <algorithm>
 using namespace std;
 
 struct Vertex {
@@ -42,6 +45,9 @@ public:
 
     unsigned int VAO;
     std::string glslIdentifierPrefix;
+    // object space bounds, computed once from the vertices at import
+    AABB bounds;
+    BoundingSphere boundingSphere;
     // constructor
     Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
     {
@@ -49,6 +55,7 @@ public:
         this->indices = indices;
         this->textures = textures;
 
+        computeBounds();
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
         setupMesh();
     }
@@ -63,7 +70,6 @@ public:
         unsigned int heightNr   = 1;
         for(unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
             // retrieve texture number (the N in diffuse_textureN)
             string number;
             string name = textures[i].type;
@@ -78,25 +84,35 @@ public:
 
             // now set the sampler to the correct texture unit
             glUniform1i(glGetUniformLocation(shader.ID, (glslIdentifierPrefix + name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            // and finally bind the texture, the state cache skips it if it is bound already
+            glState().BindTexture(i, GL_TEXTURE_2D, textures[i].id);
         }
 
-
-
         // draw mesh
-        glBindVertexArray(VAO);
+        glState().BindVertexArray(VAO);
         glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
     }
 
 private:
     // render data
     unsigned int VBO, EBO;
 
+    // box from the vertex extremes, sphere centered in the box and grown to the farthest vertex
+    void computeBounds()
+    {
+        for (const Vertex& vertex : vertices)
+            bounds.Expand(vertex.Position);
+        if (bounds.IsEmpty())
+            return;
+        boundingSphere.center = bounds.Center();
+        float radiusSquared = 0.0f;
+        for (const Vertex& vertex : vertices) {
+            glm::vec3 offset = vertex.Position - boundingSphere.center;
+            radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+        }
+        boundingSphere.radius = std::sqrt(radiusSquared);
+    }
+
     // initializes all the buffer objects/arrays
     void setupMesh()
     {
@@ -33,6 +33,9 @@ public:
     vector<Mesh>    meshes;
     string directory;
     bool gammaCorrection;
+    // union of the mesh bounds, in model space
+    AABB bounds;
+    BoundingSphere boundingSphere;
 
     // constructor, expects a filepath to a 3D model.
     Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
@@ -70,6 +73,20 @@ private:
 
         // process ASSIMP's root node recursively
         processNode(scene->mRootNode, scene);
+        computeBounds();
+    }
+
+    void computeBounds()
+    {
+        for (const Mesh& mesh : meshes)
+            bounds.Expand(mesh.bounds);
+        if (bounds.IsEmpty())
+            return;
+        boundingSphere.center = bounds.Center();
+        for (const Mesh& mesh : meshes) {
+            float reach = glm::length(mesh.boundingSphere.center - boundingSphere.center) + mesh.boundingSphere.radius;
+            boundingSphere.radius = std::max(boundingSphere.radius, reach);
+        }
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
@@ -5,10 +5,13 @@
 #include <glm/glm.hpp>
 
 #include <string>
-#include <fstream>
-#include <sstream>
+#include <map>
+#include <vector>
 #include <iostream>
-#include <common.h>
+#include <functional>
+#include <rg/Error.h>
+#include <rg/GLState.h>
+#include <rg/ShaderPreprocessor.h>
 class Shader
 {
 public:
@@ -16,98 +19,59 @@ public:
     // constructor generates the shader on the fly
     // ------------------------------------------------------------------------
     Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+        : vertexPath(vertexPath), fragmentPath(fragmentPath), geometryPath(geometryPath != nullptr ? geometryPath : "")
     {
-        std::string vertexPathString(vertexPath);
-        std::string fragmentPathString(fragmentPath);
-
-        vertexPath = vertexPathString.c_str();
-        fragmentPath= fragmentPathString.c_str();
-        // 1. retrieve the vertex/fragment source code from filePath
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::string geometryCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        std::ifstream gShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        gShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        try 
-        {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();		
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();			
-            // if geometry shader path is present, also load a geometry shader
-            if(geometryPath != nullptr)
-            {
-                std::string geometryPathString(geometryPath);
-                geometryPath = geometryPathString.c_str();
-                gShaderFile.open(geometryPath);
-                std::stringstream gShaderStream;
-                gShaderStream << gShaderFile.rdbuf();
-                gShaderFile.close();
-                geometryCode = gShaderStream.str();
-            }
-        }
-        catch (std::ifstream::failure& e)
+        ID = compile(ShaderDefines());
+        ASSERT(ID != 0, "Shader " << this->vertexPath << " could not be built");
+        variants[""] = ID;
+    }
+    // the program built with defines in front of every stage; each define set is compiled
+    // the first time it is asked for and cached after that. ID is the variant without defines
+    // ------------------------------------------------------------------------
+    unsigned int variant(const ShaderDefines& defines)
+    {
+        std::string key = defines.Key();
+        auto found = variants.find(key);
+        if (found != variants.end())
+            return found->second;
+        unsigned int program = compile(defines);
+        ASSERT(program != 0, "Shader " << vertexPath << " variant " << key << " could not be built");
+        glState().UseProgram(program);
+        for (const auto& sampler : samplers)
+            glUniform1i(glGetUniformLocation(program, sampler.first.c_str()), sampler.second);
+        for (const auto& setup : setups)
+            setup(program);
+        variants[key] = program;
+        return program;
+    }
+    // sets a sampler's texture unit in every variant, also in the ones compiled later
+    // ------------------------------------------------------------------------
+    void setSampler(const std::string &name, int unit)
+    {
+        samplers[name] = unit;
+        for (const auto& variant : variants)
         {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+            glState().UseProgram(variant.second);
+            glUniform1i(glGetUniformLocation(variant.second, name.c_str()), unit);
         }
-        const char* vShaderCode = vertexCode.c_str();
-        const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
-        // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
-        // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
-        // if geometry shader is given, compile geometry shader
-        unsigned int geometry;
-        if(geometryPath != nullptr)
+    }
+    // runs setup with the program in use on every variant, also on the ones compiled later;
+    // for uniforms that never change and locations to look up once
+    // ------------------------------------------------------------------------
+    void setupVariants(const std::function<void(unsigned int)>& setup)
+    {
+        setups.push_back(setup);
+        for (const auto& variant : variants)
         {
-            const char * gShaderCode = geometryCode.c_str();
-            geometry = glCreateShader(GL_GEOMETRY_SHADER);
-            glShaderSource(geometry, 1, &gShaderCode, NULL);
-            glCompileShader(geometry);
-            checkCompileErrors(geometry, "GEOMETRY");
+            glState().UseProgram(variant.second);
+            setup(variant.second);
         }
-        // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        if(geometryPath != nullptr)
-            glAttachShader(ID, geometry);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
-        // delete the shaders as they're linked into our program now and no longer necessery
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-        if(geometryPath != nullptr)
-            glDeleteShader(geometry);
-
     }
     // activate the shader
     // ------------------------------------------------------------------------
     void use() 
     { 
-        glUseProgram(ID); 
+        glState().UseProgram(ID); 
     }
     // utility uniform functions
     // ------------------------------------------------------------------------
@@ -169,9 +133,71 @@ public:
     }
 
 private:
+    std::string vertexPath;
+    std::string fragmentPath;
+    std::string geometryPath;
+    std::map<std::string, unsigned int> variants;
+    std::map<std::string, int> samplers;
+    std::vector<std::function<void(unsigned int)>> setups;
+
+    // 1. expands the #includes of every stage and inserts the defines
+    // 2. compiles the stages and links them
+    // returns 0 without linking if a stage's source could not be read
+    // ------------------------------------------------------------------------
+    unsigned int compile(const ShaderDefines& defines)
+    {
+        unsigned int vertex = compileStage(GL_VERTEX_SHADER, vertexPath, defines, "VERTEX");
+        unsigned int fragment = compileStage(GL_FRAGMENT_SHADER, fragmentPath, defines, "FRAGMENT");
+        unsigned int geometry = 0;
+        if (!geometryPath.empty())
+            geometry = compileStage(GL_GEOMETRY_SHADER, geometryPath, defines, "GEOMETRY");
+        if (vertex == 0 || fragment == 0 || (!geometryPath.empty() && geometry == 0))
+        {
+            // glDeleteShader ignores 0
+            glDeleteShader(vertex);
+            glDeleteShader(fragment);
+            glDeleteShader(geometry);
+            return 0;
+        }
+        // shader Program
+        unsigned int program = glCreateProgram();
+        glAttachShader(program, vertex);
+        glAttachShader(program, fragment);
+        if (geometry != 0)
+            glAttachShader(program, geometry);
+        glLinkProgram(program);
+        std::vector<std::string> files = { vertexPath, fragmentPath };
+        if (geometry != 0)
+            files.push_back(geometryPath);
+        checkCompileErrors(program, "PROGRAM", files, defines);
+        // delete the shaders as they're linked into our program now and no longer necessery
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+        if (geometry != 0)
+            glDeleteShader(geometry);
+        return program;
+    }
+    unsigned int compileStage(GLenum type, const std::string& path, const ShaderDefines& defines, const std::string& typeName)
+    {
+        std::string code;
+        std::vector<std::string> files;
+        if (!ShaderPreprocessor::Load(path, defines, code, files))
+        {
+            // Load already printed which file or #include failed
+            std::cout << "ERROR::SHADER_PREPROCESSING_ERROR of type: " << typeName << "\ndefines: " << defines.Key() << std::endl;
+            return 0;
+        }
+        const char* source = code.c_str();
+        unsigned int shader = glCreateShader(type);
+        glShaderSource(shader, 1, &source, NULL);
+        glCompileShader(shader);
+        checkCompileErrors(shader, typeName, files, defines);
+        return shader;
+    }
     // utility function for checking shader compilation/linking errors.
+    // files lists the sources the messages' source string numbers refer to
     // ------------------------------------------------------------------------
-    void checkCompileErrors(GLuint shader, std::string type)
+    void checkCompileErrors(GLuint shader, std::string type, const std::vector<std::string>& files, const ShaderDefines& defines)
     {
         GLint success;
         GLchar infoLog[1024];
@@ -181,7 +207,7 @@ private:
             if(!success)
             {
                 glGetShaderInfoLog(shader, 1024, NULL, infoLog);
-                std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+                std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n" << infoLog;
             }
         }
         else
@@ -190,9 +216,15 @@ private:
             if(!success)
             {
                 glGetProgramInfoLog(shader, 1024, NULL, infoLog);
-                std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+                std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog;
             }
         }
+        if(!success)
+        {
+            for (unsigned int i = 0; i < files.size(); i++)
+                std::cout << i << ": " << files[i] << "\n";
+            std::cout << "defines: " << defines.Key() << "\n -- --------------------------------------------------- -- " << std::endl;
+        }
     }
 };
 #endif
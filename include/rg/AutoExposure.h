@@ -0,0 +1,250 @@
+#ifndef PROJECT_BASE_AUTOEXPOSURE_H
+#define PROJECT_BASE_AUTOEXPOSURE_H
+
+#include <cmath>
+#include <glad/glad.h>
+
+#include <rg/Error.h>
+#include <rg/GLState.h>
+#include <rg/ComputePost.h>
+
+// Eye adaptation that never leaves the GPU. Every frame the HDR scene is drawn into a
+// LUMINANCE_SIZE square of log2 luminance whose mip chain averages it down to one texel,
+// the geometric mean of the frame. A second pass moves last frame's exposure towards
+// key / mean, in log space so the step from the sun to a night sky takes as long as the
+// step back, and writes it into a 1x1 target the composite reads. The CPU never needs the
+// value to render.
+//
+// For display the exposure and mean luminance are copied into a ring of READBACK_FRAMES
+// pixel pack buffers; a copy is only mapped once its fence has signaled, so it arrives a
+// few frames late and a slow frame is skipped instead of stalling the pipeline.
+//
+// The programs are autoExposureLuminance.fs and autoExposureAdapt.fs on fullscreen.vs. With
+// the compute kernel set and enabled, autoExposureLuminance.comp replaces the luminance draw
+// and the mipmap generation: one workgroup reduces the same samples in shared memory and
+// writes the mean into the chain's last level, where the adapt pass reads it either way.
+class AutoExposure {
+public:
+    static const int LUMINANCE_SIZE = 256;
+    static const int READBACK_FRAMES = 4;
+
+    struct Settings {
+        // mid grey the mean luminance is mapped to
+        float key = 0.18f;
+        float minExposure = 0.02f;
+        float maxExposure = 16.0f;
+        // adaptation rate per second towards a brighter and a darker scene
+        float speedUp = 3.0f;
+        float speedDown = 1.0f;
+    };
+
+    struct Stats {
+        float exposure = 0.0f;
+        float averageLuminance = 0.0f;
+        unsigned int readbacks = 0;
+        // readbacks that weren't ready yet and were skipped rather than waited for
+        unsigned int skipped = 0;
+    };
+
+    AutoExposure() {
+        glGenVertexArrays(1, &emptyVAO);
+
+        glGenTextures(1, &luminanceTexture);
+        glBindTexture(GL_TEXTURE_2D, luminanceTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R16F, LUMINANCE_SIZE, LUMINANCE_SIZE, 0, GL_RED, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        luminanceFramebuffer = createFramebuffer(luminanceTexture);
+
+        for (int i = 0; i < 2; i++) {
+            glGenTextures(1, &exposureTextures[i]);
+            glBindTexture(GL_TEXTURE_2D, exposureTextures[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, 1, 1, 0, GL_RG, GL_FLOAT, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            exposureFramebuffers[i] = createFramebuffer(exposureTextures[i]);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glGenBuffers(READBACK_FRAMES, readbackBuffers);
+        for (unsigned int buffer : readbackBuffers) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+            glBufferData(GL_PIXEL_PACK_BUFFER, 2 * sizeof(float), nullptr, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glState().Invalidate();
+    }
+
+    ~AutoExposure() {
+        for (GLsync& fence : fences)
+            if (fence != nullptr)
+                glDeleteSync(fence);
+        glDeleteBuffers(READBACK_FRAMES, readbackBuffers);
+        glDeleteFramebuffers(2, exposureFramebuffers);
+        glDeleteTextures(2, exposureTextures);
+        glDeleteFramebuffers(1, &luminanceFramebuffer);
+        glDeleteTextures(1, &luminanceTexture);
+        glDeleteVertexArrays(1, &emptyVAO);
+    }
+
+    AutoExposure(const AutoExposure&) = delete;
+    AutoExposure& operator=(const AutoExposure&) = delete;
+
+    void SetPrograms(unsigned int luminance, unsigned int adapt) {
+        luminanceProgram = luminance;
+        adaptProgram = adapt;
+        glState().UseProgram(adapt);
+        glUniform1i(glGetUniformLocation(adapt, "luminance"), 0);
+        glUniform1i(glGetUniformLocation(adapt, "previousExposure"), 1);
+        glUniform1i(glGetUniformLocation(adapt, "luminanceLevel"), luminanceLevels() - 1);
+        keyLocation = glGetUniformLocation(adapt, "key");
+        exposureRangeLocation = glGetUniformLocation(adapt, "exposureRange");
+        adaptationLocation = glGetUniformLocation(adapt, "adaptation");
+        resetLocation = glGetUniformLocation(adapt, "reset");
+        glState().UseProgram(luminance);
+        glUniform1i(glGetUniformLocation(luminance, "image"), 0);
+    }
+
+    // autoExposureLuminance.comp compiled with LUMINANCE_SIZE; used instead of the fragment
+    // program and the mip chain while compute is enabled
+    void SetComputeProgram(const ComputePost* post, unsigned int reduce) {
+        computePost = post;
+        reduceKernel = reduce;
+    }
+
+    void SetComputeEnabled(bool enabled) {
+        computeEnabled = enabled;
+    }
+
+    bool UsesCompute() const {
+        return computeEnabled && computePost != nullptr && reduceKernel != 0;
+    }
+
+    Settings& GetSettings() {
+        return settings;
+    }
+
+    // jumps straight to the next frame's exposure instead of adapting to it
+    void Reset() {
+        reset = true;
+    }
+
+    // texture the next Render writes the exposure into (red; green holds the mean
+    // luminance); changes every frame
+    unsigned int GetOutput() const {
+        return exposureTextures[frame % 2];
+    }
+
+    // measures source and adapts; leaves the 1x1 exposure framebuffer bound
+    void Render(unsigned int source, float deltaTime) {
+        ASSERT(luminanceProgram != 0 && adaptProgram != 0, "Auto exposure programs are not set");
+        collect();
+        GLStateCache& state = glState();
+        state.BindVertexArray(emptyVAO);
+
+        state.BindTexture(0, GL_TEXTURE_2D, source);
+        if (UsesCompute()) {
+            state.UseProgram(reduceKernel);
+            computePost->BindImage(0, luminanceTexture, GL_WRITE_ONLY, GL_R16F, luminanceLevels() - 1);
+            computePost->Dispatch(1, 1, 1);
+            computePost->Barrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+            state.BindTexture(0, GL_TEXTURE_2D, luminanceTexture);
+        } else {
+            state.UseProgram(luminanceProgram);
+            state.BindFramebuffer(luminanceFramebuffer);
+            state.Viewport(0, 0, LUMINANCE_SIZE, LUMINANCE_SIZE);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            state.BindTexture(0, GL_TEXTURE_2D, luminanceTexture);
+            glGenerateMipmap(GL_TEXTURE_2D);
+        }
+
+        state.UseProgram(adaptProgram);
+        glUniform1f(keyLocation, settings.key);
+        glUniform2f(exposureRangeLocation, settings.minExposure, settings.maxExposure);
+        glUniform2f(adaptationLocation, 1.0f - std::exp(-deltaTime * settings.speedUp), 1.0f - std::exp(-deltaTime * settings.speedDown));
+        glUniform1i(resetLocation, reset);
+        state.BindFramebuffer(exposureFramebuffers[frame % 2]);
+        state.Viewport(0, 0, 1, 1);
+        state.BindTexture(1, GL_TEXTURE_2D, exposureTextures[(frame + 1) % 2]);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        reset = false;
+
+        // the copy into the buffer runs on the GPU; nothing is read here
+        int slot = frame % READBACK_FRAMES;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffers[slot]);
+        glReadPixels(0, 0, 1, 1, GL_RG, GL_FLOAT, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        if (fences[slot] != nullptr)
+            glDeleteSync(fences[slot]);
+        fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        frame++;
+    }
+
+    // values from a few frames ago
+    const Stats& GetStats() const {
+        return stats;
+    }
+
+private:
+    Settings settings;
+    Stats stats;
+    unsigned int emptyVAO = 0;
+    unsigned int luminanceTexture = 0;
+    unsigned int luminanceFramebuffer = 0;
+    unsigned int exposureTextures[2] = {};
+    unsigned int exposureFramebuffers[2] = {};
+    unsigned int readbackBuffers[READBACK_FRAMES] = {};
+    GLsync fences[READBACK_FRAMES] = {};
+    unsigned int luminanceProgram = 0;
+    unsigned int adaptProgram = 0;
+    const ComputePost* computePost = nullptr;
+    unsigned int reduceKernel = 0;
+    bool computeEnabled = true;
+    int keyLocation = -1;
+    int exposureRangeLocation = -1;
+    int adaptationLocation = -1;
+    int resetLocation = -1;
+    unsigned long long frame = 0;
+    bool reset = true;
+
+    static int luminanceLevels() {
+        int levels = 1;
+        for (int size = LUMINANCE_SIZE; size > 1; size /= 2)
+            levels++;
+        return levels;
+    }
+
+    static unsigned int createFramebuffer(unsigned int texture) {
+        unsigned int framebuffer;
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+        ASSERT(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE, "Auto exposure framebuffer not complete");
+        return framebuffer;
+    }
+
+    // maps the oldest copy if the GPU has finished it; the slot is written again this frame
+    void collect() {
+        int slot = frame % READBACK_FRAMES;
+        GLsync& fence = fences[slot];
+        if (fence == nullptr)
+            return;
+        if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+            stats.skipped++;
+            return;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffers[slot]);
+        const float* values = (const float*) glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, 2 * sizeof(float), GL_MAP_READ_BIT);
+        if (values != nullptr) {
+            stats.exposure = values[0];
+            stats.averageLuminance = values[1];
+            stats.readbacks++;
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+};
+
+#endif //PROJECT_BASE_AUTOEXPOSURE_H
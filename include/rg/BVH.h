@@ -0,0 +1,402 @@
+#ifndef PROJECT_BASE_BVH_H
+#define PROJECT_BASE_BVH_H
+
+#include <vector>
+#include <utility>
+#include <cfloat>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+#include <rg/Bounds.h>
+#include <rg/Frustum.h>
+#include <rg/Error.h>
+
+// Dynamic bounding volume hierarchy over object bounds (an incrementally built AABB
+// tree). Leaves store a slightly enlarged ("fat") box, so objects that move a little
+// don't touch the tree at all; objects that leave their fat box are removed and
+// reinserted, which refits only the ancestors on their path. Every query walks the
+// tree from the root and skips whole subtrees, so it costs O(log n) for small results.
+class DynamicBVH {
+public:
+    static const int NULL_NODE = -1;
+    // traversal stack size; an AVL balanced tree of a million leaves is ~30 levels deep
+    static const int MAX_STACK = 128;
+
+    DynamicBVH(float margin = 0.5f) : margin(margin) {}
+
+    // returns a proxy id used for Move/Remove; userData is handed back by the queries
+    int Insert(const AABB& box, int userData) {
+        int leaf = allocateNode();
+        nodes[leaf].box = fatten(box);
+        nodes[leaf].userData = userData;
+        nodes[leaf].height = 0;
+        insertLeaf(leaf);
+        return leaf;
+    }
+
+    void Remove(int proxy) {
+        ASSERT(proxy >= 0 && proxy < (int) nodes.size() && nodes[proxy].IsLeaf(), "Invalid BVH proxy");
+        removeLeaf(proxy);
+        freeNode(proxy);
+    }
+
+    // returns true if the tree changed
+    bool Move(int proxy, const AABB& box) {
+        ASSERT(proxy >= 0 && proxy < (int) nodes.size() && nodes[proxy].IsLeaf(), "Invalid BVH proxy");
+        const AABB& fat = nodes[proxy].box;
+        if (contains(fat, box))
+            return false;
+        removeLeaf(proxy);
+        nodes[proxy].box = fatten(box);
+        insertLeaf(proxy);
+        return true;
+    }
+
+    void Clear() {
+        nodes.clear();
+        root = NULL_NODE;
+        freeList = NULL_NODE;
+        leafCount = 0;
+    }
+
+    int GetUserData(int proxy) const {
+        return nodes[proxy].userData;
+    }
+
+    const AABB& GetFatBox(int proxy) const {
+        return nodes[proxy].box;
+    }
+
+    int LeafCount() const {
+        return leafCount;
+    }
+
+    int NodeCount() const {
+        return (int) nodes.size();
+    }
+
+    int Height() const {
+        return root == NULL_NODE ? 0 : nodes[root].height;
+    }
+
+    // calls visit(userData) for every leaf whose box intersects the frustum
+    template<typename Visitor>
+    void QueryFrustum(const Frustum& frustum, Visitor visit) const {
+        if (root == NULL_NODE)
+            return;
+        // the mask holds the planes the node may still cross; a box fully inside a
+        // plane doesn't need to test it again anywhere below
+        std::pair<int, unsigned int> stack[MAX_STACK];
+        int size = 0;
+        stack[size++] = std::make_pair(root, (1u << Frustum::PLANE_COUNT) - 1);
+        while (size > 0) {
+            int index = stack[size - 1].first;
+            unsigned int planeMask = stack[size - 1].second;
+            size--;
+            const Node& node = nodes[index];
+
+            glm::vec3 center = node.box.Center();
+            glm::vec3 extents = node.box.Extents();
+            bool outside = false;
+            for (int i = 0; i < Frustum::PLANE_COUNT && !outside; i++) {
+                if (!(planeMask & (1u << i)))
+                    continue;
+                const glm::vec4& plane = frustum.planes[i];
+                float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+                float radius = glm::dot(glm::abs(glm::vec3(plane)), extents);
+                if (distance + radius < 0.0f)
+                    outside = true;
+                else if (distance - radius >= 0.0f)
+                    planeMask &= ~(1u << i);
+            }
+            if (outside)
+                continue;
+
+            if (node.IsLeaf()) {
+                visit(node.userData);
+            } else {
+                ASSERT(size + 2 <= MAX_STACK, "BVH too deep");
+                stack[size++] = std::make_pair(node.child1, planeMask);
+                stack[size++] = std::make_pair(node.child2, planeMask);
+            }
+        }
+    }
+
+    // calls visit(userData) for every leaf whose box overlaps the sphere
+    template<typename Visitor>
+    void QuerySphere(const BoundingSphere& sphere, Visitor visit) const {
+        if (root == NULL_NODE)
+            return;
+        int stack[MAX_STACK];
+        int size = 0;
+        stack[size++] = root;
+        float radiusSquared = sphere.radius * sphere.radius;
+        while (size > 0) {
+            const Node& node = nodes[stack[--size]];
+            glm::vec3 closest = glm::clamp(sphere.center, node.box.min, node.box.max);
+            glm::vec3 offset = closest - sphere.center;
+            if (glm::dot(offset, offset) > radiusSquared)
+                continue;
+            if (node.IsLeaf()) {
+                visit(node.userData);
+            } else {
+                ASSERT(size + 2 <= MAX_STACK, "BVH too deep");
+                stack[size++] = node.child1;
+                stack[size++] = node.child2;
+            }
+        }
+    }
+
+    // closest hit along the ray. hitTest(userData, boxEntryDistance) refines a leaf and returns
+    // the hit distance, or a negative value for a miss; by default the leaf box is the hit.
+    template<typename HitTest>
+    int RayCast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+                float& hitDistance, HitTest hitTest) const {
+        int hitUserData = -1;
+        hitDistance = maxDistance;
+        if (root == NULL_NODE)
+            return hitUserData;
+        glm::vec3 inverseDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+        int stack[MAX_STACK];
+        int size = 0;
+        stack[size++] = root;
+        while (size > 0) {
+            const Node& node = nodes[stack[--size]];
+            float entry;
+            if (!rayHitsBox(origin, inverseDirection, node.box, hitDistance, entry))
+                continue;
+            if (node.IsLeaf()) {
+                float distance = hitTest(node.userData, entry);
+                if (distance >= 0.0f && distance < hitDistance) {
+                    hitDistance = distance;
+                    hitUserData = node.userData;
+                }
+            } else {
+                ASSERT(size + 2 <= MAX_STACK, "BVH too deep");
+                stack[size++] = node.child1;
+                stack[size++] = node.child2;
+            }
+        }
+        return hitUserData;
+    }
+
+    int RayCast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float& hitDistance) const {
+        return RayCast(origin, direction, maxDistance, hitDistance, [](int userData, float entry) {
+            return entry;
+        });
+    }
+
+private:
+    struct Node {
+        AABB box;
+        int parent = NULL_NODE;
+        int child1 = NULL_NODE;
+        int child2 = NULL_NODE;
+        // leaf = 0, free node = -1
+        int height = -1;
+        int userData = -1;
+
+        bool IsLeaf() const {
+            return child1 == NULL_NODE;
+        }
+    };
+
+    std::vector<Node> nodes;
+    int root = NULL_NODE;
+    int freeList = NULL_NODE;
+    int leafCount = 0;
+    float margin;
+
+    AABB fatten(const AABB& box) const {
+        return AABB(box.min - glm::vec3(margin), box.max + glm::vec3(margin));
+    }
+
+    static bool contains(const AABB& outer, const AABB& inner) {
+        return outer.min.x <= inner.min.x && outer.min.y <= inner.min.y && outer.min.z <= inner.min.z
+            && outer.max.x >= inner.max.x && outer.max.y >= inner.max.y && outer.max.z >= inner.max.z;
+    }
+
+    static float surfaceArea(const AABB& box) {
+        glm::vec3 d = box.max - box.min;
+        return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    static AABB combine(const AABB& a, const AABB& b) {
+        return AABB(glm::min(a.min, b.min), glm::max(a.max, b.max));
+    }
+
+    static bool rayHitsBox(const glm::vec3& origin, const glm::vec3& inverseDirection, const AABB& box,
+                           float maxDistance, float& entry) {
+        glm::vec3 t1 = (box.min - origin) * inverseDirection;
+        glm::vec3 t2 = (box.max - origin) * inverseDirection;
+        glm::vec3 tMin = glm::min(t1, t2);
+        glm::vec3 tMax = glm::max(t1, t2);
+        entry = std::max(std::max(tMin.x, tMin.y), std::max(tMin.z, 0.0f));
+        float exit = std::min(std::min(tMax.x, tMax.y), std::min(tMax.z, maxDistance));
+        return entry <= exit;
+    }
+
+    int allocateNode() {
+        int index;
+        if (freeList != NULL_NODE) {
+            index = freeList;
+            freeList = nodes[index].parent;
+            nodes[index] = Node();
+        } else {
+            index = (int) nodes.size();
+            nodes.emplace_back();
+        }
+        return index;
+    }
+
+    void freeNode(int index) {
+        nodes[index] = Node();
+        nodes[index].parent = freeList;
+        freeList = index;
+    }
+
+    void insertLeaf(int leaf) {
+        leafCount++;
+        if (root == NULL_NODE) {
+            root = leaf;
+            nodes[root].parent = NULL_NODE;
+            return;
+        }
+
+        // descend towards the sibling with the cheapest surface area increase
+        const AABB leafBox = nodes[leaf].box;
+        int index = root;
+        while (!nodes[index].IsLeaf()) {
+            int child1 = nodes[index].child1;
+            int child2 = nodes[index].child2;
+            float area = surfaceArea(nodes[index].box);
+            float combinedArea = surfaceArea(combine(nodes[index].box, leafBox));
+            float cost = 2.0f * combinedArea;
+            float inheritanceCost = 2.0f * (combinedArea - area);
+
+            float cost1 = descendCost(child1, leafBox) + inheritanceCost;
+            float cost2 = descendCost(child2, leafBox) + inheritanceCost;
+            if (cost < cost1 && cost < cost2)
+                break;
+            index = cost1 < cost2 ? child1 : child2;
+        }
+
+        int sibling = index;
+        int oldParent = nodes[sibling].parent;
+        int newParent = allocateNode();
+        nodes[newParent].parent = oldParent;
+        nodes[newParent].box = combine(leafBox, nodes[sibling].box);
+        nodes[newParent].height = nodes[sibling].height + 1;
+        nodes[newParent].child1 = sibling;
+        nodes[newParent].child2 = leaf;
+        nodes[sibling].parent = newParent;
+        nodes[leaf].parent = newParent;
+
+        if (oldParent != NULL_NODE) {
+            if (nodes[oldParent].child1 == sibling)
+                nodes[oldParent].child1 = newParent;
+            else
+                nodes[oldParent].child2 = newParent;
+        } else {
+            root = newParent;
+        }
+        refit(nodes[leaf].parent);
+    }
+
+    float descendCost(int child, const AABB& leafBox) const {
+        AABB box = combine(leafBox, nodes[child].box);
+        if (nodes[child].IsLeaf())
+            return surfaceArea(box);
+        return surfaceArea(box) - surfaceArea(nodes[child].box);
+    }
+
+    void removeLeaf(int leaf) {
+        leafCount--;
+        if (leaf == root) {
+            root = NULL_NODE;
+            return;
+        }
+        int parent = nodes[leaf].parent;
+        int grandParent = nodes[parent].parent;
+        int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+        if (grandParent != NULL_NODE) {
+            if (nodes[grandParent].child1 == parent)
+                nodes[grandParent].child1 = sibling;
+            else
+                nodes[grandParent].child2 = sibling;
+            nodes[sibling].parent = grandParent;
+            freeNode(parent);
+            refit(grandParent);
+        } else {
+            root = sibling;
+            nodes[sibling].parent = NULL_NODE;
+            freeNode(parent);
+        }
+        nodes[leaf].parent = NULL_NODE;
+    }
+
+    // walks up from index, rebalancing and recomputing boxes and heights
+    void refit(int index) {
+        while (index != NULL_NODE) {
+            index = balance(index);
+            int child1 = nodes[index].child1;
+            int child2 = nodes[index].child2;
+            nodes[index].height = 1 + std::max(nodes[child1].height, nodes[child2].height);
+            nodes[index].box = combine(nodes[child1].box, nodes[child2].box);
+            index = nodes[index].parent;
+        }
+    }
+
+    // single AVL style rotation when the children heights differ by more than one
+    int balance(int a) {
+        if (nodes[a].IsLeaf() || nodes[a].height < 2)
+            return a;
+        int b = nodes[a].child1;
+        int c = nodes[a].child2;
+        int difference = nodes[c].height - nodes[b].height;
+        if (difference > 1)
+            return rotate(a, c, b);
+        if (difference < -1)
+            return rotate(a, b, c);
+        return a;
+    }
+
+    // promotes the taller child "up" above a; "other" stays below a
+    int rotate(int a, int up, int other) {
+        int f = nodes[up].child1;
+        int g = nodes[up].child2;
+
+        nodes[up].child1 = a;
+        nodes[up].parent = nodes[a].parent;
+        nodes[a].parent = up;
+
+        int upParent = nodes[up].parent;
+        if (upParent != NULL_NODE) {
+            if (nodes[upParent].child1 == a)
+                nodes[upParent].child1 = up;
+            else
+                nodes[upParent].child2 = up;
+        } else {
+            root = up;
+        }
+
+        // keep the taller grandchild next to a's new parent, move the shorter one under a
+        int keep = nodes[f].height > nodes[g].height ? f : g;
+        int move = keep == f ? g : f;
+        nodes[up].child2 = keep;
+        if (nodes[a].child1 == up)
+            nodes[a].child1 = move;
+        else
+            nodes[a].child2 = move;
+        nodes[move].parent = a;
+
+        nodes[a].box = combine(nodes[other].box, nodes[move].box);
+        nodes[a].height = 1 + std::max(nodes[other].height, nodes[move].height);
+        nodes[up].box = combine(nodes[a].box, nodes[keep].box);
+        nodes[up].height = 1 + std::max(nodes[a].height, nodes[keep].height);
+        return up;
+    }
+};
+
+#endif //PROJECT_BASE_BVH_H
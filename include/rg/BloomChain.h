@@ -0,0 +1,204 @@
+#ifndef PROJECT_BASE_BLOOMCHAIN_H
+#define PROJECT_BASE_BLOOMCHAIN_H
+
+#include <vector>
+#include <algorithm>
+#include <glad/glad.h>
+
+#include <rg/Error.h>
+#include <rg/GLState.h>
+#include <rg/ComputePost.h>
+#include <rg/RenderTargetPool.h>
+
+// Dual filter bloom over a pyramid of half resolution steps. The bright buffer is
+// downsampled level by level (level 0 is half the source size), then upsampled back
+// up the pyramid, each level overwriting the one above it. Every tap is a bilinear fetch
+// that lands between texels, so the 5 tap downsample reads a 4x4 block and the 8 tap
+// upsample a tent over 3x3 texels of the smaller level. The blur radius doubles with
+// every level while the whole chain touches about two thirds of the source's pixels.
+//
+// The programs draw a full screen triangle without vertex input (see fullscreen.vs) and
+// sample their source from unit 0. The levels have no depth attachment, so the depth
+// test never rejects anything. The level textures are held from a RenderTargetPool in
+// the format given at construction. With compute programs set and enabled the same filters
+// run as compute dispatches that share their source tiles per workgroup; their image
+// format has to match the levels'.
+class BloomChain {
+public:
+    static const int MAX_LEVELS = 8;
+
+    BloomChain(RenderTargetPool& pool, int width, int height, int levels, GLenum format = GL_RGBA16F)
+            : pool(pool), format(format) {
+        glGenVertexArrays(1, &emptyVAO);
+        this->levels = std::max(1, std::min(levels, MAX_LEVELS));
+        Resize(width, height);
+    }
+
+    ~BloomChain() {
+        release();
+        glDeleteVertexArrays(1, &emptyVAO);
+    }
+
+    BloomChain(const BloomChain&) = delete;
+    BloomChain& operator=(const BloomChain&) = delete;
+
+    void SetPrograms(unsigned int downsample, unsigned int upsample) {
+        downsampleProgram = downsample;
+        upsampleProgram = upsample;
+    }
+
+    // bloomDownsample.comp and bloomUpsample.comp; used instead of the fragment programs
+    // while compute is enabled
+    void SetComputePrograms(const ComputePost* post, unsigned int downsample, unsigned int upsample) {
+        computePost = post;
+        downsampleKernel = downsample;
+        upsampleKernel = upsample;
+    }
+
+    void SetComputeEnabled(bool enabled) {
+        computeEnabled = enabled;
+    }
+
+    bool UsesCompute() const {
+        return computeEnabled && computePost != nullptr && downsampleKernel != 0 && upsampleKernel != 0;
+    }
+
+    // size of the source image; recreates the pyramid if it changed
+    void Resize(int width, int height) {
+        if (width == sourceWidth && height == sourceHeight && !chain.empty())
+            return;
+        sourceWidth = width;
+        sourceHeight = height;
+        create();
+    }
+
+    void SetLevels(int levels) {
+        levels = std::max(1, std::min(levels, MAX_LEVELS));
+        if (levels == this->levels)
+            return;
+        this->levels = levels;
+        create();
+    }
+
+    int GetLevels() const {
+        return chain.size();
+    }
+
+    GLenum GetFormat() const {
+        return format;
+    }
+
+    // the texture Render returns; changes when the pyramid is recreated
+    unsigned int GetOutput() const {
+        return chain[0].texture;
+    }
+
+    // blurs source and returns the half resolution result; leaves the pyramid's last
+    // framebuffer and viewport bound
+    unsigned int Render(unsigned int source) {
+        if (UsesCompute())
+            return dispatch(source);
+        ASSERT(downsampleProgram != 0 && upsampleProgram != 0, "Bloom programs are not set");
+        GLStateCache& state = glState();
+        state.BindVertexArray(emptyVAO);
+
+        state.UseProgram(downsampleProgram);
+        unsigned int input = source;
+        for (const Level& level : chain) {
+            draw(level, input);
+            input = level.texture;
+        }
+
+        state.UseProgram(upsampleProgram);
+        for (int i = (int) chain.size() - 2; i >= 0; i--)
+            draw(chain[i], chain[i + 1].texture);
+        return chain[0].texture;
+    }
+
+private:
+    struct Level {
+        unsigned int framebuffer = 0;
+        unsigned int texture = 0;
+        int width = 0;
+        int height = 0;
+    };
+
+    RenderTargetPool& pool;
+    GLenum format;
+    std::vector<Level> chain;
+    int levels = 1;
+    int sourceWidth = 0;
+    int sourceHeight = 0;
+    unsigned int emptyVAO = 0;
+    unsigned int downsampleProgram = 0;
+    unsigned int upsampleProgram = 0;
+    const ComputePost* computePost = nullptr;
+    unsigned int downsampleKernel = 0;
+    unsigned int upsampleKernel = 0;
+    bool computeEnabled = true;
+
+    static const int GROUP_SIZE = 8;
+
+    unsigned int dispatch(unsigned int source) {
+        GLStateCache& state = glState();
+        state.UseProgram(downsampleKernel);
+        unsigned int input = source;
+        for (const Level& level : chain) {
+            kernel(level, input);
+            input = level.texture;
+        }
+
+        state.UseProgram(upsampleKernel);
+        for (int i = (int) chain.size() - 2; i >= 0; i--)
+            kernel(chain[i], chain[i + 1].texture);
+        return chain[0].texture;
+    }
+
+    // each level is written by one dispatch and read by the next one or by the composite
+    void kernel(const Level& target, unsigned int input) {
+        glState().BindTexture(0, GL_TEXTURE_2D, input);
+        computePost->BindImage(0, target.texture, GL_WRITE_ONLY, format);
+        computePost->Dispatch(target.width, target.height, GROUP_SIZE);
+        computePost->Barrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    }
+
+    void draw(const Level& target, unsigned int input) {
+        GLStateCache& state = glState();
+        state.BindFramebuffer(target.framebuffer);
+        state.Viewport(0, 0, target.width, target.height);
+        state.BindTexture(0, GL_TEXTURE_2D, input);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+
+    void create() {
+        release();
+        int width = sourceWidth, height = sourceHeight;
+        for (int i = 0; i < levels; i++) {
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+            Level level;
+            level.width = width;
+            level.height = height;
+            level.texture = pool.Acquire({ width, height, format, 1 });
+            glGenFramebuffers(1, &level.framebuffer);
+            glBindFramebuffer(GL_FRAMEBUFFER, level.framebuffer);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, level.texture, 0);
+            ASSERT(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE, "Bloom framebuffer not complete");
+            chain.push_back(level);
+            if (width == 1 && height == 1)
+                break;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glState().Invalidate();
+    }
+
+    void release() {
+        for (Level& level : chain) {
+            glDeleteFramebuffers(1, &level.framebuffer);
+            pool.Release(level.texture);
+        }
+        chain.clear();
+    }
+};
+
+#endif //PROJECT_BASE_BLOOMCHAIN_H
@@ -0,0 +1,72 @@
+#ifndef PROJECT_BASE_BOUNDS_H
+#define PROJECT_BASE_BOUNDS_H
+
+#include <glm/glm.hpp>
+#include <cfloat>
+#include <cmath>
+
+// Axis aligned bounding box. A default constructed box is empty (min > max),
+// so it can be grown point by point with Expand.
+struct AABB {
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    AABB() = default;
+    AABB(const glm::vec3& min, const glm::vec3& max) : min(min), max(max) {}
+
+    bool IsEmpty() const {
+        return min.x > max.x || min.y > max.y || min.z > max.z;
+    }
+
+    glm::vec3 Center() const {
+        return (min + max) * 0.5f;
+    }
+
+    glm::vec3 Extents() const {
+        return (max - min) * 0.5f;
+    }
+
+    void Expand(const glm::vec3& point) {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void Expand(const AABB& other) {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    // box that encloses this box after the affine transform m (Arvo's method)
+    AABB Transformed(const glm::mat4& m) const {
+        if (IsEmpty())
+            return *this;
+        glm::vec3 center = glm::vec3(m * glm::vec4(Center(), 1.0f));
+        glm::vec3 extents = Extents();
+        glm::vec3 worldExtents;
+        for (int row = 0; row < 3; row++) {
+            worldExtents[row] = std::fabs(m[0][row]) * extents.x
+                              + std::fabs(m[1][row]) * extents.y
+                              + std::fabs(m[2][row]) * extents.z;
+        }
+        return AABB(center - worldExtents, center + worldExtents);
+    }
+};
+
+struct BoundingSphere {
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+
+    BoundingSphere() = default;
+    BoundingSphere(const glm::vec3& center, float radius) : center(center), radius(radius) {}
+
+    // the radius is scaled by the largest axis scale, so non-uniform scale stays conservative
+    BoundingSphere Transformed(const glm::mat4& m) const {
+        float sx = glm::dot(glm::vec3(m[0]), glm::vec3(m[0]));
+        float sy = glm::dot(glm::vec3(m[1]), glm::vec3(m[1]));
+        float sz = glm::dot(glm::vec3(m[2]), glm::vec3(m[2]));
+        float maxScale = std::sqrt(std::fmax(sx, std::fmax(sy, sz)));
+        return BoundingSphere(glm::vec3(m * glm::vec4(center, 1.0f)), radius * maxScale);
+    }
+};
+
+#endif //PROJECT_BASE_BOUNDS_H
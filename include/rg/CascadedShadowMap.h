@@ -0,0 +1,318 @@
+#ifndef PROJECT_BASE_CASCADEDSHADOWMAP_H
+#define PROJECT_BASE_CASCADEDSHADOWMAP_H
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <learnopengl/model.h>
+#include <rg/Error.h>
+#include <rg/GLState.h>
+#include <rg/Frustum.h>
+#include <rg/Scene.h>
+
+// Shadow cascades of a directional light that are only re-rendered when they have to be.
+// Each cascade covers a slice of the view frustum with a square a margin larger than the
+// slice's bounding sphere; the sphere doesn't change size when the camera turns and the
+// square only moves in whole texels, so the cascade stays valid until the camera walks out
+// of the margin, the light turns or a static renderer moves (Scene::GetStaticVersion).
+//
+// Static casters are cached in one depth array. Every frame a cascade that has dynamic
+// casters in it gets a copy of its static layer with the dynamic casters drawn on top;
+// cascades without any keep last frame's layer. Distant cascades that went stale only
+// re-render on alternate frames. The shader picks the first cascade whose square holds the
+// point, so a deferred cascade leaves the next one to cover the gap for that frame.
+//
+// The depth program is shadowDepth.vs and shadowDepth.fs.
+class CascadedShadowMap {
+public:
+    static const int MAX_CASCADES = 4;
+
+    struct Stats {
+        unsigned int cascades = 0;
+        // cascades whose static casters were redrawn this frame and since the start
+        unsigned int staticRenders = 0;
+        unsigned int totalStaticRenders = 0;
+        // re-renders of distant cascades pushed to the next frame
+        unsigned int deferred = 0;
+        unsigned int dynamicCasters = 0;
+        unsigned int draws = 0;
+    };
+
+    // depthFormat: orthographic depth is linear, 16 bits cover the casters' range
+    CascadedShadowMap(int size, int cascades, GLenum depthFormat = GL_DEPTH_COMPONENT24) : size(size), depthFormat(depthFormat) {
+        this->cascades.resize(std::max(1, std::min(cascades, MAX_CASCADES)));
+        staticMap = createArray();
+        shadowMap = createArray();
+        for (Cascade& cascade : this->cascades) {
+            int layer = &cascade - &this->cascades[0];
+            cascade.staticFramebuffer = createFramebuffer(staticMap, layer);
+            cascade.framebuffer = createFramebuffer(shadowMap, layer);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glState().Invalidate();
+    }
+
+    ~CascadedShadowMap() {
+        for (Cascade& cascade : cascades) {
+            glDeleteFramebuffers(1, &cascade.staticFramebuffer);
+            glDeleteFramebuffers(1, &cascade.framebuffer);
+        }
+        glDeleteTextures(1, &staticMap);
+        glDeleteTextures(1, &shadowMap);
+    }
+
+    CascadedShadowMap(const CascadedShadowMap&) = delete;
+    CascadedShadowMap& operator=(const CascadedShadowMap&) = delete;
+
+    void SetProgram(unsigned int program) {
+        this->program = program;
+        lightViewProjectionLocation = glGetUniformLocation(program, "lightViewProjection");
+        modelLocation = glGetUniformLocation(program, "model");
+    }
+
+    // direction the light travels in
+    void SetLight(const glm::vec3& direction) {
+        glm::vec3 up = std::fabs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::mat4 view = glm::lookAt(glm::vec3(0.0f), direction, up);
+        if (view != lightView) {
+            lightView = view;
+            for (Cascade& cascade : cascades)
+                cascade.valid = false;
+        }
+    }
+
+    // how far from the camera the cascades reach
+    void SetDistance(float distance) {
+        this->distance = distance;
+    }
+
+    // fits the cascades to the camera and decides which ones to redraw; the matrices are
+    // valid from here on, the drawing happens in Render
+    void Prepare(const Scene& scene, const glm::mat4& view, float fovy, float aspect, float nearPlane) {
+        frame++;
+        stats.cascades = cascades.size();
+        stats.staticRenders = stats.deferred = 0;
+        glm::mat4 cameraToWorld = glm::inverse(view);
+        float tanHalfFov = std::tan(fovy * 0.5f);
+        float diagonal = tanHalfFov * std::sqrt(1.0f + aspect * aspect);
+        int count = cascades.size();
+        for (int i = 0; i < count; i++) {
+            Cascade& cascade = cascades[i];
+            float sliceNear = i == 0 ? nearPlane : split(i, nearPlane);
+            float sliceFar = split(i + 1, nearPlane);
+            // the sphere through the slice's near and far corners, centered on the view axis
+            float a = sliceNear * diagonal, b = sliceFar * diagonal;
+            float center = (sliceFar * sliceFar + b * b - sliceNear * sliceNear - a * a) / (2.0f * (sliceFar - sliceNear));
+            center = std::min(center, sliceFar);
+            float radius = std::ceil(std::sqrt(std::max((center - sliceNear) * (center - sliceNear) + a * a,
+                                                        (sliceFar - center) * (sliceFar - center) + b * b)));
+            float extent = std::ceil(radius * MARGIN);
+            glm::vec3 lightCenter = glm::vec3(lightView * cameraToWorld * glm::vec4(0.0f, 0.0f, -center, 1.0f));
+
+            bool covered = cascade.valid && extent == cascade.extent
+                           && std::fabs(lightCenter.x - cascade.center.x) + radius <= extent
+                           && std::fabs(lightCenter.y - cascade.center.y) + radius <= extent;
+            cascade.render = !covered || cascade.staticVersion != scene.GetStaticVersion();
+            if (cascade.render && cascade.valid && i > 0 && (frame + i) % 2 != 0) {
+                cascade.render = false;
+                stats.deferred++;
+                continue;
+            }
+            if (!cascade.render)
+                continue;
+            // the square moves in whole texels so re-rendered static shadows don't swim
+            float texel = 2.0f * extent / size;
+            cascade.extent = extent;
+            cascade.center = glm::vec2(std::floor(lightCenter.x / texel) * texel, std::floor(lightCenter.y / texel) * texel);
+            cascade.staticVersion = scene.GetStaticVersion();
+            cascade.valid = true;
+            fitDepth(scene, cascade);
+        }
+    }
+
+    // draws the stale cascades and the dynamic casters; leaves the last cascade's
+    // framebuffer bound
+    void Render(const Scene& scene) {
+        ASSERT(program != 0, "Shadow depth program is not set");
+        stats.dynamicCasters = stats.draws = 0;
+        GLStateCache& state = glState();
+        state.UseProgram(program);
+        state.Viewport(0, 0, size, size);
+        state.SetDepthTest(true);
+        state.DepthMask(true);
+        state.DepthFunc(GL_LESS);
+        state.SetCullFace(false);
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(2.0f, 4.0f);
+        for (Cascade& cascade : cascades) {
+            Frustum frustum = Frustum::FromMatrix(cascade.viewProjection);
+            glUniformMatrix4fv(lightViewProjectionLocation, 1, GL_FALSE, glm::value_ptr(cascade.viewProjection));
+            if (cascade.render) {
+                state.BindFramebuffer(cascade.staticFramebuffer);
+                glClear(GL_DEPTH_BUFFER_BIT);
+                gatherCasters(scene, frustum, false);
+                drawCasters(scene);
+                stats.staticRenders++;
+                stats.totalStaticRenders++;
+            }
+            gatherCasters(scene, frustum, true);
+            // last frame's dynamic casters have to be wiped even if none are left
+            if (cascade.render || !casters.empty() || cascade.hadDynamicCasters) {
+                state.BindFramebuffer(cascade.framebuffer);
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, cascade.staticFramebuffer);
+                glBlitFramebuffer(0, 0, size, size, 0, 0, size, size, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, cascade.framebuffer);
+                drawCasters(scene);
+            }
+            cascade.hadDynamicCasters = !casters.empty();
+            stats.dynamicCasters += casters.size();
+        }
+        glDisable(GL_POLYGON_OFFSET_FILL);
+    }
+
+    // depth array with one layer per cascade, set up for comparison sampling
+    unsigned int GetTexture() const {
+        return shadowMap;
+    }
+
+    GLenum GetDepthFormat() const {
+        return depthFormat;
+    }
+
+    int GetCascadeCount() const {
+        return cascades.size();
+    }
+
+    // world space to the cascade's shadow map coordinates and depth, all in [0, 1]
+    glm::mat4 GetMatrix(int cascade) const {
+        const glm::mat4 bias = glm::translate(glm::mat4(1.0f), glm::vec3(0.5f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.5f));
+        return bias * cascades[cascade].viewProjection;
+    }
+
+    const Stats& GetStats() const {
+        return stats;
+    }
+
+private:
+    // how much larger than the slice's sphere a cascade is drawn
+    static constexpr float MARGIN = 1.25f;
+    // share of the logarithmic split scheme, the rest is uniform
+    static constexpr float LOGARITHMIC_SPLITS = 0.8f;
+
+    struct Cascade {
+        unsigned int staticFramebuffer = 0;
+        unsigned int framebuffer = 0;
+        bool valid = false;
+        bool render = false;
+        bool hadDynamicCasters = false;
+        unsigned int staticVersion = 0;
+        // light space center and half size of the square
+        glm::vec2 center = glm::vec2(0.0f);
+        float extent = 0.0f;
+        glm::mat4 viewProjection = glm::mat4(1.0f);
+    };
+
+    int size;
+    GLenum depthFormat;
+    std::vector<Cascade> cascades;
+    unsigned int staticMap = 0;
+    unsigned int shadowMap = 0;
+    // renderer indices of the casters being drawn
+    std::vector<int> casters;
+    unsigned int program = 0;
+    int lightViewProjectionLocation = -1;
+    int modelLocation = -1;
+    glm::mat4 lightView = glm::mat4(1.0f);
+    float distance = 150.0f;
+    unsigned long long frame = 0;
+    Stats stats;
+
+    static bool castsShadow(const MeshRenderer& renderer) {
+        return renderer.model != nullptr && renderer.pass == MeshRenderer::LIT;
+    }
+
+    float split(int index, float nearPlane) const {
+        float fraction = (float) index / cascades.size();
+        float logarithmic = nearPlane * std::pow(distance / nearPlane, fraction);
+        float uniform = nearPlane + (distance - nearPlane) * fraction;
+        return LOGARITHMIC_SPLITS * logarithmic + (1.0f - LOGARITHMIC_SPLITS) * uniform;
+    }
+
+    // the depth range covers every caster, so casters outside the square still shadow into it
+    void fitDepth(const Scene& scene, Cascade& cascade) {
+        float nearest = FLT_MAX, farthest = -FLT_MAX;
+        for (int i = 0; i < scene.meshRenderers.Size(); i++) {
+            const MeshRenderer& renderer = scene.meshRenderers[i];
+            if (!castsShadow(renderer))
+                continue;
+            AABB bounds = renderer.worldBounds.Transformed(lightView);
+            nearest = std::min(nearest, -bounds.max.z);
+            farthest = std::max(farthest, -bounds.min.z);
+        }
+        if (nearest > farthest)
+            nearest = farthest = 0.0f;
+        glm::mat4 projection = glm::ortho(cascade.center.x - cascade.extent, cascade.center.x + cascade.extent,
+                                          cascade.center.y - cascade.extent, cascade.center.y + cascade.extent,
+                                          nearest - 1.0f, farthest + 1.0f);
+        cascade.viewProjection = projection * lightView;
+    }
+
+    void gatherCasters(const Scene& scene, const Frustum& frustum, bool dynamic) {
+        casters.clear();
+        for (int i = 0; i < scene.meshRenderers.Size(); i++) {
+            const MeshRenderer& renderer = scene.meshRenderers[i];
+            if (renderer.dynamic == dynamic && castsShadow(renderer) && frustum.Intersects(renderer.worldBounds))
+                casters.push_back(i);
+        }
+    }
+
+    void drawCasters(const Scene& scene) {
+        GLStateCache& state = glState();
+        for (int i : casters) {
+            const MeshRenderer& renderer = scene.meshRenderers[i];
+            glUniformMatrix4fv(modelLocation, 1, GL_FALSE, glm::value_ptr(scene.hierarchy.GetWorldMatrix(renderer.node)));
+            for (const Mesh& mesh : renderer.model->meshes) {
+                state.BindVertexArray(mesh.VAO);
+                glDrawElements(GL_TRIANGLES, mesh.indices.size(), GL_UNSIGNED_INT, 0);
+                stats.draws++;
+            }
+        }
+    }
+
+    unsigned int createArray() const {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, depthFormat, size, size, cascades.size(), 0,
+                     GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        // outside the map nothing is in shadow
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        const float border[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+        glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        return texture;
+    }
+
+    static unsigned int createFramebuffer(unsigned int texture, int layer) {
+        unsigned int framebuffer;
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, layer);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        ASSERT(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE, "Shadow framebuffer not complete");
+        return framebuffer;
+    }
+};
+
+#endif //PROJECT_BASE_CASCADEDSHADOWMAP_H
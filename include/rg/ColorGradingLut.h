@@ -0,0 +1,131 @@
+#ifndef PROJECT_BASE_COLORGRADINGLUT_H
+#define PROJECT_BASE_COLORGRADINGLUT_H
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <rg/GLState.h>
+
+// Tonemapping and color grading baked into a SIZE^3 3D texture, so the composite
+// replaces its per pixel curve math with one trilinear fetch. The LUT is indexed by the
+// log2 of the exposed scene color over [MIN_LOG, MAX_LOG], which spends its texels evenly
+// over stops instead of crowding them into the brights. Colors below the range clamp to
+// the first texel, which is black; colors above to the last.
+//
+// The output is display linear for a target that encodes to sRGB on write, or already
+// encoded where the target can't. The texture is rebuilt on the CPU whenever the
+// settings change.
+class ColorGradingLut {
+public:
+    static const int SIZE = 32;
+    static constexpr float MIN_LOG = -12.0f;
+    static constexpr float MAX_LOG = 4.0f;
+
+    struct Settings {
+        // slope around mid grey in log space
+        float contrast = 1.0f;
+        float saturation = 1.0f;
+        // negative is cooler, positive warmer
+        float temperature = 0.0f;
+
+        bool operator==(const Settings& other) const {
+            return contrast == other.contrast && saturation == other.saturation && temperature == other.temperature;
+        }
+    };
+
+    explicit ColorGradingLut(bool encodeSrgb) : encodeSrgb(encodeSrgb) {
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_3D, texture);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_3D, 0);
+        glState().Invalidate();
+        build();
+    }
+
+    ~ColorGradingLut() {
+        glDeleteTextures(1, &texture);
+    }
+
+    ColorGradingLut(const ColorGradingLut&) = delete;
+    ColorGradingLut& operator=(const ColorGradingLut&) = delete;
+
+    // rebuilds the texture if the settings changed
+    void SetSettings(const Settings& settings) {
+        if (settings == this->settings)
+            return;
+        this->settings = settings;
+        build();
+    }
+
+    unsigned int GetTexture() const {
+        return texture;
+    }
+
+    // scale and offset from log2(color) to texture coordinates on the texel centers
+    static glm::vec2 GetTransform() {
+        float scale = (SIZE - 1.0f) / SIZE / (MAX_LOG - MIN_LOG);
+        return glm::vec2(scale, -MIN_LOG * scale + 0.5f / SIZE);
+    }
+
+private:
+    Settings settings;
+    bool encodeSrgb;
+    unsigned int texture = 0;
+
+    static float toSrgb(float linear) {
+        return linear <= 0.0031308f ? linear * 12.92f : 1.055f * std::pow(linear, 1.0f / 2.4f) - 0.055f;
+    }
+
+    // exposed scene color to display color
+    glm::vec3 grade(glm::vec3 color) const {
+        const float middleGrey = 0.18f;
+        glm::vec3 balance(1.0f + 0.1f * settings.temperature, 1.0f, 1.0f - 0.1f * settings.temperature);
+        color *= balance;
+        for (int c = 0; c < 3; c++) {
+            float stops = std::log2(std::max(color[c], 1e-10f) / middleGrey);
+            color[c] = middleGrey * std::exp2(stops * settings.contrast);
+        }
+        float luminance = glm::dot(color, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+        color = glm::max(glm::vec3(luminance) + (color - glm::vec3(luminance)) * settings.saturation, glm::vec3(0.0f));
+        // the exponential curve the composite used to evaluate per pixel
+        for (int c = 0; c < 3; c++) {
+            color[c] = 1.0f - std::exp(-color[c]);
+            if (encodeSrgb)
+                color[c] = toSrgb(color[c]);
+        }
+        return color;
+    }
+
+    void build() {
+        std::vector<float> texels(SIZE * SIZE * SIZE * 3);
+        for (int b = 0; b < SIZE; b++) {
+            for (int g = 0; g < SIZE; g++) {
+                for (int r = 0; r < SIZE; r++) {
+                    int index[3] = { r, g, b };
+                    glm::vec3 color;
+                    for (int c = 0; c < 3; c++)
+                        color[c] = index[c] == 0 ? 0.0f : std::exp2(MIN_LOG + (MAX_LOG - MIN_LOG) * index[c] / (SIZE - 1.0f));
+                    glm::vec3 graded = grade(color);
+                    float* texel = &texels[((b * SIZE + g) * SIZE + r) * 3];
+                    texel[0] = graded.r;
+                    texel[1] = graded.g;
+                    texel[2] = graded.b;
+                }
+            }
+        }
+        glState().BindTexture(0, GL_TEXTURE_3D, texture);
+        glTexImage3D(GL_TEXTURE_3D, 0, GL_RGB16F, SIZE, SIZE, SIZE, 0, GL_RGB, GL_FLOAT, texels.data());
+    }
+};
+
+constexpr float ColorGradingLut::MIN_LOG;
+constexpr float ColorGradingLut::MAX_LOG;
+
+#endif //PROJECT_BASE_COLORGRADINGLUT_H
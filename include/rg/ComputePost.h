@@ -0,0 +1,112 @@
+#ifndef PROJECT_BASE_COMPUTEPOST_H
+#define PROJECT_BASE_COMPUTEPOST_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <glad/glad.h>
+
+#include <rg/Error.h>
+#include <rg/GLState.h>
+#include <rg/ShaderPreprocessor.h>
+
+// compute shaders are core since 4.3 and not part of the 3.3 loader, so their entry
+// points and enums are looked up by hand
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#endif
+#ifndef GL_TEXTURE_FETCH_BARRIER_BIT
+#define GL_TEXTURE_FETCH_BARRIER_BIT 0x00000008
+#endif
+#ifndef GL_SHADER_IMAGE_ACCESS_BARRIER_BIT
+#define GL_SHADER_IMAGE_ACCESS_BARRIER_BIT 0x00000020
+#endif
+#ifndef GL_FRAMEBUFFER_BARRIER_BIT
+#define GL_FRAMEBUFFER_BARRIER_BIT 0x00000400
+#endif
+typedef void (APIENTRYP PFNGLDISPATCHCOMPUTEPROC_RG)(GLuint x, GLuint y, GLuint z);
+typedef void (APIENTRYP PFNGLMEMORYBARRIERPROC_RG)(GLbitfield barriers);
+typedef void (APIENTRYP PFNGLBINDIMAGETEXTUREPROC_RG)(GLuint unit, GLuint texture, GLint level, GLboolean layered,
+                                                       GLint layer, GLenum access, GLenum format);
+
+// Runs post processing kernels as compute dispatches when the context is 4.3 or newer.
+// Kernels read their inputs with texelFetch, keep the tile a workgroup needs in shared
+// memory and write their output through image units; IsSupported tells the caller
+// whether to use them or the fragment passes. The bloom filters and the auto exposure
+// reduction have kernels.
+class ComputePost {
+public:
+    explicit ComputePost(GLADloadproc load) {
+        int major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        if (major < 4 || (major == 4 && minor < 3))
+            return;
+        dispatchCompute = (PFNGLDISPATCHCOMPUTEPROC_RG) load("glDispatchCompute");
+        memoryBarrier = (PFNGLMEMORYBARRIERPROC_RG) load("glMemoryBarrier");
+        bindImageTexture = (PFNGLBINDIMAGETEXTUREPROC_RG) load("glBindImageTexture");
+        supported = dispatchCompute != nullptr && memoryBarrier != nullptr && bindImageTexture != nullptr;
+    }
+
+    bool IsSupported() const {
+        return supported;
+    }
+
+    // compiles and links a compute program with #includes expanded; returns 0 if it does
+    // not compile
+    unsigned int CreateProgram(const std::string& path, const ShaderDefines& defines = ShaderDefines()) const {
+        ASSERT(supported, "Compute shaders need a 4.3 context");
+        std::string source;
+        std::vector<std::string> files;
+        if (!ShaderPreprocessor::Load(path, defines, source, files))
+            return 0;
+        const char* code = source.c_str();
+        unsigned int shader = glCreateShader(GL_COMPUTE_SHADER);
+        glShaderSource(shader, 1, &code, NULL);
+        glCompileShader(shader);
+        int success = 0;
+        char infoLog[1024];
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+        if (!success) {
+            glGetShaderInfoLog(shader, 1024, NULL, infoLog);
+            std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: COMPUTE (" << path << ")\n" << infoLog << std::endl;
+            glDeleteShader(shader);
+            return 0;
+        }
+        unsigned int program = glCreateProgram();
+        glAttachShader(program, shader);
+        glLinkProgram(program);
+        glDeleteShader(shader);
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) {
+            glGetProgramInfoLog(program, 1024, NULL, infoLog);
+            std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: COMPUTE (" << path << ")\n" << infoLog << std::endl;
+            glDeleteProgram(program);
+            return 0;
+        }
+        return program;
+    }
+
+    // binds a level of a 2D texture to an image unit
+    void BindImage(unsigned int unit, unsigned int texture, GLenum access, GLenum format, int level = 0) const {
+        bindImageTexture(unit, texture, level, GL_FALSE, 0, access, format);
+    }
+
+    // one workgroup per groupSize x groupSize tile of a width x height output
+    void Dispatch(int width, int height, int groupSize) const {
+        dispatchCompute((width + groupSize - 1) / groupSize, (height + groupSize - 1) / groupSize, 1);
+    }
+
+    // makes image writes of earlier dispatches visible to the reads named by barriers
+    void Barrier(GLbitfield barriers) const {
+        memoryBarrier(barriers);
+    }
+
+private:
+    bool supported = false;
+    PFNGLDISPATCHCOMPUTEPROC_RG dispatchCompute = nullptr;
+    PFNGLMEMORYBARRIERPROC_RG memoryBarrier = nullptr;
+    PFNGLBINDIMAGETEXTUREPROC_RG bindImageTexture = nullptr;
+};
+
+#endif //PROJECT_BASE_COMPUTEPOST_H
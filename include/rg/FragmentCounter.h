@@ -0,0 +1,92 @@
+#ifndef PROJECT_BASE_FRAGMENTCOUNTER_H
+#define PROJECT_BASE_FRAGMENTCOUNTER_H
+
+#include <cstring>
+#include <glad/glad.h>
+
+// pipeline statistics queries are core since 4.6 and not part of the 3.3 loader
+#ifndef GL_FRAGMENT_SHADER_INVOCATIONS_ARB
+#define GL_FRAGMENT_SHADER_INVOCATIONS_ARB 0x82F4
+#endif
+
+// Counts the fragments a stretch of draws shades, to measure overdraw: fragment shader
+// invocations where the context has pipeline statistics queries, otherwise the samples
+// that pass the depth test. Results are read QUERIES - 1 frames later without waiting, and
+// kept apart for frames drawn with and without a depth pre-pass so both can be compared.
+class FragmentCounter {
+public:
+    static const int QUERIES = 4;
+
+    struct Stats {
+        // counts shader invocations rather than samples passing the depth test
+        bool invocations = false;
+        unsigned long long fragments = 0;
+        // fragments per pixel of the last frame read back with and without a pre-pass
+        double overdraw = 0.0;
+        double overdrawWithoutPrepass = 0.0;
+        double overdrawWithPrepass = 0.0;
+    };
+
+    FragmentCounter() {
+        int major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        bool statistics = major > 4 || (major == 4 && minor >= 6);
+        int extensions = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extensions);
+        for (int i = 0; i < extensions && !statistics; i++)
+            statistics = std::strcmp((const char*) glGetStringi(GL_EXTENSIONS, i), "GL_ARB_pipeline_statistics_query") == 0;
+        target = statistics ? GL_FRAGMENT_SHADER_INVOCATIONS_ARB : GL_SAMPLES_PASSED;
+        stats.invocations = statistics;
+        glGenQueries(QUERIES, queries);
+    }
+
+    ~FragmentCounter() {
+        glDeleteQueries(QUERIES, queries);
+    }
+
+    FragmentCounter(const FragmentCounter&) = delete;
+    FragmentCounter& operator=(const FragmentCounter&) = delete;
+
+    // pixels is the size of the target the counted draws cover
+    void Begin(unsigned long long pixels, bool prepass) {
+        int slot = frame % QUERIES;
+        this->pixels[slot] = pixels;
+        this->prepass[slot] = prepass;
+        glBeginQuery(target, queries[slot]);
+    }
+
+    void End() {
+        glEndQuery(target);
+        frame++;
+        if (frame < QUERIES)
+            return;
+        int slot = frame % QUERIES;
+        int available = 0;
+        glGetQueryObjectiv(queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return;
+        GLuint64 fragments = 0;
+        glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &fragments);
+        stats.fragments = fragments;
+        stats.overdraw = (double) fragments / pixels[slot];
+        if (prepass[slot])
+            stats.overdrawWithPrepass = stats.overdraw;
+        else
+            stats.overdrawWithoutPrepass = stats.overdraw;
+    }
+
+    const Stats& GetStats() const {
+        return stats;
+    }
+
+private:
+    GLenum target;
+    unsigned int queries[QUERIES];
+    unsigned long long pixels[QUERIES] = {};
+    bool prepass[QUERIES] = {};
+    unsigned long long frame = 0;
+    Stats stats;
+};
+
+#endif //PROJECT_BASE_FRAGMENTCOUNTER_H
@@ -0,0 +1,180 @@
+#ifndef PROJECT_BASE_FRAMEGOVERNOR_H
+#define PROJECT_BASE_FRAMEGOVERNOR_H
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <glad/glad.h>
+
+#include <rg/Error.h>
+
+// Holds the GPU frame time under a target by trading quality. Quality knobs are registered
+// in the order they should be given up: when the frame is over budget the first knob that
+// is still above its minimum drops one step, when it has been well under budget for a
+// while the last lowered knob comes back one step. A single frame far over the target
+// lowers quality right away, raising it again takes a long calm stretch, so spikes are cut
+// short and quality doesn't oscillate.
+//
+// GPU time comes from GL_TIME_ELAPSED queries read back QUERIES - 1 frames later, so the
+// governor never waits for the GPU; after a change it waits for that latency before it
+// judges the result.
+class FrameGovernor {
+public:
+    static const int QUERIES = 4;
+
+    struct Knob {
+        std::string name;
+        float value;
+        float min;
+        float max;
+        float step;
+    };
+
+    struct Stats {
+        double cpuMilliseconds = 0.0;
+        double gpuMilliseconds = 0.0;
+        // smoothed GPU time the decisions are based on
+        double averageMilliseconds = 0.0;
+        unsigned int lowered = 0;
+        unsigned int raised = 0;
+    };
+
+    FrameGovernor() {
+        glGenQueries(QUERIES, queries);
+    }
+
+    ~FrameGovernor() {
+        glDeleteQueries(QUERIES, queries);
+    }
+
+    FrameGovernor(const FrameGovernor&) = delete;
+    FrameGovernor& operator=(const FrameGovernor&) = delete;
+
+    // knobs start at their maximum
+    int AddKnob(const std::string& name, float min, float max, float step) {
+        ASSERT(min <= max && step > 0.0f, "Invalid quality knob range");
+        knobs.push_back({ name, max, min, max, step });
+        return knobs.size() - 1;
+    }
+
+    float GetValue(int knob) const {
+        return knobs[knob].value;
+    }
+
+    const std::vector<Knob>& GetKnobs() const {
+        return knobs;
+    }
+
+    void SetTarget(float milliseconds) {
+        targetMilliseconds = milliseconds;
+    }
+
+    // a disabled governor puts every knob back to its maximum and leaves it there
+    void SetEnabled(bool enabled) {
+        if (enabled == this->enabled)
+            return;
+        this->enabled = enabled;
+        for (Knob& knob : knobs)
+            knob.value = knob.max;
+        calmFrames = 0;
+        cooldown = QUERIES;
+    }
+
+    void BeginFrame() {
+        cpuStart = std::chrono::high_resolution_clock::now();
+        glBeginQuery(GL_TIME_ELAPSED, queries[frame % QUERIES]);
+    }
+
+    // call after the frame's last GL command and before swapping buffers
+    void EndFrame() {
+        glEndQuery(GL_TIME_ELAPSED);
+        auto cpuEnd = std::chrono::high_resolution_clock::now();
+        stats.cpuMilliseconds = std::chrono::duration<double, std::milli>(cpuEnd - cpuStart).count();
+        frame++;
+        // the oldest query; its frame finished on the GPU long ago unless we're far behind
+        if (frame < QUERIES)
+            return;
+        unsigned int query = queries[frame % QUERIES];
+        int available = 0;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return;
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+        stats.gpuMilliseconds = nanoseconds / 1e6;
+        stats.averageMilliseconds = stats.averageMilliseconds == 0.0 ? stats.gpuMilliseconds
+                : stats.averageMilliseconds * 0.9 + stats.gpuMilliseconds * 0.1;
+        if (enabled)
+            adjust();
+    }
+
+    const Stats& GetStats() const {
+        return stats;
+    }
+
+private:
+    // frames well under budget before quality goes up one step
+    static const int CALM_FRAMES = 60;
+
+    std::vector<Knob> knobs;
+    unsigned int queries[QUERIES];
+    unsigned long long frame = 0;
+    std::chrono::high_resolution_clock::time_point cpuStart;
+    float targetMilliseconds = 16.6f;
+    bool enabled = true;
+    int calmFrames = 0;
+    int cooldown = 0;
+    Stats stats;
+
+    void adjust() {
+        if (cooldown > 0) {
+            cooldown--;
+            return;
+        }
+        bool spike = stats.gpuMilliseconds > targetMilliseconds * 1.5;
+        bool over = stats.averageMilliseconds > targetMilliseconds * 1.05;
+        if (spike || over) {
+            calmFrames = 0;
+            if (lower()) {
+                stats.lowered++;
+                // the average still remembers the expensive frames
+                stats.averageMilliseconds = stats.gpuMilliseconds;
+                cooldown = QUERIES;
+            }
+            return;
+        }
+        if (stats.averageMilliseconds < targetMilliseconds * 0.8)
+            calmFrames++;
+        else
+            calmFrames = 0;
+        if (calmFrames >= CALM_FRAMES && raise()) {
+            stats.raised++;
+            calmFrames = 0;
+            cooldown = QUERIES;
+        }
+    }
+
+    bool lower() {
+        for (Knob& knob : knobs) {
+            if (knob.value > knob.min) {
+                knob.value = std::max(knob.min, knob.value - knob.step);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool raise() {
+        for (int i = (int) knobs.size() - 1; i >= 0; i--) {
+            Knob& knob = knobs[i];
+            if (knob.value < knob.max) {
+                knob.value = std::min(knob.max, knob.value + knob.step);
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+#endif //PROJECT_BASE_FRAMEGOVERNOR_H
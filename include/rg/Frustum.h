@@ -0,0 +1,57 @@
+#ifndef PROJECT_BASE_FRUSTUM_H
+#define PROJECT_BASE_FRUSTUM_H
+
+#include <glm/glm.hpp>
+#include <rg/Bounds.h>
+
+// View frustum as six planes (ax + by + cz + d >= 0 is inside), extracted from
+// a projection * view matrix (Gribb/Hartmann). Plane normals point inwards.
+struct Frustum {
+    enum { LEFT_PLANE, RIGHT_PLANE, BOTTOM_PLANE, TOP_PLANE, NEAR_PLANE, FAR_PLANE, PLANE_COUNT };
+    glm::vec4 planes[PLANE_COUNT];
+
+    static Frustum FromMatrix(const glm::mat4& viewProjection) {
+        Frustum frustum;
+        const glm::mat4& m = viewProjection;
+        glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+        frustum.planes[LEFT_PLANE] = row3 + row0;
+        frustum.planes[RIGHT_PLANE] = row3 - row0;
+        frustum.planes[BOTTOM_PLANE] = row3 + row1;
+        frustum.planes[TOP_PLANE] = row3 - row1;
+        frustum.planes[NEAR_PLANE] = row3 + row2;
+        frustum.planes[FAR_PLANE] = row3 - row2;
+
+        for (glm::vec4& plane : frustum.planes) {
+            float length = glm::length(glm::vec3(plane));
+            plane /= length;
+        }
+        return frustum;
+    }
+
+    bool Intersects(const AABB& box) const {
+        glm::vec3 center = box.Center();
+        glm::vec3 extents = box.Extents();
+        for (const glm::vec4& plane : planes) {
+            glm::vec3 normal(plane);
+            float distance = glm::dot(normal, center) + plane.w;
+            float radius = glm::dot(glm::abs(normal), extents);
+            if (distance + radius < 0.0f)
+                return false;
+        }
+        return true;
+    }
+
+    bool Intersects(const BoundingSphere& sphere) const {
+        for (const glm::vec4& plane : planes) {
+            if (glm::dot(glm::vec3(plane), sphere.center) + plane.w < -sphere.radius)
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif //PROJECT_BASE_FRUSTUM_H
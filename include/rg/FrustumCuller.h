@@ -0,0 +1,150 @@
+#ifndef PROJECT_BASE_FRUSTUMCULLER_H
+#define PROJECT_BASE_FRUSTUMCULLER_H
+
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <immintrin.h>
+
+#include <rg/Bounds.h>
+#include <rg/Frustum.h>
+
+// Culls world space boxes against a frustum. Boxes are kept as structure of arrays
+// (center and extents per axis) padded to a multiple of eight, so the kernel tests
+// eight boxes per batch: one AVX register, or two SSE registers when the build
+// doesn't enable AVX (see RG_ENABLE_AVX2 in CMakeLists.txt).
+class FrustumCuller {
+public:
+    static const unsigned int BATCH = 8;
+
+    struct Stats {
+        unsigned int total = 0;
+        unsigned int visible = 0;
+        double milliseconds = 0.0;
+    };
+
+    unsigned int Add(const AABB& worldBounds) {
+        unsigned int index = count++;
+        if (count > centerX.size())
+            grow();
+        Update(index, worldBounds);
+        return index;
+    }
+
+    void Update(unsigned int index, const AABB& worldBounds) {
+        glm::vec3 center = worldBounds.Center();
+        glm::vec3 extents = worldBounds.Extents();
+        centerX[index] = center.x;
+        centerY[index] = center.y;
+        centerZ[index] = center.z;
+        extentX[index] = extents.x;
+        extentY[index] = extents.y;
+        extentZ[index] = extents.z;
+    }
+
+    void Clear() {
+        count = 0;
+    }
+
+    unsigned int Size() const {
+        return count;
+    }
+
+    bool IsVisible(unsigned int index) const {
+        return visible[index] != 0;
+    }
+
+    const Stats& GetStats() const {
+        return stats;
+    }
+
+    void Cull(const Frustum& frustum) {
+        auto start = std::chrono::high_resolution_clock::now();
+        unsigned int batches = (count + BATCH - 1) / BATCH;
+        for (unsigned int batch = 0; batch < batches; batch++)
+            cullBatch(frustum, batch * BATCH);
+
+        stats.total = count;
+        stats.visible = 0;
+        for (unsigned int i = 0; i < count; i++)
+            stats.visible += visible[i];
+        auto end = std::chrono::high_resolution_clock::now();
+        stats.milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+private:
+    unsigned int count = 0;
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> extentX, extentY, extentZ;
+    std::vector<unsigned char> visible;
+    Stats stats;
+
+    void grow() {
+        // padding lanes get an empty box far behind every plane, so they are never visible
+        size_t size = ((count + BATCH - 1) / BATCH) * BATCH * 2;
+        centerX.resize(size, -FLT_MAX);
+        centerY.resize(size, -FLT_MAX);
+        centerZ.resize(size, -FLT_MAX);
+        extentX.resize(size, 0.0f);
+        extentY.resize(size, 0.0f);
+        extentZ.resize(size, 0.0f);
+        visible.resize(size, 0);
+    }
+
+#if defined(__AVX__)
+    void cullBatch(const Frustum& frustum, unsigned int first) {
+        __m256 cx = _mm256_loadu_ps(&centerX[first]);
+        __m256 cy = _mm256_loadu_ps(&centerY[first]);
+        __m256 cz = _mm256_loadu_ps(&centerZ[first]);
+        __m256 ex = _mm256_loadu_ps(&extentX[first]);
+        __m256 ey = _mm256_loadu_ps(&extentY[first]);
+        __m256 ez = _mm256_loadu_ps(&extentZ[first]);
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (const glm::vec4& plane : frustum.planes) {
+            __m256 nx = _mm256_set1_ps(plane.x);
+            __m256 ny = _mm256_set1_ps(plane.y);
+            __m256 nz = _mm256_set1_ps(plane.z);
+            __m256 distance = _mm256_add_ps(_mm256_mul_ps(nx, cx), _mm256_set1_ps(plane.w));
+            distance = _mm256_add_ps(distance, _mm256_mul_ps(ny, cy));
+            distance = _mm256_add_ps(distance, _mm256_mul_ps(nz, cz));
+            __m256 radius = _mm256_mul_ps(_mm256_set1_ps(std::fabs(plane.x)), ex);
+            radius = _mm256_add_ps(radius, _mm256_mul_ps(_mm256_set1_ps(std::fabs(plane.y)), ey));
+            radius = _mm256_add_ps(radius, _mm256_mul_ps(_mm256_set1_ps(std::fabs(plane.z)), ez));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), _mm256_setzero_ps(), _CMP_GE_OQ));
+        }
+        writeMask(first, (unsigned int) _mm256_movemask_ps(inside));
+    }
+#else
+    unsigned int cullHalfBatch(const Frustum& frustum, unsigned int first) {
+        __m128 cx = _mm_loadu_ps(&centerX[first]);
+        __m128 cy = _mm_loadu_ps(&centerY[first]);
+        __m128 cz = _mm_loadu_ps(&centerZ[first]);
+        __m128 ex = _mm_loadu_ps(&extentX[first]);
+        __m128 ey = _mm_loadu_ps(&extentY[first]);
+        __m128 ez = _mm_loadu_ps(&extentZ[first]);
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (const glm::vec4& plane : frustum.planes) {
+            __m128 distance = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), cx), _mm_set1_ps(plane.w));
+            distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(plane.y), cy));
+            distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(plane.z), cz));
+            __m128 radius = _mm_mul_ps(_mm_set1_ps(std::fabs(plane.x)), ex);
+            radius = _mm_add_ps(radius, _mm_mul_ps(_mm_set1_ps(std::fabs(plane.y)), ey));
+            radius = _mm_add_ps(radius, _mm_mul_ps(_mm_set1_ps(std::fabs(plane.z)), ez));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+        }
+        return (unsigned int) _mm_movemask_ps(inside);
+    }
+
+    void cullBatch(const Frustum& frustum, unsigned int first) {
+        unsigned int mask = cullHalfBatch(frustum, first) | (cullHalfBatch(frustum, first + 4) << 4);
+        writeMask(first, mask);
+    }
+#endif
+
+    void writeMask(unsigned int first, unsigned int mask) {
+        for (unsigned int lane = 0; lane < BATCH; lane++)
+            visible[first + lane] = (mask >> lane) & 1;
+    }
+};
+
+#endif //PROJECT_BASE_FRUSTUMCULLER_H
@@ -0,0 +1,193 @@
+#ifndef PROJECT_BASE_GLSTATE_H
+#define PROJECT_BASE_GLSTATE_H
+
+#include <glad/glad.h>
+
+// Shadow copy of the GL state that rendering changes every frame. Every setter compares
+// against the last value it issued and skips the GL call when nothing would change.
+// State starts out unknown, so the first call of each kind always goes through.
+//
+// Code that changes tracked state behind the cache's back (resource creation, ImGui)
+// has to be followed by Invalidate.
+class GLStateCache {
+public:
+    static const int TEXTURE_UNITS = 16;
+    static const int UNIFORM_BUFFER_BINDINGS = 8;
+
+    struct Stats {
+        unsigned int issued = 0;
+        unsigned int elided = 0;
+    };
+
+    GLStateCache() {
+        Invalidate();
+    }
+
+    void Invalidate() {
+        program = vertexArray = framebuffer = UNKNOWN;
+        activeUnit = UNKNOWN;
+        for (int unit = 0; unit < TEXTURE_UNITS; unit++) {
+            textures[unit] = UNKNOWN;
+            textureTargets[unit] = UNKNOWN;
+            samplers[unit] = UNKNOWN;
+        }
+        for (int i = 0; i < UNIFORM_BUFFER_BINDINGS; i++)
+            uniformBuffers[i] = UniformRange();
+        depthTest = cullFace = blend = depthMask = UNKNOWN_FLAG;
+        depthFunc = blendSource = blendDestination = UNKNOWN;
+        viewport[0] = viewport[1] = viewport[2] = viewport[3] = -1;
+    }
+
+    void UseProgram(unsigned int id) {
+        if (changed(program, id))
+            glUseProgram(id);
+    }
+
+    void BindVertexArray(unsigned int id) {
+        if (changed(vertexArray, id))
+            glBindVertexArray(id);
+    }
+
+    // binds to GL_FRAMEBUFFER, both draw and read
+    void BindFramebuffer(unsigned int id) {
+        if (changed(framebuffer, id))
+            glBindFramebuffer(GL_FRAMEBUFFER, id);
+    }
+
+    void BindTexture(unsigned int unit, GLenum target, unsigned int id) {
+        if (textures[unit] == id && textureTargets[unit] == target) {
+            stats.elided++;
+            return;
+        }
+        ActiveTexture(unit);
+        glBindTexture(target, id);
+        textures[unit] = id;
+        textureTargets[unit] = target;
+        stats.issued++;
+    }
+
+    void BindSampler(unsigned int unit, unsigned int sampler) {
+        if (changed(samplers[unit], sampler))
+            glBindSampler(unit, sampler);
+    }
+
+    void BindUniformBufferRange(unsigned int index, unsigned int buffer, unsigned int offset, unsigned int size) {
+        UniformRange& bound = uniformBuffers[index];
+        if (bound.buffer == buffer && bound.offset == offset && bound.size == size) {
+            stats.elided++;
+            return;
+        }
+        glBindBufferRange(GL_UNIFORM_BUFFER, index, buffer, offset, size);
+        bound.buffer = buffer;
+        bound.offset = offset;
+        bound.size = size;
+        stats.issued++;
+    }
+
+    void ActiveTexture(unsigned int unit) {
+        if (changed(activeUnit, unit))
+            glActiveTexture(GL_TEXTURE0 + unit);
+    }
+
+    void SetDepthTest(bool enabled) {
+        setCapability(depthTest, enabled, GL_DEPTH_TEST);
+    }
+
+    void SetCullFace(bool enabled) {
+        setCapability(cullFace, enabled, GL_CULL_FACE);
+    }
+
+    void SetBlend(bool enabled) {
+        setCapability(blend, enabled, GL_BLEND);
+    }
+
+    void DepthMask(bool enabled) {
+        if (changed(depthMask, enabled ? 1 : 0))
+            glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+    }
+
+    void DepthFunc(GLenum function) {
+        if (changed(depthFunc, function))
+            glDepthFunc(function);
+    }
+
+    void BlendFunc(GLenum source, GLenum destination) {
+        if (blendSource == source && blendDestination == destination) {
+            stats.elided++;
+            return;
+        }
+        glBlendFunc(source, destination);
+        blendSource = source;
+        blendDestination = destination;
+        stats.issued++;
+    }
+
+    void Viewport(int x, int y, int width, int height) {
+        if (viewport[0] == x && viewport[1] == y && viewport[2] == width && viewport[3] == height) {
+            stats.elided++;
+            return;
+        }
+        glViewport(x, y, width, height);
+        viewport[0] = x;
+        viewport[1] = y;
+        viewport[2] = width;
+        viewport[3] = height;
+        stats.issued++;
+    }
+
+    const Stats& GetStats() const {
+        return stats;
+    }
+
+    void ResetStats() {
+        stats = Stats();
+    }
+
+private:
+    static const unsigned int UNKNOWN = 0xffffffffu;
+    static const int UNKNOWN_FLAG = -1;
+
+    struct UniformRange {
+        unsigned int buffer = UNKNOWN;
+        unsigned int offset = 0;
+        unsigned int size = 0;
+    };
+
+    unsigned int program, vertexArray, framebuffer, activeUnit;
+    unsigned int textures[TEXTURE_UNITS];
+    unsigned int textureTargets[TEXTURE_UNITS];
+    unsigned int samplers[TEXTURE_UNITS];
+    UniformRange uniformBuffers[UNIFORM_BUFFER_BINDINGS];
+    int depthTest, cullFace, blend, depthMask;
+    unsigned int depthFunc, blendSource, blendDestination;
+    int viewport[4];
+    Stats stats;
+
+    template<typename T>
+    bool changed(T& current, T value) {
+        if (current == value) {
+            stats.elided++;
+            return false;
+        }
+        current = value;
+        stats.issued++;
+        return true;
+    }
+
+    void setCapability(int& current, bool enabled, GLenum capability) {
+        if (!changed(current, enabled ? 1 : 0))
+            return;
+        if (enabled)
+            glEnable(capability);
+        else
+            glDisable(capability);
+    }
+};
+
+// the cache of the one GL context; only the GL thread may use it
+inline GLStateCache& glState() {
+    static GLStateCache cache;
+    return cache;
+}
+
+#endif //PROJECT_BASE_GLSTATE_H
@@ -0,0 +1,99 @@
+#ifndef PROJECT_BASE_GPUTIMER_H
+#define PROJECT_BASE_GPUTIMER_H
+
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+
+#include <rg/Error.h>
+
+// Times named stretches of GPU work inside a frame. Scopes are bracketed by GL_TIMESTAMP
+// queries rather than GL_TIME_ELAPSED, which can't nest and is already taken by the frame
+// governor for the whole frame. Results are read QUERIES - 1 frames later without waiting;
+// a scope that didn't run in the frame read back reports zero.
+class GpuTimer {
+public:
+    static const int QUERIES = 4;
+
+    struct Scope {
+        std::string name;
+        // smoothed over frames the scope ran in
+        double milliseconds = 0.0;
+        bool ran = false;
+    };
+
+    GpuTimer() = default;
+
+    ~GpuTimer() {
+        for (Query& query : queries)
+            glDeleteQueries(2 * QUERIES, query.ids);
+    }
+
+    GpuTimer(const GpuTimer&) = delete;
+    GpuTimer& operator=(const GpuTimer&) = delete;
+
+    int AddScope(const std::string& name) {
+        Scope scope;
+        scope.name = name;
+        scopes.push_back(scope);
+        queries.push_back(Query());
+        glGenQueries(2 * QUERIES, queries.back().ids);
+        return scopes.size() - 1;
+    }
+
+    void Begin(int scope) {
+        ASSERT(scope >= 0 && scope < (int) scopes.size(), "Unknown GPU timer scope");
+        glQueryCounter(queries[scope].ids[2 * (frame % QUERIES)], GL_TIMESTAMP);
+    }
+
+    void End(int scope) {
+        int slot = frame % QUERIES;
+        glQueryCounter(queries[scope].ids[2 * slot + 1], GL_TIMESTAMP);
+        queries[scope].recorded[slot] = true;
+    }
+
+    // call once a frame after the last timed scope
+    void EndFrame() {
+        frame++;
+        if (frame < QUERIES)
+            return;
+        int slot = frame % QUERIES;
+        for (unsigned int i = 0; i < scopes.size(); i++) {
+            Query& query = queries[i];
+            Scope& scope = scopes[i];
+            if (!query.recorded[slot]) {
+                scope.milliseconds = 0.0;
+                scope.ran = false;
+                continue;
+            }
+            int available = 0;
+            glGetQueryObjectiv(query.ids[2 * slot + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                continue;
+            GLuint64 start = 0, end = 0;
+            glGetQueryObjectui64v(query.ids[2 * slot], GL_QUERY_RESULT, &start);
+            glGetQueryObjectui64v(query.ids[2 * slot + 1], GL_QUERY_RESULT, &end);
+            query.recorded[slot] = false;
+            double milliseconds = (end - start) / 1e6;
+            scope.milliseconds = scope.ran ? scope.milliseconds * 0.9 + milliseconds * 0.1 : milliseconds;
+            scope.ran = true;
+        }
+    }
+
+    const std::vector<Scope>& GetScopes() const {
+        return scopes;
+    }
+
+private:
+    struct Query {
+        // start and end timestamp of every slot
+        unsigned int ids[2 * QUERIES] = {};
+        bool recorded[QUERIES] = {};
+    };
+
+    std::vector<Scope> scopes;
+    std::vector<Query> queries;
+    unsigned long long frame = 0;
+};
+
+#endif //PROJECT_BASE_GPUTIMER_H
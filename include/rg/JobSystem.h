@@ -0,0 +1,195 @@
+#ifndef PROJECT_BASE_JOBSYSTEM_H
+#define PROJECT_BASE_JOBSYSTEM_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+// Work-stealing thread pool with a small task graph on top. Every worker owns a deque:
+// it pushes and pops its own jobs at the back, idle workers steal from the front of the
+// others. Threads that are not workers (the GL thread) share one extra deque.
+//
+// A job starts once all of its dependencies have finished; finished jobs release their
+// continuations themselves, so nothing polls the graph. Wait runs other jobs while the
+// awaited one isn't done, which makes it safe to wait from inside a job.
+class JobSystem {
+public:
+    struct Job;
+    typedef std::shared_ptr<Job> Handle;
+
+    // one worker per core, minus the thread that creates the system
+    explicit JobSystem(int workerCount = std::max(1, (int) std::thread::hardware_concurrency() - 1)) {
+        for (int i = 0; i <= workerCount; i++)
+            queues.emplace_back(new Queue());
+        for (int i = 1; i <= workerCount; i++)
+            workers.emplace_back([this, i]() { workerLoop(i); });
+    }
+
+    ~JobSystem() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            running = false;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    int WorkerCount() const {
+        return (int) workers.size();
+    }
+
+    Handle Schedule(std::function<void()> work, const std::vector<Handle>& dependencies = {}) {
+        Handle job = std::make_shared<Job>();
+        job->work = std::move(work);
+        // the extra count keeps the job from starting while dependencies are still being added
+        job->pending = (int) dependencies.size() + 1;
+        for (const Handle& dependency : dependencies) {
+            std::lock_guard<std::mutex> lock(dependency->mutex);
+            if (dependency->done)
+                job->pending--;
+            else
+                dependency->continuations.push_back(job);
+        }
+        if (--job->pending == 0)
+            push(job);
+        return job;
+    }
+
+    Handle Then(const Handle& job, std::function<void()> work) {
+        return Schedule(std::move(work), { job });
+    }
+
+    // body(begin, end) for consecutive ranges of at most grainSize indices; the returned
+    // job finishes when all ranges have
+    Handle ParallelFor(int count, int grainSize, std::function<void(int, int)> body,
+                       const std::vector<Handle>& dependencies = {}) {
+        grainSize = std::max(1, grainSize);
+        auto shared = std::make_shared<std::function<void(int, int)>>(std::move(body));
+        std::vector<Handle> ranges;
+        for (int begin = 0; begin < count; begin += grainSize) {
+            int end = std::min(count, begin + grainSize);
+            ranges.push_back(Schedule([shared, begin, end]() { (*shared)(begin, end); }, dependencies));
+        }
+        if (ranges.empty())
+            return Schedule([]() {}, dependencies);
+        return Schedule([]() {}, ranges);
+    }
+
+    bool IsDone(const Handle& job) const {
+        return job->done;
+    }
+
+    void Wait(const Handle& job) {
+        while (!job->done) {
+            Handle next;
+            if (tryPop(next))
+                execute(next);
+            else
+                std::this_thread::yield();
+        }
+    }
+
+    void Wait(const std::vector<Handle>& jobs) {
+        for (const Handle& job : jobs)
+            Wait(job);
+    }
+
+    struct Job {
+        std::function<void()> work;
+        std::atomic<int> pending{0};
+        std::atomic<bool> done{false};
+        std::mutex mutex;
+        std::vector<Handle> continuations;
+    };
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Handle> jobs;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<int> queued{0};
+    bool running = true;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+
+    // queue of the calling thread: 0 unless it is a worker
+    static int& currentQueue() {
+        thread_local int index = 0;
+        return index;
+    }
+
+    void push(const Handle& job) {
+        Queue& queue = *queues[currentQueue()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.jobs.push_back(job);
+        }
+        queued++;
+        wake.notify_one();
+    }
+
+    bool tryPop(Handle& job) {
+        int self = currentQueue();
+        int count = (int) queues.size();
+        for (int i = 0; i < count; i++) {
+            Queue& queue = *queues[(self + i) % count];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.jobs.empty())
+                continue;
+            if (i == 0) {
+                job = std::move(queue.jobs.back());
+                queue.jobs.pop_back();
+            } else {
+                job = std::move(queue.jobs.front());
+                queue.jobs.pop_front();
+            }
+            queued--;
+            return true;
+        }
+        return false;
+    }
+
+    void execute(const Handle& job) {
+        job->work();
+        std::vector<Handle> continuations;
+        {
+            std::lock_guard<std::mutex> lock(job->mutex);
+            job->done = true;
+            continuations.swap(job->continuations);
+        }
+        for (const Handle& continuation : continuations)
+            if (--continuation->pending == 0)
+                push(continuation);
+    }
+
+    void workerLoop(int index) {
+        currentQueue() = index;
+        while (true) {
+            Handle job;
+            if (tryPop(job)) {
+                execute(job);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            if (!running)
+                return;
+            wake.wait_for(lock, std::chrono::milliseconds(1), [this]() { return queued > 0 || !running; });
+        }
+    }
+};
+
+#endif //PROJECT_BASE_JOBSYSTEM_H
@@ -0,0 +1,547 @@
+#ifndef PROJECT_BASE_LIGHTMAPBAKER_H
+#define PROJECT_BASE_LIGHTMAPBAKER_H
+
+#include <map>
+#include <cmath>
+#include <tuple>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/model.h>
+#include <rg/Error.h>
+#include <rg/GLState.h>
+#include <rg/Scene.h>
+#include <rg/TriangleBVH.h>
+
+// the rect packer imgui bundles; its own copy is private to imgui_draw.cpp
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include <imstb_rectpack.h>
+
+// Bakes the light of the scene's point lights on the static lit renderers into lightmaps,
+// path traced on the CPU.
+//
+// Lightmap UVs come from planar charts: connected triangles of one renderer that face the
+// same way along their dominant axis are projected onto that axis' plane, and the charts'
+// rectangles are packed into one square atlas with imstb_rectpack, at a lower density
+// until they fit. Since the projection is affine, the runtime needs no second UV set: every
+// baked triangle gets a world to lightmap transform in a buffer texture, which the shader
+// finds through DrawData::lightmapBase and gl_PrimitiveID. Renderers sharing a model get
+// their own charts.
+//
+// Every covered texel traces cosine distributed paths through a TriangleBVH of all baked
+// triangles, adding the direct light of every light at each bounce with a shadow ray. The
+// shading mirrors CalcPointLight in mainLightning.fs without specular: the ambient term as
+// it is at runtime, the diffuse term shadowed, bounces off a grey albedo. Every light gets
+// its own layer in a texture array, so lights switched off at runtime still drop out. Rows
+// of texels are traced in parallel; the texels around the charts are filled from their
+// neighbors so filtering doesn't bleed black.
+class LightmapBaker {
+public:
+    struct Settings {
+        int size = 512;
+        // starting density in texels per world unit, lowered until the charts fit
+        float texelsPerUnit = 4.0f;
+        // texels between charts
+        int padding = 2;
+        int samples = 16;
+        int bounces = 2;
+        float albedo = 0.5f;
+    };
+
+    struct Stats {
+        unsigned int triangles = 0;
+        unsigned int charts = 0;
+        unsigned int texels = 0;
+        unsigned int bvhNodes = 0;
+        unsigned int lights = 0;
+        float texelsPerUnit = 0.0f;
+        unsigned long long rays = 0;
+        double milliseconds = 0.0;
+    };
+
+    LightmapBaker() {
+        glGenTextures(1, &lightmap);
+        glGenTextures(1, &triangleTexture);
+        glGenBuffers(1, &triangleBuffer);
+    }
+
+    ~LightmapBaker() {
+        glDeleteTextures(1, &lightmap);
+        glDeleteTextures(1, &triangleTexture);
+        glDeleteBuffers(1, &triangleBuffer);
+    }
+
+    LightmapBaker(const LightmapBaker&) = delete;
+    LightmapBaker& operator=(const LightmapBaker&) = delete;
+
+    // sets MeshRenderer::lightmapTriangle of every renderer and uploads the result; the scene's
+    // transforms and lights have to be up to date. parallelFor(count, task) has to call
+    // task(i) once for every i in [0, count)
+    template<typename ParallelFor>
+    void Bake(Scene& scene, const Settings& settings, ParallelFor parallelFor) {
+        auto start = std::chrono::high_resolution_clock::now();
+        this->settings = settings;
+        stats = Stats();
+        gatherTriangles(scene);
+        gatherLights(scene);
+        bvh.Build(positions, groups);
+        buildCharts();
+        float density = packCharts();
+        rasterize(density);
+        std::atomic<unsigned long long> rays(0);
+        layers.assign(lights.size(), std::vector<float>(size * size * 3, 0.0f));
+        parallelFor(size, [&](int row) {
+            rays += traceRow(row);
+        });
+        for (std::vector<float>& layer : layers)
+            dilate(layer);
+        upload(density);
+        baked = true;
+        staticVersion = scene.GetStaticVersion();
+        stats.triangles = groups.size();
+        stats.charts = charts.size();
+        stats.bvhNodes = bvh.NodeCount();
+        stats.lights = lights.size();
+        stats.texelsPerUnit = density;
+        stats.rays = rays;
+        auto end = std::chrono::high_resolution_clock::now();
+        stats.milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    // baked, and no static renderer moved since
+    bool IsCurrent(const Scene& scene) const {
+        return baked && staticVersion == scene.GetStaticVersion();
+    }
+
+    // bit i is set if pointLights[i] is baked into layer i
+    unsigned int GetLightMask() const {
+        return lights.size() >= 32 ? ~0u : (1u << lights.size()) - 1u;
+    }
+
+    // GL_TEXTURE_2D_ARRAY of RGB16F, one layer per light
+    unsigned int GetTexture() const {
+        return lightmap;
+    }
+
+    // GL_TEXTURE_BUFFER of RGBA32F, two texels per baked triangle: the rows of its world to
+    // lightmap transform
+    unsigned int GetTriangleTexture() const {
+        return triangleTexture;
+    }
+
+    const Stats& GetStats() const {
+        return stats;
+    }
+
+private:
+    // along the normal, so rays don't hit the surface they start on
+    static constexpr float RAY_OFFSET = 0.01f;
+    static const int PACK_ATTEMPTS = 16;
+
+    struct Light {
+        PointLight light;
+        // the renderer holding the light, ignored by its shadow rays
+        int ignoredGroup = -1;
+    };
+
+    struct Chart {
+        // 0 to 2, the axis the chart is projected along
+        int axis = 0;
+        glm::vec2 min = glm::vec2(FLT_MAX);
+        glm::vec2 max = glm::vec2(-FLT_MAX);
+        std::vector<int> triangles;
+        // lower left texel of the packed rectangle, padding included
+        int x = 0, y = 0;
+    };
+
+    struct Texel {
+        glm::vec3 position;
+        int triangle = -1;
+    };
+
+    // xorshift, one sequence per texel
+    struct Random {
+        uint32_t state;
+
+        explicit Random(uint32_t seed) : state(seed * 747796405u + 2891336453u) {}
+
+        float Next() {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            return (state >> 8) * (1.0f / 16777216.0f);
+        }
+    };
+
+    Settings settings;
+    int size = 0;
+    // three per triangle, world space
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    // the renderer a triangle belongs to
+    std::vector<int> groups;
+    std::vector<AABB> groupBounds;
+    std::vector<Light> lights;
+    std::vector<Chart> charts;
+    std::vector<int> triangleCharts;
+    std::vector<Texel> texels;
+    std::vector<std::vector<float>> layers;
+    TriangleBVH bvh;
+    bool baked = false;
+    unsigned int staticVersion = 0;
+    unsigned int lightmap = 0;
+    unsigned int triangleTexture = 0;
+    unsigned int triangleBuffer = 0;
+    Stats stats;
+
+    // the static lit renderers' triangles, in the order the render queue draws their meshes
+    void gatherTriangles(Scene& scene) {
+        positions.clear();
+        normals.clear();
+        groups.clear();
+        groupBounds.clear();
+        for (int i = 0; i < scene.meshRenderers.Size(); i++) {
+            MeshRenderer& renderer = scene.meshRenderers[i];
+            renderer.lightmapTriangle = -1;
+            if (renderer.model == nullptr || renderer.dynamic || renderer.pass != MeshRenderer::LIT)
+                continue;
+            int group = groupBounds.size();
+            groupBounds.push_back(renderer.worldBounds);
+            renderer.lightmapTriangle = groups.size();
+            const glm::mat4& model = scene.hierarchy.GetWorldMatrix(renderer.node);
+            for (const Mesh& mesh : renderer.model->meshes) {
+                for (unsigned int index = 0; index + 2 < mesh.indices.size(); index += 3) {
+                    glm::vec3 v[3];
+                    for (int k = 0; k < 3; k++) {
+                        v[k] = glm::vec3(model * glm::vec4(mesh.vertices[mesh.indices[index + k]].Position, 1.0f));
+                        positions.push_back(v[k]);
+                    }
+                    glm::vec3 normal = glm::cross(v[1] - v[0], v[2] - v[0]);
+                    float length = glm::length(normal);
+                    normals.push_back(length > 0.0f ? normal / length : glm::vec3(0.0f, 1.0f, 0.0f));
+                    groups.push_back(group);
+                }
+            }
+        }
+    }
+
+    void gatherLights(const Scene& scene) {
+        ASSERT(scene.pointLights.Size() <= 32, "Light masks hold at most 32 lights");
+        lights.clear();
+        for (int i = 0; i < scene.pointLights.Size(); i++) {
+            Light light;
+            light.light = scene.pointLights[i];
+            for (int group = 0; group < (int) groupBounds.size() && light.ignoredGroup < 0; group++) {
+                if (contains(groupBounds[group], light.light.position))
+                    light.ignoredGroup = group;
+            }
+            lights.push_back(light);
+        }
+    }
+
+    static bool contains(const AABB& bounds, const glm::vec3& point) {
+        return point.x >= bounds.min.x && point.y >= bounds.min.y && point.z >= bounds.min.z
+            && point.x <= bounds.max.x && point.y <= bounds.max.y && point.z <= bounds.max.z;
+    }
+
+    static int dominantDirection(const glm::vec3& normal) {
+        glm::vec3 magnitude = glm::abs(normal);
+        int axis = magnitude.x >= magnitude.y && magnitude.x >= magnitude.z ? 0 : (magnitude.y >= magnitude.z ? 1 : 2);
+        return axis * 2 + (normal[axis] < 0.0f);
+    }
+
+    static glm::vec2 project(const glm::vec3& position, int axis) {
+        return glm::vec2(position[(axis + 1) % 3], position[(axis + 2) % 3]);
+    }
+
+    static int find(std::vector<int>& parents, int i) {
+        while (parents[i] != i) {
+            parents[i] = parents[parents[i]];
+            i = parents[i];
+        }
+        return i;
+    }
+
+    // triangles sharing an edge join the same chart if they are of one renderer and face the same way
+    void buildCharts() {
+        int count = groups.size();
+        std::vector<int> parents(count);
+        std::vector<int> directions(count);
+        for (int i = 0; i < count; i++) {
+            parents[i] = i;
+            directions[i] = dominantDirection(normals[i]);
+        }
+        // vertices are welded on a millimeter grid
+        std::map<std::tuple<int, int, int>, int> vertexIds;
+        auto vertexId = [&](const glm::vec3& position) {
+            glm::vec3 grid = glm::floor(position * 1000.0f + 0.5f);
+            auto key = std::make_tuple((int) grid.x, (int) grid.y, (int) grid.z);
+            auto found = vertexIds.find(key);
+            if (found != vertexIds.end())
+                return found->second;
+            int id = vertexIds.size();
+            vertexIds[key] = id;
+            return id;
+        };
+        std::map<std::tuple<int, int, int>, int> edges;
+        for (int i = 0; i < count; i++) {
+            int ids[3];
+            for (int k = 0; k < 3; k++)
+                ids[k] = vertexId(positions[i * 3 + k]);
+            int chartKey = groups[i] * 6 + directions[i];
+            for (int k = 0; k < 3; k++) {
+                int a = std::min(ids[k], ids[(k + 1) % 3]);
+                int b = std::max(ids[k], ids[(k + 1) % 3]);
+                auto inserted = edges.insert(std::make_pair(std::make_tuple(chartKey, a, b), i));
+                if (!inserted.second)
+                    parents[find(parents, i)] = find(parents, inserted.first->second);
+            }
+        }
+
+        charts.clear();
+        triangleCharts.assign(count, -1);
+        std::vector<int> rootCharts(count, -1);
+        for (int i = 0; i < count; i++) {
+            int root = find(parents, i);
+            if (rootCharts[root] < 0) {
+                rootCharts[root] = charts.size();
+                charts.emplace_back();
+                charts.back().axis = directions[i] / 2;
+            }
+            Chart& chart = charts[rootCharts[root]];
+            triangleCharts[i] = rootCharts[root];
+            chart.triangles.push_back(i);
+            for (int k = 0; k < 3; k++) {
+                glm::vec2 point = project(positions[i * 3 + k], chart.axis);
+                chart.min = glm::min(chart.min, point);
+                chart.max = glm::max(chart.max, point);
+            }
+        }
+    }
+
+    int chartTexels(float extent, float density) const {
+        return (int) std::ceil(extent * density) + 1 + 2 * settings.padding;
+    }
+
+    // places every chart in the atlas; returns the density they fit at
+    float packCharts() {
+        size = settings.size;
+        float density = settings.texelsPerUnit;
+        std::vector<stbrp_rect> rects(charts.size());
+        std::vector<stbrp_node> nodes(size);
+        for (int attempt = 0; attempt < PACK_ATTEMPTS; attempt++, density *= 0.8f) {
+            bool fits = true;
+            for (unsigned int i = 0; i < charts.size(); i++) {
+                glm::vec2 extent = charts[i].max - charts[i].min;
+                rects[i].id = i;
+                rects[i].w = chartTexels(extent.x, density);
+                rects[i].h = chartTexels(extent.y, density);
+                fits = fits && rects[i].w <= size && rects[i].h <= size;
+            }
+            if (!fits)
+                continue;
+            stbrp_context context;
+            stbrp_init_target(&context, size, size, nodes.data(), nodes.size());
+            stbrp_setup_heuristic(&context, STBRP_HEURISTIC_Skyline_BF_sortHeight);
+            stbrp_setup_allow_out_of_mem(&context, 0);
+            if (stbrp_pack_rects(&context, rects.data(), rects.size()))
+                break;
+        }
+        for (const stbrp_rect& rect : rects) {
+            ASSERT(rect.was_packed, "Lightmap charts don't fit the atlas");
+            charts[rect.id].x = rect.x;
+            charts[rect.id].y = rect.y;
+        }
+        return density;
+    }
+
+    // texel coordinates of a world position on a chart
+    glm::vec2 chartTexel(const Chart& chart, const glm::vec3& position, float density) const {
+        return (project(position, chart.axis) - chart.min) * density + glm::vec2(chart.x + settings.padding, chart.y + settings.padding);
+    }
+
+    // the triangle and world position at every texel center a triangle covers
+    void rasterize(float density) {
+        texels.assign(size * size, Texel());
+        stats.texels = 0;
+        for (const Chart& chart : charts) {
+            for (int triangle : chart.triangles) {
+                glm::vec2 p[3];
+                for (int k = 0; k < 3; k++)
+                    p[k] = chartTexel(chart, positions[triangle * 3 + k], density);
+                float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+                if (std::abs(area) < 1e-8f)
+                    continue;
+                glm::vec2 low = glm::min(glm::min(p[0], p[1]), p[2]);
+                glm::vec2 high = glm::max(glm::max(p[0], p[1]), p[2]);
+                for (int y = std::max(0, (int) low.y); y <= std::min(size - 1, (int) high.y); y++) {
+                    for (int x = std::max(0, (int) low.x); x <= std::min(size - 1, (int) high.x); x++) {
+                        glm::vec2 center(x + 0.5f, y + 0.5f);
+                        // barycentrics from the sub triangles opposite each vertex
+                        float b0 = ((p[1].x - center.x) * (p[2].y - center.y) - (p[2].x - center.x) * (p[1].y - center.y)) / area;
+                        float b1 = ((p[2].x - center.x) * (p[0].y - center.y) - (p[0].x - center.x) * (p[2].y - center.y)) / area;
+                        float b2 = 1.0f - b0 - b1;
+                        if (b0 < -1e-4f || b1 < -1e-4f || b2 < -1e-4f)
+                            continue;
+                        Texel& texel = texels[y * size + x];
+                        if (texel.triangle < 0)
+                            stats.texels++;
+                        texel.triangle = triangle;
+                        texel.position = b0 * positions[triangle * 3] + b1 * positions[triangle * 3 + 1] + b2 * positions[triangle * 3 + 2];
+                    }
+                }
+            }
+        }
+    }
+
+    static glm::vec3 cosineDirection(const glm::vec3& normal, Random& random) {
+        float angle = 2.0f * 3.14159265f * random.Next();
+        float radius2 = random.Next();
+        float radius = std::sqrt(radius2);
+        glm::vec3 tangent = glm::normalize(glm::cross(std::abs(normal.x) > 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f), normal));
+        glm::vec3 bitangent = glm::cross(normal, tangent);
+        return tangent * (radius * std::cos(angle)) + bitangent * (radius * std::sin(angle)) + normal * std::sqrt(1.0f - radius2);
+    }
+
+    // CalcPointLight's ambient and diffuse terms at a surface point, without the albedo
+    glm::vec3 lightAt(const Light& light, const glm::vec3& position, const glm::vec3& normal, bool ambient,
+                      unsigned long long& rays) const {
+        glm::vec3 toLight = light.light.position - position;
+        float distance = glm::length(toLight);
+        if (distance <= 0.0f)
+            return glm::vec3(0.0f);
+        glm::vec3 direction = toLight / distance;
+        float attenuation = 1.0f / (light.light.constant + light.light.linear * distance + light.light.quadratic * distance * distance);
+        glm::vec3 result = ambient ? light.light.ambient * attenuation : glm::vec3(0.0f);
+        float cosine = glm::dot(normal, direction);
+        if (cosine <= 0.0f)
+            return result;
+        rays++;
+        if (bvh.Occluded(position, direction, distance - RAY_OFFSET, light.ignoredGroup))
+            return result;
+        return result + light.light.diffuse * (cosine * attenuation);
+    }
+
+    // traces every covered texel of the row; returns the rays it cast
+    unsigned long long traceRow(int row) {
+        unsigned long long rays = 0;
+        for (int x = 0; x < size; x++) {
+            int index = row * size + x;
+            const Texel& texel = texels[index];
+            if (texel.triangle < 0)
+                continue;
+            glm::vec3 normal = normals[texel.triangle];
+            glm::vec3 origin = texel.position + normal * RAY_OFFSET;
+            Random random(index + 1);
+            for (unsigned int l = 0; l < lights.size(); l++)
+                add(l, index, lightAt(lights[l], origin, normal, true, rays));
+            float weight = 1.0f / settings.samples;
+            for (int sample = 0; sample < settings.samples; sample++) {
+                glm::vec3 position = origin;
+                glm::vec3 surfaceNormal = normal;
+                float throughput = weight;
+                for (int bounce = 0; bounce < settings.bounces; bounce++) {
+                    glm::vec3 direction = cosineDirection(surfaceNormal, random);
+                    rays++;
+                    TriangleBVH::Hit hit = bvh.Intersect(position, direction, FLT_MAX);
+                    if (hit.triangle < 0)
+                        break;
+                    surfaceNormal = normals[hit.triangle];
+                    if (glm::dot(surfaceNormal, direction) > 0.0f)
+                        surfaceNormal = -surfaceNormal;
+                    position = position + direction * hit.distance + surfaceNormal * RAY_OFFSET;
+                    throughput *= settings.albedo;
+                    for (unsigned int l = 0; l < lights.size(); l++)
+                        add(l, index, lightAt(lights[l], position, surfaceNormal, false, rays) * throughput);
+                }
+            }
+        }
+        return rays;
+    }
+
+    void add(int layer, int texel, const glm::vec3& color) {
+        float* value = &layers[layer][texel * 3];
+        value[0] += color.r;
+        value[1] += color.g;
+        value[2] += color.b;
+    }
+
+    // grows the covered texels into the empty ones around them, one ring per pass
+    void dilate(std::vector<float>& layer) const {
+        std::vector<char> covered(size * size);
+        for (int i = 0; i < size * size; i++)
+            covered[i] = texels[i].triangle >= 0;
+        std::vector<char> next = covered;
+        for (int pass = 0; pass <= settings.padding; pass++) {
+            for (int y = 0; y < size; y++) {
+                for (int x = 0; x < size; x++) {
+                    if (covered[y * size + x])
+                        continue;
+                    glm::vec3 sum(0.0f);
+                    int count = 0;
+                    for (int dy = -1; dy <= 1; dy++) {
+                        for (int dx = -1; dx <= 1; dx++) {
+                            int nx = x + dx, ny = y + dy;
+                            if (nx < 0 || ny < 0 || nx >= size || ny >= size || !covered[ny * size + nx])
+                                continue;
+                            const float* value = &layer[(ny * size + nx) * 3];
+                            sum += glm::vec3(value[0], value[1], value[2]);
+                            count++;
+                        }
+                    }
+                    if (count == 0)
+                        continue;
+                    float* value = &layer[(y * size + x) * 3];
+                    value[0] = sum.r / count;
+                    value[1] = sum.g / count;
+                    value[2] = sum.b / count;
+                    next[y * size + x] = 1;
+                }
+            }
+            covered = next;
+        }
+    }
+
+    void upload(float density) {
+        std::vector<float> data;
+        data.reserve(layers.size() * size * size * 3);
+        for (const std::vector<float>& layer : layers)
+            data.insert(data.end(), layer.begin(), layer.end());
+        glBindTexture(GL_TEXTURE_2D_ARRAY, lightmap);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGB16F, size, size, std::max<int>(1, layers.size()), 0, GL_RGB, GL_FLOAT,
+                     data.empty() ? nullptr : data.data());
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        // uv = (dot(u.xyz, position) + u.w, dot(v.xyz, position) + v.w), in [0, 1] over the atlas
+        std::vector<glm::vec4> transforms(std::max<size_t>(1, groups.size() * 2), glm::vec4(0.0f));
+        for (unsigned int triangle = 0; triangle < groups.size(); triangle++) {
+            const Chart& chart = charts[triangleCharts[triangle]];
+            for (int row = 0; row < 2; row++) {
+                glm::vec4 transform(0.0f);
+                transform[(chart.axis + 1 + row) % 3] = density / size;
+                float offset = row == 0 ? chart.x : chart.y;
+                transform.w = (offset + settings.padding - chart.min[row] * density) / size;
+                transforms[triangle * 2 + row] = transform;
+            }
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, triangleBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, transforms.size() * sizeof(glm::vec4), transforms.data(), GL_STATIC_DRAW);
+        glBindTexture(GL_TEXTURE_BUFFER, triangleTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, triangleBuffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        glState().Invalidate();
+    }
+};
+
+constexpr float LightmapBaker::RAY_OFFSET;
+
+#endif //PROJECT_BASE_LIGHTMAPBAKER_H
@@ -0,0 +1,235 @@
+#ifndef PROJECT_BASE_OCCLUSIONCULLER_H
+#define PROJECT_BASE_OCCLUSIONCULLER_H
+
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <functional>
+#include <glm/glm.hpp>
+
+#include <rg/Bounds.h>
+#include <rg/Simd.h>
+
+// Software occlusion culling. A few low-poly occluders are rasterized on the CPU into a
+// small depth buffer that stores 1/w (bigger is nearer), then every tile of 8x8 pixels
+// keeps the farthest depth written to it. An occludee's screen rectangle is occluded if
+// its nearest point is behind the tile depth everywhere; tiles that can't decide are
+// resolved per pixel.
+//
+// The screen is rasterized in independent rows of tiles, so Rasterize can hand the rows
+// to worker threads. Rows are processed simd::WIDTH pixels at a time.
+class OcclusionCuller {
+public:
+    static const int WIDTH = 320;
+    static const int HEIGHT = 192;
+    static const int TILE_SIZE = 8;
+    static const int TILES_X = WIDTH / TILE_SIZE;
+    static const int TILES_Y = HEIGHT / TILE_SIZE;
+
+    struct Stats {
+        unsigned int occluderTriangles = 0;
+        unsigned int tested = 0;
+        unsigned int occluded = 0;
+        double rasterMilliseconds = 0.0;
+        double testMilliseconds = 0.0;
+    };
+
+    OcclusionCuller() : depth(WIDTH * HEIGHT, 0.0f), tileDepth(TILES_X * TILES_Y, 0.0f) {}
+
+    void BeginFrame(const glm::mat4& viewProjection) {
+        this->viewProjection = viewProjection;
+        triangles.clear();
+        stats = Stats();
+    }
+
+    // positions are in model space; triangles crossing the near plane are dropped,
+    // which only makes the occluder smaller
+    void AddOccluder(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices,
+                     const glm::mat4& model) {
+        glm::mat4 mvp = viewProjection * model;
+        clipPositions.resize(positions.size());
+        for (size_t i = 0; i < positions.size(); i++)
+            clipPositions[i] = mvp * glm::vec4(positions[i], 1.0f);
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+            setupTriangle(clipPositions[indices[i]], clipPositions[indices[i + 1]], clipPositions[indices[i + 2]]);
+        stats.occluderTriangles = triangles.size();
+    }
+
+    // parallelFor(count, task) has to call task(i) once for every i in [0, count)
+    template<typename ParallelFor>
+    void Rasterize(ParallelFor parallelFor) {
+        auto start = std::chrono::high_resolution_clock::now();
+        parallelFor(TILES_Y, [this](int tileRow) {
+            rasterizeTileRow(tileRow);
+        });
+        auto end = std::chrono::high_resolution_clock::now();
+        stats.rasterMilliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    void Rasterize() {
+        Rasterize([](int count, const std::function<void(int)>& task) {
+            for (int i = 0; i < count; i++)
+                task(i);
+        });
+    }
+
+    // false if the box is certainly hidden behind the occluders
+    bool TestAABB(const AABB& box) {
+        auto start = std::chrono::high_resolution_clock::now();
+        bool visible = isVisible(box);
+        auto end = std::chrono::high_resolution_clock::now();
+        stats.testMilliseconds += std::chrono::duration<double, std::milli>(end - start).count();
+        stats.tested++;
+        stats.occluded += !visible;
+        return visible;
+    }
+
+    const Stats& GetStats() const {
+        return stats;
+    }
+
+private:
+    // clip space w below this counts as behind the camera
+    static constexpr float NEAR_W = 1e-3f;
+
+    struct Triangle {
+        // edge functions and the 1/w plane, all of the form a * x + b * y + c
+        float edgeA[3], edgeB[3], edgeC[3];
+        float depthA, depthB, depthC;
+        int minX, maxX, minY, maxY;
+    };
+
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+    std::vector<glm::vec4> clipPositions;
+    std::vector<Triangle> triangles;
+    std::vector<float> depth;
+    std::vector<float> tileDepth;
+    Stats stats;
+
+    static glm::vec3 toScreen(const glm::vec4& clip) {
+        float inverseW = 1.0f / clip.w;
+        return glm::vec3((clip.x * inverseW * 0.5f + 0.5f) * WIDTH,
+                         (clip.y * inverseW * 0.5f + 0.5f) * HEIGHT,
+                         inverseW);
+    }
+
+    void setupTriangle(const glm::vec4& c0, const glm::vec4& c1, const glm::vec4& c2) {
+        if (c0.w < NEAR_W || c1.w < NEAR_W || c2.w < NEAR_W)
+            return;
+        glm::vec3 v[3] = { toScreen(c0), toScreen(c1), toScreen(c2) };
+        float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[2].x - v[0].x) * (v[1].y - v[0].y);
+        if (std::fabs(area) < 1e-6f)
+            return;
+        if (area < 0.0f) {
+            std::swap(v[1], v[2]);
+            area = -area;
+        }
+
+        Triangle triangle;
+        triangle.minX = std::max(0, (int) std::floor(std::min(v[0].x, std::min(v[1].x, v[2].x))));
+        triangle.maxX = std::min(WIDTH - 1, (int) std::ceil(std::max(v[0].x, std::max(v[1].x, v[2].x))));
+        triangle.minY = std::max(0, (int) std::floor(std::min(v[0].y, std::min(v[1].y, v[2].y))));
+        triangle.maxY = std::min(HEIGHT - 1, (int) std::ceil(std::max(v[0].y, std::max(v[1].y, v[2].y))));
+        if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+            return;
+
+        // edge i is opposite to vertex i, positive inside
+        float inverseArea = 1.0f / area;
+        triangle.depthA = triangle.depthB = triangle.depthC = 0.0f;
+        for (int i = 0; i < 3; i++) {
+            const glm::vec3& a = v[(i + 1) % 3];
+            const glm::vec3& b = v[(i + 2) % 3];
+            triangle.edgeA[i] = a.y - b.y;
+            triangle.edgeB[i] = b.x - a.x;
+            triangle.edgeC[i] = -(triangle.edgeA[i] * a.x + triangle.edgeB[i] * a.y);
+            triangle.depthA += triangle.edgeA[i] * inverseArea * v[i].z;
+            triangle.depthB += triangle.edgeB[i] * inverseArea * v[i].z;
+            triangle.depthC += triangle.edgeC[i] * inverseArea * v[i].z;
+        }
+        triangles.push_back(triangle);
+    }
+
+    void rasterizeTileRow(int tileRow) {
+        int firstRow = tileRow * TILE_SIZE;
+        int lastRow = firstRow + TILE_SIZE - 1;
+        std::fill(depth.begin() + firstRow * WIDTH, depth.begin() + (lastRow + 1) * WIDTH, 0.0f);
+
+        const simd::Float offsets = simd::add(simd::laneOffsets(), simd::set1(0.5f));
+        const simd::Float zero = simd::zero();
+        for (const Triangle& triangle : triangles) {
+            int rowBegin = std::max(triangle.minY, firstRow);
+            int rowEnd = std::min(triangle.maxY, lastRow);
+            int columnBegin = triangle.minX - triangle.minX % simd::WIDTH;
+            for (int y = rowBegin; y <= rowEnd; y++) {
+                float py = y + 0.5f;
+                simd::Float a0 = simd::set1(triangle.edgeA[0]), rowC0 = simd::set1(triangle.edgeB[0] * py + triangle.edgeC[0]);
+                simd::Float a1 = simd::set1(triangle.edgeA[1]), rowC1 = simd::set1(triangle.edgeB[1] * py + triangle.edgeC[1]);
+                simd::Float a2 = simd::set1(triangle.edgeA[2]), rowC2 = simd::set1(triangle.edgeB[2] * py + triangle.edgeC[2]);
+                simd::Float depthA = simd::set1(triangle.depthA);
+                simd::Float rowDepth = simd::set1(triangle.depthB * py + triangle.depthC);
+                float* row = &depth[y * WIDTH];
+                for (int x = columnBegin; x <= triangle.maxX; x += simd::WIDTH) {
+                    simd::Float px = simd::add(simd::set1((float) x), offsets);
+                    simd::Float e0 = simd::add(simd::mul(a0, px), rowC0);
+                    simd::Float e1 = simd::add(simd::mul(a1, px), rowC1);
+                    simd::Float e2 = simd::add(simd::mul(a2, px), rowC2);
+                    simd::Float inside = simd::andMask(simd::andMask(simd::cmpge(e0, zero), simd::cmpge(e1, zero)), simd::cmpge(e2, zero));
+                    if (simd::movemask(inside) == 0)
+                        continue;
+                    simd::Float z = simd::add(simd::mul(depthA, px), rowDepth);
+                    simd::Float old = simd::load(row + x);
+                    simd::store(row + x, simd::select(inside, simd::max(old, z), old));
+                }
+            }
+        }
+
+        for (int tileX = 0; tileX < TILES_X; tileX++) {
+            simd::Float farthest = simd::set1(FLT_MAX);
+            for (int y = firstRow; y <= lastRow; y++)
+                for (int x = tileX * TILE_SIZE; x < (tileX + 1) * TILE_SIZE; x += simd::WIDTH)
+                    farthest = simd::min(farthest, simd::load(&depth[y * WIDTH + x]));
+            float lanes[simd::WIDTH];
+            simd::store(lanes, farthest);
+            tileDepth[tileRow * TILES_X + tileX] = *std::min_element(lanes, lanes + simd::WIDTH);
+        }
+    }
+
+    bool isVisible(const AABB& box) const {
+        glm::vec2 screenMin(FLT_MAX), screenMax(-FLT_MAX);
+        float nearest = 0.0f;
+        for (int i = 0; i < 8; i++) {
+            glm::vec3 corner((i & 1) ? box.max.x : box.min.x, (i & 2) ? box.max.y : box.min.y, (i & 4) ? box.max.z : box.min.z);
+            glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+            if (clip.w < NEAR_W)
+                return true;
+            glm::vec3 screen = toScreen(clip);
+            screenMin = glm::min(screenMin, glm::vec2(screen));
+            screenMax = glm::max(screenMax, glm::vec2(screen));
+            nearest = std::max(nearest, screen.z);
+        }
+        // grow by a pixel, the occluders were only sampled at pixel centers
+        int x0 = std::max(0, (int) std::floor(screenMin.x) - 1);
+        int y0 = std::max(0, (int) std::floor(screenMin.y) - 1);
+        int x1 = std::min(WIDTH - 1, (int) std::ceil(screenMax.x) + 1);
+        int y1 = std::min(HEIGHT - 1, (int) std::ceil(screenMax.y) + 1);
+        if (x0 > x1 || y0 > y1)
+            return true;
+
+        for (int tileY = y0 / TILE_SIZE; tileY <= y1 / TILE_SIZE; tileY++) {
+            for (int tileX = x0 / TILE_SIZE; tileX <= x1 / TILE_SIZE; tileX++) {
+                if (tileDepth[tileY * TILES_X + tileX] > nearest)
+                    continue;
+                int yEnd = std::min(y1, tileY * TILE_SIZE + TILE_SIZE - 1);
+                int xEnd = std::min(x1, tileX * TILE_SIZE + TILE_SIZE - 1);
+                for (int y = std::max(y0, tileY * TILE_SIZE); y <= yEnd; y++)
+                    for (int x = std::max(x0, tileX * TILE_SIZE); x <= xEnd; x++)
+                        if (depth[y * WIDTH + x] <= nearest)
+                            return true;
+            }
+        }
+        return false;
+    }
+};
+
+#endif //PROJECT_BASE_OCCLUSIONCULLER_H
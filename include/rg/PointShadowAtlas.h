@@ -0,0 +1,431 @@
+#ifndef PROJECT_BASE_POINTSHADOWATLAS_H
+#define PROJECT_BASE_POINTSHADOWATLAS_H
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <learnopengl/model.h>
+#include <rg/Error.h>
+#include <rg/GLState.h>
+#include <rg/Scene.h>
+
+// Cube shadow maps of the range limited point lights, six square faces per light packed
+// into one depth atlas. A light's face size follows how large its sphere of influence is on
+// screen, changing only after the new size held for SETTLE_FRAMES frames. Faces are cached:
+// they're redrawn when the light moves, its face size changes or a renderer with a mesh
+// moves, appears or disappears inside its range (Scene::GetMovedBounds). Stale faces are
+// redrawn most important light first, at most the budget's number of faces per frame, so
+// a static street costs nothing once every face is drawn.
+//
+// Tiles are split off larger free tiles; when the atlas has no room left it is repacked,
+// which redraws every face. A light on new tiles gets no slot until all six of its faces
+// are drawn, the tiles would still hold another light's depth. The depth program is the one of CascadedShadowMap, casters
+// whose bounds hold the light (its own lamp) are skipped.
+class PointShadowAtlas {
+public:
+    static const int MAX_LIGHTS = 4;
+    static const int FACES = 6;
+    static const int MIN_FACE_SIZE = 64;
+    static const int MAX_FACE_SIZE = 512;
+    static const int SETTLE_FRAMES = 30;
+
+    struct Stats {
+        unsigned int lights = 0;
+        unsigned int facesDrawn = 0;
+        unsigned int facesPending = 0;
+        unsigned int draws = 0;
+        unsigned int repacks = 0;
+        // share of the atlas the tiles cover
+        float usage = 0.0f;
+    };
+
+    explicit PointShadowAtlas(int size, GLenum depthFormat = GL_DEPTH_COMPONENT24) : size(size), depthFormat(depthFormat) {
+        glGenTextures(1, &atlas);
+        glBindTexture(GL_TEXTURE_2D, atlas);
+        glTexImage2D(GL_TEXTURE_2D, 0, depthFormat, size, size, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, atlas, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        ASSERT(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE, "Shadow atlas framebuffer not complete");
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glState().Invalidate();
+        freeTiles.push_back({ 0, 0, size });
+    }
+
+    ~PointShadowAtlas() {
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteTextures(1, &atlas);
+    }
+
+    PointShadowAtlas(const PointShadowAtlas&) = delete;
+    PointShadowAtlas& operator=(const PointShadowAtlas&) = delete;
+
+    void SetProgram(unsigned int program) {
+        this->program = program;
+        lightViewProjectionLocation = glGetUniformLocation(program, "lightViewProjection");
+        modelLocation = glGetUniformLocation(program, "model");
+    }
+
+    // redraws every face, for example after a stretch without Prepare
+    void Invalidate() {
+        for (Light& light : lights)
+            light.stale = ALL_FACES;
+    }
+
+    // faces drawn per frame at most
+    void SetBudget(int faces) {
+        budget = std::max(1, faces);
+    }
+
+    // picks the lights, sizes their faces and decides which faces to draw this frame; the
+    // lights' positions and ranges have to be gathered already. screenScale is the
+    // projection's [1][1] times half the viewport height, the pixels per unit of size over
+    // distance
+    void Prepare(const Scene& scene, const glm::vec3& cameraPosition, float screenScale) {
+        stats.facesDrawn = stats.facesPending = 0;
+        for (Light& light : lights)
+            light.seen = false;
+        for (int i = 0; i < scene.pointLights.Size(); i++) {
+            const PointLight& point = scene.pointLights[i];
+            if (point.global)
+                continue;
+            Entity entity = scene.pointLights.GetEntity(i);
+            auto found = std::find_if(lights.begin(), lights.end(), [&](const Light& light) {
+                return light.entity == entity;
+            });
+            if (found == lights.end()) {
+                if ((int) lights.size() == MAX_LIGHTS)
+                    continue;
+                lights.push_back(Light());
+                found = lights.end() - 1;
+                found->entity = entity;
+            }
+            Light& light = *found;
+            light.seen = true;
+            light.index = i;
+            if (light.position != point.position || light.range != point.range) {
+                light.position = point.position;
+                light.range = point.range;
+                light.stale = ALL_FACES;
+            }
+            resize(light, faceSize(light, cameraPosition, screenScale));
+        }
+        for (int i = (int) lights.size() - 1; i >= 0; i--) {
+            if (!lights[i].seen) {
+                release(lights[i]);
+                lights.erase(lights.begin() + i);
+            }
+        }
+
+        for (const AABB& moved : scene.GetMovedBounds())
+            for (Light& light : lights)
+                if (overlaps(moved, light))
+                    light.stale = ALL_FACES;
+
+        for (Light& light : lights)
+            if (light.faceSize == 0)
+                allocate(light);
+
+        // the biggest lights on screen get their faces first
+        std::vector<Light*> order;
+        for (Light& light : lights)
+            order.push_back(&light);
+        std::stable_sort(order.begin(), order.end(), [](const Light* a, const Light* b) {
+            return a->desiredSize > b->desiredSize;
+        });
+        int remaining = budget;
+        for (Light* light : order) {
+            light->drawn = 0;
+            for (int face = 0; face < FACES; face++) {
+                if (!(light->stale & (1u << face)))
+                    continue;
+                if (remaining > 0) {
+                    light->drawn |= 1u << face;
+                    remaining--;
+                } else {
+                    stats.facesPending++;
+                }
+            }
+            light->stale &= ~light->drawn;
+            // Render draws the rest of the new tiles this frame
+            if (light->stale == 0)
+                light->ready = true;
+        }
+        stats.lights = lights.size();
+        updateUsage();
+    }
+
+    // draws the faces Prepare picked; leaves the atlas framebuffer bound
+    void Render(const Scene& scene) {
+        ASSERT(program != 0, "Shadow depth program is not set");
+        stats.draws = 0;
+        GLStateCache& state = glState();
+        state.UseProgram(program);
+        state.BindFramebuffer(framebuffer);
+        state.SetDepthTest(true);
+        state.DepthMask(true);
+        state.DepthFunc(GL_LESS);
+        state.SetCullFace(false);
+        glEnable(GL_SCISSOR_TEST);
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(2.0f, 4.0f);
+        for (const Light& light : lights) {
+            if (light.drawn == 0)
+                continue;
+            casters.clear();
+            scene.bvh.QuerySphere(BoundingSphere(light.position, light.range), [&](int entity) {
+                const MeshRenderer& renderer = scene.meshRenderers.Get((Entity) entity);
+                if (renderer.model == nullptr || renderer.pass != MeshRenderer::LIT)
+                    return;
+                const AABB& bounds = renderer.worldBounds;
+                if (glm::clamp(light.position, bounds.min, bounds.max) == light.position)
+                    return;
+                casters.push_back(&renderer);
+            });
+            for (int face = 0; face < FACES; face++) {
+                if (!(light.drawn & (1u << face)))
+                    continue;
+                const Tile& tile = light.tiles[face];
+                state.Viewport(tile.x, tile.y, tile.size, tile.size);
+                glScissor(tile.x, tile.y, tile.size, tile.size);
+                glClear(GL_DEPTH_BUFFER_BIT);
+                glm::mat4 viewProjection = faceViewProjection(light, face);
+                glUniformMatrix4fv(lightViewProjectionLocation, 1, GL_FALSE, glm::value_ptr(viewProjection));
+                for (const MeshRenderer* renderer : casters) {
+                    glUniformMatrix4fv(modelLocation, 1, GL_FALSE, glm::value_ptr(scene.hierarchy.GetWorldMatrix(renderer->node)));
+                    for (const Mesh& mesh : renderer->model->meshes) {
+                        state.BindVertexArray(mesh.VAO);
+                        glDrawElements(GL_TRIANGLES, mesh.indices.size(), GL_UNSIGNED_INT, 0);
+                        stats.draws++;
+                    }
+                }
+                stats.facesDrawn++;
+            }
+        }
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glDisable(GL_SCISSOR_TEST);
+    }
+
+    unsigned int GetTexture() const {
+        return atlas;
+    }
+
+    GLenum GetDepthFormat() const {
+        return depthFormat;
+    }
+
+    // shadow slot of scene.pointLights[index], -1 if the light has none or its new tiles
+    // aren't fully drawn yet
+    int GetSlot(int index) const {
+        for (int slot = 0; slot < (int) lights.size(); slot++)
+            if (lights[slot].index == index)
+                return lights[slot].ready ? slot : -1;
+        return -1;
+    }
+
+    int GetSlotCount() const {
+        return lights.size();
+    }
+
+    // world space to atlas coordinates and depth of one face, faces in +x, -x, +y, -y, +z, -z order
+    glm::mat4 GetMatrix(int slot, int face) const {
+        const Light& light = lights[slot];
+        const Tile& tile = light.tiles[face];
+        float scale = 0.5f * tile.size / size;
+        glm::mat4 toTile = glm::translate(glm::mat4(1.0f), glm::vec3((float) tile.x / size + scale, (float) tile.y / size + scale, 0.5f))
+                           * glm::scale(glm::mat4(1.0f), glm::vec3(scale, scale, 0.5f));
+        return toTile * faceViewProjection(light, face);
+    }
+
+    // atlas rectangle (min x, min y, max x, max y) the face's filter taps are clamped to
+    glm::vec4 GetRect(int slot, int face) const {
+        const Tile& tile = lights[slot].tiles[face];
+        float texel = 1.0f / size;
+        return glm::vec4((tile.x + 1) * texel, (tile.y + 1) * texel, (tile.x + tile.size - 1) * texel, (tile.y + tile.size - 1) * texel);
+    }
+
+    const Stats& GetStats() const {
+        return stats;
+    }
+
+private:
+    static const unsigned int ALL_FACES = (1u << FACES) - 1;
+
+    struct Tile {
+        int x;
+        int y;
+        int size;
+    };
+
+    struct Light {
+        Entity entity = NULL_ENTITY;
+        int index = -1;
+        bool seen = false;
+        glm::vec3 position = glm::vec3(0.0f);
+        float range = 0.0f;
+        // allocated face size, 0 without tiles
+        int faceSize = 0;
+        // size the light should have and for how many frames it has wanted it
+        int desiredSize = 0;
+        int desiredFrames = 0;
+        Tile tiles[FACES] = {};
+        // repacking gave it smaller faces than it wants
+        bool shrunk = false;
+        // faces that need drawing, and the ones drawn this frame
+        unsigned int stale = ALL_FACES;
+        unsigned int drawn = 0;
+        // every face was drawn since the tiles were allocated
+        bool ready = false;
+    };
+
+    int size;
+    GLenum depthFormat;
+    unsigned int atlas = 0;
+    unsigned int framebuffer = 0;
+    unsigned int program = 0;
+    int lightViewProjectionLocation = -1;
+    int modelLocation = -1;
+    int budget = FACES;
+    std::vector<Light> lights;
+    std::vector<Tile> freeTiles;
+    std::vector<const MeshRenderer*> casters;
+    Stats stats;
+
+    static glm::mat4 faceViewProjection(const Light& light, int face) {
+        static const glm::vec3 directions[FACES] = {
+                { 1.0f, 0.0f, 0.0f }, { -1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f },
+                { 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f }
+        };
+        static const glm::vec3 ups[FACES] = {
+                { 0.0f, -1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f },
+                { 0.0f, 0.0f, -1.0f }, { 0.0f, -1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f }
+        };
+        glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, 0.05f, std::max(light.range, 0.1f));
+        return projection * glm::lookAt(light.position, light.position + directions[face], ups[face]);
+    }
+
+    static bool overlaps(const AABB& box, const Light& light) {
+        glm::vec3 offset = glm::clamp(light.position, box.min, box.max) - light.position;
+        return glm::dot(offset, offset) <= light.range * light.range;
+    }
+
+    static int faceSize(const Light& light, const glm::vec3& cameraPosition, float screenScale) {
+        float distance = std::max(glm::length(light.position - cameraPosition), light.range);
+        float pixels = light.range / distance * screenScale;
+        int faceSize = MIN_FACE_SIZE;
+        while (faceSize < MAX_FACE_SIZE && faceSize < pixels)
+            faceSize *= 2;
+        return faceSize;
+    }
+
+    // a new size has to hold for a while before the tiles follow it
+    void resize(Light& light, int desired) {
+        if (desired != light.desiredSize) {
+            light.desiredSize = desired;
+            light.desiredFrames = 0;
+            light.shrunk = false;
+        } else {
+            light.desiredFrames++;
+        }
+        if (light.faceSize != 0 && light.faceSize != desired && !light.shrunk && light.desiredFrames >= SETTLE_FRAMES)
+            release(light);
+    }
+
+    void allocate(Light& light) {
+        for (int face = 0; face < FACES; face++) {
+            if (!split(light.desiredSize, light.tiles[face])) {
+                repack();
+                return;
+            }
+        }
+        light.faceSize = light.desiredSize;
+        light.stale = ALL_FACES;
+        light.ready = false;
+    }
+
+    void release(Light& light) {
+        if (light.faceSize == 0)
+            return;
+        for (const Tile& tile : light.tiles)
+            if (tile.size != 0)
+                freeTiles.push_back(tile);
+        light.faceSize = 0;
+    }
+
+    // takes the smallest free tile that fits and splits it down to tileSize
+    bool split(int tileSize, Tile& result) {
+        int best = -1;
+        for (int i = 0; i < (int) freeTiles.size(); i++)
+            if (freeTiles[i].size >= tileSize && (best < 0 || freeTiles[i].size < freeTiles[best].size))
+                best = i;
+        if (best < 0)
+            return false;
+        Tile tile = freeTiles[best];
+        freeTiles.erase(freeTiles.begin() + best);
+        while (tile.size > tileSize) {
+            int half = tile.size / 2;
+            freeTiles.push_back({ tile.x + half, tile.y, half });
+            freeTiles.push_back({ tile.x, tile.y + half, half });
+            freeTiles.push_back({ tile.x + half, tile.y + half, half });
+            tile.size = half;
+        }
+        result = tile;
+        return true;
+    }
+
+    // starts the atlas over with the largest faces first, shrinking lights that don't fit
+    void repack() {
+        stats.repacks++;
+        freeTiles.assign(1, { 0, 0, size });
+        std::vector<Light*> order;
+        for (Light& light : lights) {
+            light.faceSize = 0;
+            for (Tile& tile : light.tiles)
+                tile = { 0, 0, 0 };
+            order.push_back(&light);
+        }
+        std::stable_sort(order.begin(), order.end(), [](const Light* a, const Light* b) {
+            return a->desiredSize > b->desiredSize;
+        });
+        for (Light* light : order) {
+            for (int faceSize = light->desiredSize; faceSize >= MIN_FACE_SIZE && light->faceSize == 0; faceSize /= 2) {
+                std::vector<Tile> saved = freeTiles;
+                bool fits = true;
+                for (int face = 0; face < FACES && fits; face++)
+                    fits = split(faceSize, light->tiles[face]);
+                if (fits)
+                    light->faceSize = faceSize;
+                else
+                    freeTiles = saved;
+            }
+            ASSERT(light->faceSize != 0, "Point shadow atlas is too small for its lights");
+            light->shrunk = light->faceSize < light->desiredSize;
+            light->stale = ALL_FACES;
+            light->ready = false;
+        }
+    }
+
+    void updateUsage() {
+        unsigned long long texels = 0;
+        for (const Light& light : lights)
+            texels += (unsigned long long) FACES * light.faceSize * light.faceSize;
+        stats.usage = (float) texels / ((float) size * size);
+    }
+};
+
+#endif //PROJECT_BASE_POINTSHADOWATLAS_H
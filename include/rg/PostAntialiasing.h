@@ -0,0 +1,225 @@
+#ifndef PROJECT_BASE_POSTANTIALIASING_H
+#define PROJECT_BASE_POSTANTIALIASING_H
+
+#include <vector>
+#include <algorithm>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <rg/Error.h>
+#include <rg/GLState.h>
+
+// Anti-aliasing on the tonemapped image, an alternative to MSAA that costs a few fullscreen
+// passes whatever the scene's geometry. Both modes read the composite's LDR output with
+// perceptual luma in alpha.
+//
+// FXAA is one pass: it finds the local edge direction from luma, walks along the edge to
+// its ends and resamples the pixel across it (fxaa.fs).
+//
+// SMAA is three: edge detection writes luma edges on the left and bottom side of every
+// pixel into an RG8 target (smaaEdges.fs); the weight pass follows every edge up to
+// MAX_DISTANCE pixels each way, classifies the crossing edges at its ends and looks up how
+// much of the straightened silhouette covers the pixels on either side (smaaWeights.fs);
+// the last pass blends every pixel with its neighbors by those weights (smaaBlend.fs).
+// Only horizontal and vertical patterns are detected, not diagonal ones.
+//
+// The edge search steps two pixels per fetch: one bilinear fetch of the edges weights the
+// next pixel 3/4 and the one after it 1/4 along the edge, and the edge's row 7/8 and the
+// row across it 1/8, so both channels come back as a sum of 21, 7, 3 and 1 32nds that
+// tells every one of the four texels apart. The search goes on while both pixels carry
+// the edge and no crossing edge touches them; where it stops, the search texture turns
+// the last fetch into the number of pixels the edge still continues. Both the area and
+// the search texture are precomputed at startup.
+class PostAntialiasing {
+public:
+    enum Mode {
+        NONE,
+        FXAA,
+        SMAA
+    };
+
+    // farthest the weight pass follows an edge in either direction
+    static const int MAX_DISTANCE = 16;
+    // one block of distances per crossing edge: below, none, above
+    static const int AREA_SIZE = 3 * (MAX_DISTANCE + 1);
+    // edge and crossing sums of a search fetch, in 32nds
+    static const int SEARCH_SIZE = 33;
+    static_assert(MAX_DISTANCE % 2 == 0, "The edge search steps two pixels at a time");
+
+    PostAntialiasing() {
+        glGenVertexArrays(1, &emptyVAO);
+        areaTexture = createLookup(AREA_SIZE, buildArea());
+        searchTexture = createLookup(SEARCH_SIZE, buildSearch());
+        glState().Invalidate();
+    }
+
+    ~PostAntialiasing() {
+        glDeleteTextures(1, &areaTexture);
+        glDeleteTextures(1, &searchTexture);
+        glDeleteVertexArrays(1, &emptyVAO);
+    }
+
+    PostAntialiasing(const PostAntialiasing&) = delete;
+    PostAntialiasing& operator=(const PostAntialiasing&) = delete;
+
+    // smaaWeights has to be compiled with MAX_DISTANCE defined to the class's value
+    void SetPrograms(unsigned int fxaa, unsigned int smaaEdges, unsigned int smaaWeights, unsigned int smaaBlend) {
+        fxaaProgram = fxaa;
+        edgesProgram = smaaEdges;
+        weightsProgram = smaaWeights;
+        blendProgram = smaaBlend;
+        glState().UseProgram(fxaaProgram);
+        glUniform1i(glGetUniformLocation(fxaaProgram, "image"), 0);
+        glState().UseProgram(edgesProgram);
+        glUniform1i(glGetUniformLocation(edgesProgram, "image"), 0);
+        glState().UseProgram(weightsProgram);
+        glUniform1i(glGetUniformLocation(weightsProgram, "edges"), 0);
+        glUniform1i(glGetUniformLocation(weightsProgram, "areaTexture"), 1);
+        glUniform1i(glGetUniformLocation(weightsProgram, "searchTexture"), 2);
+        glState().UseProgram(blendProgram);
+        glUniform1i(glGetUniformLocation(blendProgram, "image"), 0);
+        glUniform1i(glGetUniformLocation(blendProgram, "weights"), 1);
+    }
+
+    // the passes draw into whatever framebuffer is bound
+    void Fxaa(unsigned int color) {
+        ASSERT(fxaaProgram != 0, "FXAA program is not set");
+        draw(fxaaProgram, color, 0);
+    }
+
+    void SmaaEdges(unsigned int color) {
+        ASSERT(edgesProgram != 0, "SMAA programs are not set");
+        draw(edgesProgram, color, 0);
+    }
+
+    void SmaaWeights(unsigned int edges) {
+        draw(weightsProgram, edges, areaTexture, searchTexture);
+    }
+
+    void SmaaBlend(unsigned int color, unsigned int weights) {
+        draw(blendProgram, color, weights);
+    }
+
+private:
+    unsigned int emptyVAO = 0;
+    unsigned int areaTexture = 0;
+    unsigned int searchTexture = 0;
+    unsigned int fxaaProgram = 0;
+    unsigned int edgesProgram = 0;
+    unsigned int weightsProgram = 0;
+    unsigned int blendProgram = 0;
+
+    void draw(unsigned int program, unsigned int texture0, unsigned int texture1, unsigned int texture2 = 0) {
+        GLStateCache& state = glState();
+        state.UseProgram(program);
+        state.BindVertexArray(emptyVAO);
+        state.BindTexture(0, GL_TEXTURE_2D, texture0);
+        if (texture1 != 0)
+            state.BindTexture(1, GL_TEXTURE_2D, texture1);
+        if (texture2 != 0)
+            state.BindTexture(2, GL_TEXTURE_2D, texture2);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+
+    // square RG8 texture read with texelFetch
+    static unsigned int createLookup(int size, const std::vector<unsigned char>& texels) {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RG8, size, size, 0, GL_RG, GL_UNSIGNED_BYTE, texels.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return texture;
+    }
+
+    // adds the integral of the line from (x0, h0) to (x1, h1) over [from, to] to the part
+    // above the edge or below it
+    static void addSegment(glm::vec2& area, float x0, float h0, float x1, float h1, float from, float to) {
+        float a = std::max(x0, from);
+        float b = std::min(x1, to);
+        if (b <= a)
+            return;
+        float ha = h0 + (h1 - h0) * (a - x0) / (x1 - x0);
+        float hb = h0 + (h1 - h0) * (b - x0) / (x1 - x0);
+        float integral = 0.5f * (ha + hb) * (b - a);
+        if (integral > 0.0f)
+            area.x += integral;
+        else
+            area.y -= integral;
+    }
+
+    // The edge runs over left + right + 1 pixels with the current one left pixels from its
+    // start. A crossing edge above or below an end bends the silhouette half a pixel that
+    // way there; the straightened silhouette runs from each end to the edge's middle. The
+    // part above the edge is how much of the pixel on the upper side the lower side's color
+    // covers, the part below the opposite.
+    static glm::vec2 coverage(int startCrossing, int endCrossing, int left, int right) {
+        float length = left + right + 1.0f;
+        float middle = 0.5f * length;
+        glm::vec2 area(0.0f);
+        addSegment(area, 0.0f, 0.5f * startCrossing, middle, 0.0f, left, left + 1.0f);
+        addSegment(area, middle, 0.0f, length, 0.5f * endCrossing, left, left + 1.0f);
+        return area;
+    }
+
+    // x picks the crossing at the start and the distance to it, y the same at the end
+    static std::vector<unsigned char> buildArea() {
+        std::vector<unsigned char> texels(AREA_SIZE * AREA_SIZE * 2);
+        for (int endCrossing = -1; endCrossing <= 1; endCrossing++) {
+            for (int right = 0; right <= MAX_DISTANCE; right++) {
+                int y = (endCrossing + 1) * (MAX_DISTANCE + 1) + right;
+                for (int startCrossing = -1; startCrossing <= 1; startCrossing++) {
+                    for (int left = 0; left <= MAX_DISTANCE; left++) {
+                        int x = (startCrossing + 1) * (MAX_DISTANCE + 1) + left;
+                        glm::vec2 area = coverage(startCrossing, endCrossing, left, right);
+                        unsigned char* texel = &texels[(y * AREA_SIZE + x) * 2];
+                        texel[0] = (unsigned char) (std::min(area.x, 1.0f) * 255.0f + 0.5f);
+                        texel[1] = (unsigned char) (std::min(area.y, 1.0f) * 255.0f + 0.5f);
+                    }
+                }
+            }
+        }
+        return texels;
+    }
+
+    // the four texels of a search fetch: the near and the far pixel on the edge's row, then
+    // on the row across it, weighted 21, 7, 3 and 1 32nds; every sum has one decomposition
+    static void splitSum(int sum, bool texels[4]) {
+        const int weights[4] = { 21, 7, 3, 1 };
+        for (int i = 0; i < 4; i++) {
+            texels[i] = sum >= weights[i];
+            if (texels[i])
+                sum -= weights[i];
+        }
+    }
+
+    // x is the fetch's edge sum, y its crossing sum; texels hold how many of the two pixels
+    // the edge still continues for, in halves. A pixel's crossing edges lie on its left or
+    // bottom side, so r is for searches left or down, where a crossing ends the edge after
+    // its pixel, and g for searches right or up, where it ends the edge before its pixel
+    static std::vector<unsigned char> buildSearch() {
+        std::vector<unsigned char> texels(SEARCH_SIZE * SEARCH_SIZE * 2);
+        for (int crossingSum = 0; crossingSum < SEARCH_SIZE; crossingSum++) {
+            for (int edgeSum = 0; edgeSum < SEARCH_SIZE; edgeSum++) {
+                bool edge[4], crossing[4];
+                splitSum(edgeSum, edge);
+                splitSum(crossingSum, crossing);
+                bool crossingNear = crossing[0] || crossing[2];
+                bool crossingFar = crossing[1] || crossing[3];
+                int backward = !edge[0] ? 0 : (crossingNear || !edge[1] ? 1 : 2);
+                int forward = !edge[0] || crossingNear ? 0 : (!edge[1] || crossingFar ? 1 : 2);
+                unsigned char* texel = &texels[(crossingSum * SEARCH_SIZE + edgeSum) * 2];
+                texel[0] = (unsigned char) (backward * 255 / 2);
+                texel[1] = (unsigned char) (forward * 255 / 2);
+            }
+        }
+        return texels;
+    }
+};
+
+#endif //PROJECT_BASE_POSTANTIALIASING_H
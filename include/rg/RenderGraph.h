@@ -0,0 +1,336 @@
+#ifndef PROJECT_BASE_RENDERGRAPH_H
+#define PROJECT_BASE_RENDERGRAPH_H
+
+#include <map>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <functional>
+#include <glad/glad.h>
+
+#include <rg/Error.h>
+#include <rg/GLState.h>
+#include <rg/RenderTargetPool.h>
+
+// core since 4.3 and not part of the 3.3 loader
+typedef void (APIENTRYP PFNGLINVALIDATEFRAMEBUFFERPROC_RG)(GLenum target, GLsizei numAttachments, const GLenum* attachments);
+
+// Per frame description of the passes that produce a frame. Every frame the passes are
+// declared again with the targets they read and write, then Execute:
+//  - culls passes none of whose writes are read by a later pass or are a frame output,
+//  - drops writes nobody reads, so their targets are neither allocated nor attached,
+//  - acquires transient targets from a RenderTargetPool at their first use and releases
+//    them after their last, so targets whose lifetimes don't overlap share one texture,
+//  - binds a framebuffer made of the pass's targets and its viewport, runs the pass and
+//    invalidates attachments that no later pass reads.
+//
+// A target a pass both reads and writes (the depth buffer it tests against) is kept as
+// long as the pass runs. Passes declared with NO_FRAMEBUFFER bind their own targets.
+class RenderGraph {
+public:
+    typedef int Resource;
+
+    enum PassFlags {
+        NONE = 0,
+        // the pass binds its own framebuffers or only dispatches compute work
+        NO_FRAMEBUFFER = 1
+    };
+
+    typedef RenderTargetPool::Desc TextureDesc;
+
+    struct Stats {
+        unsigned int passes = 0;
+        unsigned int culledPasses = 0;
+        unsigned int transientTargets = 0;
+        // bytes the passes read and write in their declared targets, each access counted as
+        // one pass over the whole target; internal traffic of NO_FRAMEBUFFER passes is not seen
+        unsigned long long trafficBytes = 0;
+        // the same with the packed HDR targets at RGBA16F
+        unsigned long long rgba16fTrafficBytes = 0;
+    };
+
+    RenderGraph(RenderTargetPool& pool, GLADloadproc load) : pool(pool) {
+        int major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        if (major > 4 || (major == 4 && minor >= 3))
+            invalidateFramebuffer = (PFNGLINVALIDATEFRAMEBUFFERPROC_RG) load("glInvalidateFramebuffer");
+    }
+
+    ~RenderGraph() {
+        for (auto& framebuffer : framebuffers)
+            glDeleteFramebuffers(1, &framebuffer.second);
+    }
+
+    RenderGraph(const RenderGraph&) = delete;
+    RenderGraph& operator=(const RenderGraph&) = delete;
+
+    // forgets last frame's passes and targets; the pooled textures stay
+    void Reset() {
+        resources.clear();
+        passes.clear();
+    }
+
+    // a target that only lives during this frame
+    Resource CreateTexture(const std::string& name, const TextureDesc& desc) {
+        ResourceNode resource;
+        resource.name = name;
+        resource.desc = desc;
+        resources.push_back(resource);
+        return resources.size() - 1;
+    }
+
+    // a texture owned by someone else; texture 0 is the default framebuffer
+    Resource ImportTexture(const std::string& name, unsigned int texture, const TextureDesc& desc) {
+        Resource resource = CreateTexture(name, desc);
+        resources[resource].imported = true;
+        resources[resource].texture = texture;
+        return resource;
+    }
+
+    // passes writing an output are never culled
+    void MarkOutput(Resource resource) {
+        resources[resource].output = true;
+    }
+
+    void AddPass(const std::string& name, const std::vector<Resource>& reads, const std::vector<Resource>& writes,
+                 std::function<void()> execute, int flags = NONE) {
+        PassNode pass;
+        pass.name = name;
+        pass.reads = reads;
+        pass.writes = writes;
+        pass.execute = std::move(execute);
+        pass.flags = flags;
+        passes.push_back(std::move(pass));
+    }
+
+    // the texture behind a resource; valid while its pass executes
+    unsigned int GetTexture(Resource resource) const {
+        return resources[resource].texture;
+    }
+
+    void Execute() {
+        compile();
+        for (int i = 0; i < (int) passes.size(); i++) {
+            PassNode& pass = passes[i];
+            if (pass.culled)
+                continue;
+            // transient targets are acquired at their first use and released after their last
+            for (ResourceNode& resource : resources) {
+                if (!resource.imported && resource.firstUse == i) {
+                    resource.texture = pool.Acquire(resource.desc);
+                    stats.transientTargets++;
+                }
+            }
+            if (!(pass.flags & NO_FRAMEBUFFER))
+                bindFramebuffer(pass);
+            pass.execute();
+            if (!(pass.flags & NO_FRAMEBUFFER))
+                invalidate(pass, i);
+            for (ResourceNode& resource : resources)
+                if (!resource.imported && resource.lastUse == i)
+                    pool.Release(resource.texture);
+        }
+    }
+
+    const Stats& GetStats() const {
+        return stats;
+    }
+
+private:
+    struct ResourceNode {
+        std::string name;
+        TextureDesc desc;
+        bool imported = false;
+        bool output = false;
+        unsigned int texture = 0;
+        int firstUse = -1;
+        int lastUse = -1;
+    };
+
+    struct PassNode {
+        std::string name;
+        std::vector<Resource> reads;
+        std::vector<Resource> writes;
+        // writes that some later pass reads, in declaration order
+        std::vector<bool> keptWrites;
+        std::function<void()> execute;
+        int flags = NONE;
+        bool culled = false;
+        unsigned int framebuffer = 0;
+    };
+
+    RenderTargetPool& pool;
+    std::vector<ResourceNode> resources;
+    std::vector<PassNode> passes;
+    // framebuffers by their attachments: color textures by slot (0 for a dropped slot), then
+    // depth, then the sample count
+    std::map<std::vector<unsigned int>, unsigned int> framebuffers;
+    PFNGLINVALIDATEFRAMEBUFFERPROC_RG invalidateFramebuffer = nullptr;
+    Stats stats;
+
+    static bool reads(const PassNode& pass, Resource resource) {
+        for (Resource read : pass.reads)
+            if (read == resource)
+                return true;
+        return false;
+    }
+
+    void compile() {
+        stats = Stats();
+        stats.passes = passes.size();
+        // walk back from the outputs: a pass lives if something later needs one of its writes
+        std::vector<bool> needed(resources.size(), false);
+        for (int i = (int) passes.size() - 1; i >= 0; i--) {
+            PassNode& pass = passes[i];
+            pass.keptWrites.assign(pass.writes.size(), false);
+            bool alive = false;
+            for (int w = 0; w < (int) pass.writes.size(); w++) {
+                const ResourceNode& resource = resources[pass.writes[w]];
+                if (needed[pass.writes[w]] || resource.output)
+                    alive = pass.keptWrites[w] = true;
+            }
+            pass.culled = !alive;
+            if (pass.culled) {
+                stats.culledPasses++;
+                continue;
+            }
+            // earlier writes of what this pass overwrites are only needed if it reads them too
+            for (int w = 0; w < (int) pass.writes.size(); w++) {
+                if (reads(pass, pass.writes[w]))
+                    pass.keptWrites[w] = true;
+                needed[pass.writes[w]] = false;
+            }
+            for (Resource read : pass.reads)
+                needed[read] = true;
+        }
+
+        for (int i = 0; i < (int) passes.size(); i++) {
+            const PassNode& pass = passes[i];
+            if (pass.culled)
+                continue;
+            for (Resource read : pass.reads)
+                use(read, i);
+            for (int w = 0; w < (int) pass.writes.size(); w++)
+                if (pass.keptWrites[w])
+                    use(pass.writes[w], i);
+        }
+        countTraffic();
+        dropFramebuffers(pool.GetDeleted());
+    }
+
+    void countTraffic() {
+        for (const PassNode& pass : passes) {
+            if (pass.culled)
+                continue;
+            std::vector<Resource> accessed = pass.reads;
+            for (int w = 0; w < (int) pass.writes.size(); w++)
+                if (pass.keptWrites[w])
+                    accessed.push_back(pass.writes[w]);
+            for (Resource resource : accessed) {
+                const TextureDesc& desc = resources[resource].desc;
+                unsigned long long pixels = (unsigned long long) desc.width * desc.height * std::max(1, desc.samples);
+                stats.trafficBytes += pixels * RenderTargetPool::BytesPerPixel(desc.format);
+                stats.rgba16fTrafficBytes += pixels * RenderTargetPool::Rgba16fBytesPerPixel(desc.format);
+            }
+        }
+    }
+
+    void use(Resource resource, int pass) {
+        ResourceNode& node = resources[resource];
+        if (node.firstUse < 0)
+            node.firstUse = pass;
+        node.lastUse = pass;
+    }
+
+    void dropFramebuffers(const std::vector<unsigned int>& textures) {
+        for (unsigned int texture : textures) {
+            for (auto framebuffer = framebuffers.begin(); framebuffer != framebuffers.end();) {
+                const std::vector<unsigned int>& attachments = framebuffer->first;
+                if (std::find(attachments.begin(), attachments.end() - 1, texture) != attachments.end() - 1) {
+                    glDeleteFramebuffers(1, &framebuffer->second);
+                    framebuffer = framebuffers.erase(framebuffer);
+                } else {
+                    ++framebuffer;
+                }
+            }
+        }
+    }
+
+    void bindFramebuffer(PassNode& pass) {
+        std::vector<unsigned int> key;
+        unsigned int depth = 0;
+        bool backbuffer = false;
+        int width = 0, height = 0, samples = 1;
+        for (int w = 0; w < (int) pass.writes.size(); w++) {
+            const ResourceNode& resource = resources[pass.writes[w]];
+            if (resource.imported && resource.texture == 0)
+                backbuffer = true;
+            if (RenderTargetPool::IsDepthFormat(resource.desc.format))
+                depth = pass.keptWrites[w] ? resource.texture : 0;
+            else
+                key.push_back(pass.keptWrites[w] ? resource.texture : 0);
+            if (pass.keptWrites[w] && width == 0) {
+                width = resource.desc.width;
+                height = resource.desc.height;
+                samples = std::max(1, resource.desc.samples);
+            }
+        }
+        key.push_back(depth);
+        ASSERT(!backbuffer || key.size() <= 2, "The default framebuffer can't be combined with other targets");
+        key.push_back(samples);
+
+        if (backbuffer) {
+            pass.framebuffer = 0;
+        } else {
+            auto found = framebuffers.find(key);
+            if (found == framebuffers.end())
+                found = framebuffers.emplace(key, createFramebuffer(key)).first;
+            pass.framebuffer = found->second;
+        }
+        glState().BindFramebuffer(pass.framebuffer);
+        glState().Viewport(0, 0, width, height);
+    }
+
+    unsigned int createFramebuffer(const std::vector<unsigned int>& key) {
+        unsigned int framebuffer;
+        glGenFramebuffers(1, &framebuffer);
+        glState().BindFramebuffer(framebuffer);
+        GLenum target = key.back() > 1 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
+        int colorSlots = key.size() - 2;
+        std::vector<GLenum> drawBuffers;
+        for (int slot = 0; slot < colorSlots; slot++) {
+            if (key[slot] != 0)
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + slot, target, key[slot], 0);
+            drawBuffers.push_back(key[slot] != 0 ? GL_COLOR_ATTACHMENT0 + slot : GL_NONE);
+        }
+        if (key[colorSlots] != 0)
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, target, key[colorSlots], 0);
+        if (drawBuffers.empty())
+            glDrawBuffer(GL_NONE);
+        else
+            glDrawBuffers(drawBuffers.size(), drawBuffers.data());
+        ASSERT(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE, "Render graph framebuffer not complete");
+        return framebuffer;
+    }
+
+    // contents no later pass reads don't have to be written back to memory
+    void invalidate(const PassNode& pass, int index) {
+        if (invalidateFramebuffer == nullptr || pass.framebuffer == 0)
+            return;
+        std::vector<GLenum> attachments;
+        int slot = 0;
+        for (int w = 0; w < (int) pass.writes.size(); w++) {
+            const ResourceNode& resource = resources[pass.writes[w]];
+            bool depth = RenderTargetPool::IsDepthFormat(resource.desc.format);
+            if (pass.keptWrites[w] && !resource.imported && !resource.output && resource.lastUse == index)
+                attachments.push_back(depth ? GL_DEPTH_ATTACHMENT : GL_COLOR_ATTACHMENT0 + slot);
+            if (!depth)
+                slot++;
+        }
+        if (!attachments.empty())
+            invalidateFramebuffer(GL_FRAMEBUFFER, attachments.size(), attachments.data());
+    }
+};
+
+#endif //PROJECT_BASE_RENDERGRAPH_H
@@ -0,0 +1,304 @@
+#ifndef PROJECT_BASE_RENDERQUEUE_H
+#define PROJECT_BASE_RENDERQUEUE_H
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <learnopengl/model.h>
+#include <rg/Error.h>
+#include <rg/Scene.h>
+#include <rg/RingBuffer.h>
+#include <rg/GLState.h>
+#include <rg/TextureArrayPacker.h>
+
+// Everything the GL thread needs for one draw, already resolved: no names, no lookups.
+struct RenderPacket {
+    // diffuse, specular and normal map texture arrays
+    static const int TEXTURE_UNITS = 3;
+
+    unsigned int program;
+    unsigned int vao;
+    unsigned int indexCount;
+    unsigned int textureArrays[TEXTURE_UNITS];
+    // offset of the packet's DrawData in the ring buffer
+    unsigned int uniformOffset;
+};
+
+// std140 mirrors of the uniform blocks in the shaders; vec3s are padded to vec4
+struct LightData {
+    glm::vec4 position;
+    glm::vec4 ambient;
+    glm::vec4 diffuse;
+    glm::vec4 specular;
+    // constant, linear, quadratic, shadow slot or -1
+    glm::vec4 attenuation;
+};
+
+struct FrameData {
+    static const int MAX_POINT_LIGHTS = 8;
+    static const int MAX_SHADOW_CASCADES = 4;
+    static const int MAX_SHADOWED_POINT_LIGHTS = 4;
+
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec4 viewPosition;
+    LightData pointLights[MAX_POINT_LIGHTS];
+    int pointLightCount;
+    // bit i is set if pointLights[i] is baked into the lightmap's layer i
+    unsigned int bakedLightMask;
+    int padding[2];
+    // world to shadow map space of the sun's cascades
+    glm::mat4 sunShadowMatrices[MAX_SHADOW_CASCADES];
+    int sunShadowCascades;
+    int shadowPadding[3];
+    // world to shadow atlas space of the cube faces of the shadowed point lights, six per slot
+    glm::mat4 pointShadowMatrices[MAX_SHADOWED_POINT_LIGHTS * 6];
+    // atlas rectangles of the faces, min xy and max xy
+    glm::vec4 pointShadowRects[MAX_SHADOWED_POINT_LIGHTS * 6];
+};
+
+struct DrawData {
+    glm::mat4 model;
+    // bit i is set if pointLights[i] is on and reaches the object
+    unsigned int lightMask;
+    // layers of the material in the bound texture arrays, -1 if the mesh has no such texture
+    int diffuseLayer;
+    int specularLayer;
+    int normalLayer;
+    // the mesh's first triangle in the lightmap's triangle buffer, -1 if it isn't baked
+    int lightmapBase;
+    int lightmapPadding[3];
+};
+
+// Turns the visible mesh renderers of a scene into render packets. Build splits the
+// renderers into slices that workers turn into packets independently, writing each
+// renderer's DrawData straight into the ring buffer; Submit replays the slices in order
+// on the GL thread in one loop that only issues GL calls.
+//
+// Material textures come from a TextureArrayPacker: a packet binds the diffuse, specular
+// and normal map texture arrays on units 0 to 2 and picks its material with the layers in
+// its DrawData, so packets whose materials share an array don't rebind any textures.
+// Geometry with a normal map can be given its own program variant per pass.
+class RenderQueue {
+public:
+    static const unsigned int FRAME_DATA_BINDING = 0;
+    static const unsigned int DRAW_DATA_BINDING = 1;
+
+    struct Stats {
+        unsigned int packets = 0;
+        double buildMilliseconds = 0.0;
+        double submitMilliseconds = 0.0;
+    };
+
+    // points the program's FrameData and DrawData blocks at their binding points
+    static void BindUniformBlocks(unsigned int program) {
+        unsigned int frameData = glGetUniformBlockIndex(program, "FrameData");
+        if (frameData != GL_INVALID_INDEX)
+            glUniformBlockBinding(program, frameData, FRAME_DATA_BINDING);
+        unsigned int drawData = glGetUniformBlockIndex(program, "DrawData");
+        if (drawData != GL_INVALID_INDEX)
+            glUniformBlockBinding(program, drawData, DRAW_DATA_BINDING);
+    }
+
+    // normalMapped draws the geometry that has a normal map, program if it is 0; packets built
+    // after the call use the new programs
+    void SetProgram(MeshRenderer::Pass pass, unsigned int program, unsigned int normalMapped = 0,
+                    const std::string& samplerPrefix = "material.") {
+        if (normalMapped == 0)
+            normalMapped = program;
+        if (programs[pass][0] == program && programs[pass][1] == normalMapped)
+            return;
+        programs[pass][0] = program;
+        programs[pass][1] = normalMapped;
+        for (unsigned int variant : { program, normalMapped }) {
+            BindUniformBlocks(variant);
+            glState().UseProgram(variant);
+            for (int unit = 0; unit < RenderPacket::TEXTURE_UNITS; unit++) {
+                int location = glGetUniformLocation(variant, (samplerPrefix + SAMPLER_NAMES[unit]).c_str());
+                if (location >= 0)
+                    glUniform1i(location, unit);
+            }
+        }
+    }
+
+    // adds the diffuse and specular textures of every mesh to the packer; call for every
+    // model before packer.Build
+    static void AddTextures(const Model& model, TextureArrayPacker& packer) {
+        for (const Mesh& mesh : model.meshes)
+            for (const Texture& texture : mesh.textures)
+                for (int unit = 0; unit < RenderPacket::TEXTURE_UNITS; unit++)
+                    if (texture.type == TEXTURE_TYPES[unit])
+                        packer.Add(texture.id, unit != DIFFUSE_UNIT);
+    }
+
+    // resolves the VAO and material layers of every mesh; the packer has to be built already.
+    // Only the first texture of each type is used.
+    void Prepare(const Model& model, const TextureArrayPacker& packer) {
+        std::vector<Geometry>& geometry = models[&model];
+        geometry.clear();
+        int triangles = 0;
+        for (const Mesh& mesh : model.meshes) {
+            Geometry part;
+            part.vao = mesh.VAO;
+            part.indexCount = mesh.indices.size();
+            part.firstTriangle = triangles;
+            triangles += mesh.indices.size() / 3;
+            std::fill(part.textureArrays, part.textureArrays + RenderPacket::TEXTURE_UNITS, 0u);
+            std::fill(part.layers, part.layers + RenderPacket::TEXTURE_UNITS, -1);
+            for (const Texture& texture : mesh.textures) {
+                for (int unit = 0; unit < RenderPacket::TEXTURE_UNITS; unit++) {
+                    if (texture.type != TEXTURE_TYPES[unit] || part.layers[unit] >= 0)
+                        continue;
+                    TextureLayer layer = packer.Find(texture.id);
+                    ASSERT(layer.layer >= 0, "Texture was not added to the texture array packer");
+                    part.textureArrays[unit] = packer.GetArray(layer.array);
+                    part.layers[unit] = layer.layer;
+                }
+            }
+            geometry.push_back(part);
+        }
+    }
+
+    // lightsOn: bit i is cleared for lights that are switched off this frame; the ring
+    // buffer's frame has to be begun already.
+    // parallelFor(count, task) has to call task(i) once for every i in [0, count)
+    template<typename ParallelFor>
+    void Build(const Scene& scene, unsigned int lightsOn, RingBuffer& ring, int sliceCount, ParallelFor parallelFor) {
+        auto start = std::chrono::high_resolution_clock::now();
+        int rendererCount = scene.meshRenderers.Size();
+        sliceCount = std::max(1, std::min(sliceCount, rendererCount));
+        if ((int) slices.size() < sliceCount)
+            slices.resize(sliceCount);
+        activeSlices = sliceCount;
+        parallelFor(sliceCount, [&](int slice) {
+            buildSlice(scene, lightsOn, ring, rendererCount * slice / sliceCount, rendererCount * (slice + 1) / sliceCount, slices[slice]);
+        });
+        auto end = std::chrono::high_resolution_clock::now();
+        stats.buildMilliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    void Build(const Scene& scene, unsigned int lightsOn, RingBuffer& ring) {
+        Build(scene, lightsOn, ring, 1, [](int count, const std::function<void(int)>& task) {
+            for (int i = 0; i < count; i++)
+                task(i);
+        });
+    }
+
+    // FrameData has to be bound already and the ring buffer flushed; the state cache drops
+    // the binds that repeat between neighbouring packets
+    void Submit(const RingBuffer& ring) {
+        auto start = std::chrono::high_resolution_clock::now();
+        stats.packets = 0;
+        GLStateCache& state = glState();
+        for (int slice = 0; slice < activeSlices; slice++) {
+            for (const RenderPacket& packet : slices[slice].packets) {
+                state.UseProgram(packet.program);
+                state.BindVertexArray(packet.vao);
+                for (int unit = 0; unit < RenderPacket::TEXTURE_UNITS; unit++)
+                    state.BindTexture(unit, GL_TEXTURE_2D_ARRAY, packet.textureArrays[unit]);
+                state.BindUniformBufferRange(DRAW_DATA_BINDING, ring.GetBuffer(), packet.uniformOffset, sizeof(DrawData));
+                glDrawElements(GL_TRIANGLES, packet.indexCount, GL_UNSIGNED_INT, 0);
+                stats.packets++;
+            }
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        stats.submitMilliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    // draws the same packets with one depth only program and no textures, for a depth
+    // pre-pass; the program's vertex shader has to compute gl_Position exactly like the
+    // packets' own programs
+    void SubmitDepth(const RingBuffer& ring, unsigned int program) {
+        GLStateCache& state = glState();
+        state.UseProgram(program);
+        for (int slice = 0; slice < activeSlices; slice++) {
+            for (const RenderPacket& packet : slices[slice].packets) {
+                state.BindVertexArray(packet.vao);
+                state.BindUniformBufferRange(DRAW_DATA_BINDING, ring.GetBuffer(), packet.uniformOffset, sizeof(DrawData));
+                glDrawElements(GL_TRIANGLES, packet.indexCount, GL_UNSIGNED_INT, 0);
+            }
+        }
+    }
+
+    const Stats& GetStats() const {
+        return stats;
+    }
+
+private:
+    // only the diffuse map holds color, the other maps are packed as linear data
+    static constexpr int DIFFUSE_UNIT = 0;
+    static constexpr const char* TEXTURE_TYPES[RenderPacket::TEXTURE_UNITS] = {
+            "texture_diffuse", "texture_specular", "texture_normal"
+    };
+    static constexpr const char* SAMPLER_NAMES[RenderPacket::TEXTURE_UNITS] = {
+            "diffuseArray", "specularArray", "normalArray"
+    };
+
+    struct Geometry {
+        unsigned int vao;
+        unsigned int indexCount;
+        // triangles of the model's meshes before this one
+        int firstTriangle;
+        unsigned int textureArrays[RenderPacket::TEXTURE_UNITS];
+        int layers[RenderPacket::TEXTURE_UNITS];
+    };
+
+    struct Slice {
+        std::vector<RenderPacket> packets;
+    };
+
+    // [pass][has a normal map]
+    unsigned int programs[2][2] = {};
+    std::unordered_map<const Model*, std::vector<Geometry>> models;
+    std::vector<Slice> slices;
+    int activeSlices = 0;
+    Stats stats;
+
+    void buildSlice(const Scene& scene, unsigned int lightsOn, RingBuffer& ring, int begin, int end, Slice& slice) const {
+        slice.packets.clear();
+        for (int i = begin; i < end; i++) {
+            const MeshRenderer& renderer = scene.meshRenderers[i];
+            if (!renderer.visible || renderer.model == nullptr)
+                continue;
+            auto found = models.find(renderer.model);
+            ASSERT(found != models.end(), "Model was not prepared for the render queue");
+            DrawData drawData = {};
+            drawData.model = scene.hierarchy.GetWorldMatrix(renderer.node);
+            drawData.lightMask = renderer.lightMask & lightsOn;
+            for (const Geometry& part : found->second) {
+                drawData.diffuseLayer = part.layers[0];
+                drawData.specularLayer = part.layers[1];
+                drawData.normalLayer = part.layers[2];
+                drawData.lightmapBase = renderer.lightmapTriangle >= 0 ? renderer.lightmapTriangle + part.firstTriangle : -1;
+                RenderPacket packet;
+                packet.program = programs[renderer.pass][part.layers[2] >= 0];
+                packet.vao = part.vao;
+                packet.indexCount = part.indexCount;
+                std::copy(part.textureArrays, part.textureArrays + RenderPacket::TEXTURE_UNITS, packet.textureArrays);
+                packet.uniformOffset = ring.Push(drawData);
+                slice.packets.push_back(packet);
+            }
+        }
+        // program first, then texture arrays, then geometry: the GL thread changes as little
+        // state as it can
+        std::stable_sort(slice.packets.begin(), slice.packets.end(), [](const RenderPacket& a, const RenderPacket& b) {
+            if (a.program != b.program)
+                return a.program < b.program;
+            for (int unit = 0; unit < RenderPacket::TEXTURE_UNITS; unit++)
+                if (a.textureArrays[unit] != b.textureArrays[unit])
+                    return a.textureArrays[unit] < b.textureArrays[unit];
+            return a.vao < b.vao;
+        });
+    }
+};
+
+constexpr const char* RenderQueue::TEXTURE_TYPES[RenderPacket::TEXTURE_UNITS];
+constexpr const char* RenderQueue::SAMPLER_NAMES[RenderPacket::TEXTURE_UNITS];
+
+#endif //PROJECT_BASE_RENDERQUEUE_H
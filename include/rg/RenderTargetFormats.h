@@ -0,0 +1,100 @@
+#ifndef PROJECT_BASE_RENDERTARGETFORMATS_H
+#define PROJECT_BASE_RENDERTARGETFORMATS_H
+
+#include <glad/glad.h>
+
+#include <rg/Error.h>
+#include <rg/GLState.h>
+#include <rg/RenderTargetPool.h>
+
+// Picks the render target formats the context can actually render to, once at startup.
+//
+// HDR color prefers GL_R11F_G11F_B10F, 4 bytes a pixel against the 8 of GL_RGBA16F: no
+// pass reads alpha back and lighting never goes negative, which the packed format can't
+// hold. It falls back to RGBA16F where the packed format isn't color renderable.
+//
+// Depth is picked by what a pass does with it. Orthographic shadow maps store depth
+// linearly over the tight range of their casters, where 16 bits are plenty; perspective
+// depth crowds its precision near the camera and keeps 24 bits.
+//
+// The default framebuffer is asked whether it encodes to sRGB on write, which the window
+// has to request when it is created.
+class RenderTargetFormats {
+public:
+    enum DepthUse {
+        // perspective depth the scene tests against and reprojects from
+        SCENE_DEPTH,
+        // orthographic light space depth
+        ORTHOGRAPHIC_SHADOW_DEPTH,
+        // perspective light space depth with the near plane close to the light
+        PERSPECTIVE_SHADOW_DEPTH
+    };
+
+    RenderTargetFormats() {
+        packedHdr = isRenderable(GL_R11F_G11F_B10F);
+        depth16 = isRenderable(GL_DEPTH_COMPONENT16);
+        int encoding = GL_LINEAR;
+        rg::clearAllOpenGlErrors();
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, GL_BACK_LEFT, GL_FRAMEBUFFER_ATTACHMENT_COLOR_ENCODING, &encoding);
+        srgbBackbuffer = glGetError() == GL_NO_ERROR && encoding == GL_SRGB;
+        glState().Invalidate();
+    }
+
+    bool IsPackedHdrSupported() const {
+        return packedHdr;
+    }
+
+    // with GL_FRAMEBUFFER_SRGB enabled the default framebuffer converts linear output
+    bool IsBackbufferSrgb() const {
+        return srgbBackbuffer;
+    }
+
+    GLenum GetHdrColor() const {
+        return packedHdr ? GL_R11F_G11F_B10F : GL_RGBA16F;
+    }
+
+    GLenum GetDepth(DepthUse use) const {
+        if (use == ORTHOGRAPHIC_SHADOW_DEPTH && depth16)
+            return GL_DEPTH_COMPONENT16;
+        return GL_DEPTH_COMPONENT24;
+    }
+
+    // layout qualifier of image units bound to textures of a color format
+    static const char* ImageFormat(GLenum format) {
+        switch (format) {
+            case GL_R11F_G11F_B10F: return "r11f_g11f_b10f";
+            case GL_RGBA32F: return "rgba32f";
+            case GL_RG16F: return "rg16f";
+            case GL_R16F: return "r16f";
+            default: return "rgba16f";
+        }
+    }
+
+private:
+    bool packedHdr = false;
+    bool depth16 = false;
+    bool srgbBackbuffer = false;
+
+    // attaches a small texture of the format and asks the framebuffer if it is complete
+    static bool isRenderable(GLenum format) {
+        bool depth = RenderTargetPool::IsDepthFormat(format);
+        unsigned int texture, framebuffer;
+        rg::clearAllOpenGlErrors();
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, 4, 4, 0, depth ? GL_DEPTH_COMPONENT : GL_RGBA, GL_FLOAT, NULL);
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, depth ? GL_DEPTH_ATTACHMENT : GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+        glDrawBuffer(depth ? GL_NONE : GL_COLOR_ATTACHMENT0);
+        bool complete = glGetError() == GL_NO_ERROR && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteTextures(1, &texture);
+        glState().Invalidate();
+        return complete;
+    }
+};
+
+#endif //PROJECT_BASE_RENDERTARGETFORMATS_H
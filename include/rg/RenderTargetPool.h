@@ -0,0 +1,239 @@
+#ifndef PROJECT_BASE_RENDERTARGETPOOL_H
+#define PROJECT_BASE_RENDERTARGETPOOL_H
+
+#include <vector>
+#include <algorithm>
+#include <glad/glad.h>
+
+#include <rg/Error.h>
+#include <rg/GLState.h>
+
+// Textures for render targets, shared by everything that renders off screen. Acquire
+// hands out a free texture of the same size, format and sample count, or creates one;
+// Release gives it back for the next user. Free textures nobody acquired for IDLE_FRAMES
+// frames are retired and only deleted FRAMES_IN_FLIGHT frames later, when no frame the
+// GPU may still be working on can reference them.
+//
+// The display size the targets derive from follows the framebuffer only after it held
+// still for SETTLE_FRAMES frames, so dragging a window edge renders a few frames stretched
+// instead of allocating targets for every size on the way.
+class RenderTargetPool {
+public:
+    static const int IDLE_FRAMES = 30;
+    static const int FRAMES_IN_FLIGHT = 3;
+    static const int SETTLE_FRAMES = 10;
+
+    struct Desc {
+        int width;
+        int height;
+        GLenum format;
+        int samples;
+
+        bool operator==(const Desc& other) const {
+            return width == other.width && height == other.height && format == other.format && samples == other.samples;
+        }
+    };
+
+    struct Stats {
+        unsigned int textures = 0;
+        unsigned int acquired = 0;
+        unsigned int retired = 0;
+        unsigned long long bytes = 0;
+        // the same targets with the packed HDR ones at RGBA16F
+        unsigned long long rgba16fBytes = 0;
+        unsigned int allocations = 0;
+        unsigned int deletions = 0;
+    };
+
+    RenderTargetPool() = default;
+
+    ~RenderTargetPool() {
+        for (Target& target : targets)
+            glDeleteTextures(1, &target.id);
+    }
+
+    RenderTargetPool(const RenderTargetPool&) = delete;
+    RenderTargetPool& operator=(const RenderTargetPool&) = delete;
+
+    static bool IsDepthFormat(GLenum format) {
+        return format == GL_DEPTH_COMPONENT16 || format == GL_DEPTH_COMPONENT24 || format == GL_DEPTH_COMPONENT32F
+               || format == GL_DEPTH_COMPONENT || format == GL_DEPTH24_STENCIL8;
+    }
+
+    static unsigned int BytesPerPixel(GLenum format) {
+        switch (format) {
+            case GL_RGBA32F: return 16;
+            case GL_RGBA16F: return 8;
+            case GL_RGB16F: return 6;
+            case GL_RG16F: return 4;
+            case GL_R11F_G11F_B10F: return 4;
+            case GL_R16F: return 2;
+            case GL_DEPTH_COMPONENT16: return 2;
+            case GL_RG8: return 2;
+            case GL_R8: return 1;
+            default: return 4;
+        }
+    }
+
+    // size of a pixel if packed HDR formats were stored as RGBA16F
+    static unsigned int Rgba16fBytesPerPixel(GLenum format) {
+        return BytesPerPixel(format == GL_R11F_G11F_B10F ? GL_RGBA16F : format);
+    }
+
+    // GL_TEXTURE_2D, or GL_TEXTURE_2D_MULTISAMPLE for more than one sample
+    static GLenum TextureTarget(const Desc& desc) {
+        return desc.samples > 1 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
+    }
+
+    unsigned int Acquire(const Desc& desc) {
+        for (Target& target : targets) {
+            if (target.state == FREE && target.desc == desc) {
+                target.state = ACQUIRED;
+                target.idleFrames = 0;
+                return target.id;
+            }
+        }
+        Target target;
+        target.desc = desc;
+        target.state = ACQUIRED;
+        create(target);
+        targets.push_back(target);
+        return target.id;
+    }
+
+    void Release(unsigned int texture) {
+        for (Target& target : targets) {
+            if (target.id == texture) {
+                ASSERT(target.state == ACQUIRED, "Released a render target that wasn't acquired");
+                target.state = FREE;
+                return;
+            }
+        }
+        ASSERT(false, "Released a texture the pool doesn't own");
+    }
+
+    const Desc& GetDesc(unsigned int texture) const {
+        for (const Target& target : targets)
+            if (target.id == texture)
+                return target.desc;
+        ASSERT(false, "Texture isn't a pooled render target");
+        return targets[0].desc;
+    }
+
+    // call once per frame; ages free targets, retires idle ones and deletes the retired
+    // ones no frame in flight can use anymore
+    void EndFrame() {
+        frame++;
+        deleted.clear();
+        for (int t = (int) targets.size() - 1; t >= 0; t--) {
+            Target& target = targets[t];
+            if (target.state == FREE && ++target.idleFrames > IDLE_FRAMES) {
+                target.state = RETIRED;
+                target.retiredFrame = frame;
+            }
+            if (target.state == RETIRED && frame - target.retiredFrame >= FRAMES_IN_FLIGHT) {
+                glDeleteTextures(1, &target.id);
+                deleted.push_back(target.id);
+                stats.deletions++;
+                targets.erase(targets.begin() + t);
+            }
+        }
+        if (!deleted.empty())
+            glState().Invalidate();
+        updateStats();
+    }
+
+    // textures the last EndFrame deleted, so framebuffers made of them can be dropped
+    const std::vector<unsigned int>& GetDeleted() const {
+        return deleted;
+    }
+
+    void SetDisplaySize(int width, int height) {
+        // minimized windows report 0 x 0
+        if (width <= 0 || height <= 0)
+            return;
+        if (displayWidth == 0) {
+            displayWidth = width;
+            displayHeight = height;
+        }
+        if (width != pendingWidth || height != pendingHeight) {
+            pendingWidth = width;
+            pendingHeight = height;
+            stableFrames = 0;
+        } else if (++stableFrames >= SETTLE_FRAMES) {
+            displayWidth = width;
+            displayHeight = height;
+        }
+    }
+
+    int GetDisplayWidth() const {
+        return displayWidth;
+    }
+
+    int GetDisplayHeight() const {
+        return displayHeight;
+    }
+
+    const Stats& GetStats() const {
+        return stats;
+    }
+
+private:
+    enum State {
+        FREE,
+        ACQUIRED,
+        RETIRED
+    };
+
+    struct Target {
+        unsigned int id = 0;
+        Desc desc;
+        State state = FREE;
+        int idleFrames = 0;
+        unsigned long long retiredFrame = 0;
+    };
+
+    std::vector<Target> targets;
+    std::vector<unsigned int> deleted;
+    unsigned long long frame = 0;
+    int displayWidth = 0, displayHeight = 0;
+    int pendingWidth = 0, pendingHeight = 0;
+    int stableFrames = 0;
+    Stats stats;
+
+    void create(Target& target) {
+        const Desc& desc = target.desc;
+        GLenum textureTarget = TextureTarget(desc);
+        glGenTextures(1, &target.id);
+        glBindTexture(textureTarget, target.id);
+        if (desc.samples > 1) {
+            glTexImage2DMultisample(textureTarget, desc.samples, desc.format, desc.width, desc.height, GL_TRUE);
+        } else {
+            bool depth = IsDepthFormat(desc.format);
+            glTexImage2D(textureTarget, 0, desc.format, desc.width, desc.height, 0,
+                         depth ? GL_DEPTH_COMPONENT : GL_RGBA, GL_FLOAT, NULL);
+            glTexParameteri(textureTarget, GL_TEXTURE_MIN_FILTER, depth ? GL_NEAREST : GL_LINEAR);
+            glTexParameteri(textureTarget, GL_TEXTURE_MAG_FILTER, depth ? GL_NEAREST : GL_LINEAR);
+            glTexParameteri(textureTarget, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(textureTarget, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+        glBindTexture(textureTarget, 0);
+        glState().Invalidate();
+        stats.allocations++;
+    }
+
+    void updateStats() {
+        stats.textures = targets.size();
+        stats.acquired = stats.retired = 0;
+        stats.bytes = stats.rgba16fBytes = 0;
+        for (const Target& target : targets) {
+            stats.acquired += target.state == ACQUIRED;
+            stats.retired += target.state == RETIRED;
+            unsigned long long pixels = (unsigned long long) target.desc.width * target.desc.height * std::max(1, target.desc.samples);
+            stats.bytes += pixels * BytesPerPixel(target.desc.format);
+            stats.rgba16fBytes += pixels * Rgba16fBytesPerPixel(target.desc.format);
+        }
+    }
+};
+
+#endif //PROJECT_BASE_RENDERTARGETPOOL_H
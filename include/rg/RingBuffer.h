@@ -0,0 +1,172 @@
+#ifndef PROJECT_BASE_RINGBUFFER_H
+#define PROJECT_BASE_RINGBUFFER_H
+
+#include <vector>
+#include <atomic>
+#include <cstring>
+#include <glad/glad.h>
+
+#include <rg/Error.h>
+
+// ARB_buffer_storage is core only since 4.4 and not part of the 3.3 loader, so its entry
+// point and flags are looked up by hand
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+typedef void (APIENTRYP PFNGLBUFFERSTORAGEPROC_RG)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+// Per frame buffer memory for data that changes every frame. With ARB_buffer_storage the
+// buffer holds FRAMES sections and stays mapped for its whole life; the section of frame
+// n is only reused after the fence placed at the end of frame n completes, so with three
+// frames in flight the CPU practically never waits. Without the extension, allocations
+// go to a staging copy that Flush uploads into an orphaned buffer once per frame.
+//
+// Allocate only touches memory, so workers can fill their allocations concurrently;
+// BeginFrame, Flush and EndFrame issue GL calls and belong to the GL thread.
+class RingBuffer {
+public:
+    static const int FRAMES = 3;
+
+    struct Allocation {
+        void* data;
+        unsigned int offset;
+    };
+
+    struct Stats {
+        bool persistent = false;
+        unsigned int usedBytes = 0;
+        unsigned int capacityBytes = 0;
+        unsigned int fenceWaits = 0;
+    };
+
+    RingBuffer(GLenum target, unsigned int frameSize, GLADloadproc load) : target(target) {
+        int alignment = 16;
+        if (target == GL_UNIFORM_BUFFER)
+            glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        this->alignment = alignment;
+        this->frameSize = align(frameSize);
+
+        glGenBuffers(1, &buffer);
+        glBindBuffer(target, buffer);
+        PFNGLBUFFERSTORAGEPROC_RG bufferStorage = nullptr;
+        if (hasExtension("GL_ARB_buffer_storage"))
+            bufferStorage = (PFNGLBUFFERSTORAGEPROC_RG) load("glBufferStorage");
+        if (bufferStorage != nullptr) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            bufferStorage(target, FRAMES * this->frameSize, nullptr, flags);
+            mapped = (unsigned char*) glMapBufferRange(target, 0, FRAMES * this->frameSize, flags);
+        }
+        if (mapped == nullptr) {
+            staging.resize(this->frameSize);
+            glBufferData(target, this->frameSize, nullptr, GL_STREAM_DRAW);
+        }
+        glBindBuffer(target, 0);
+        stats.persistent = mapped != nullptr;
+        stats.capacityBytes = this->frameSize;
+    }
+
+    ~RingBuffer() {
+        for (GLsync& fence : fences)
+            if (fence != nullptr)
+                glDeleteSync(fence);
+        if (mapped != nullptr) {
+            glBindBuffer(target, buffer);
+            glUnmapBuffer(target);
+            glBindBuffer(target, 0);
+        }
+        glDeleteBuffers(1, &buffer);
+    }
+
+    RingBuffer(const RingBuffer&) = delete;
+    RingBuffer& operator=(const RingBuffer&) = delete;
+
+    // waits until the GPU is done with the section this frame is going to overwrite
+    void BeginFrame() {
+        section = (section + 1) % FRAMES;
+        GLsync& fence = fences[section];
+        if (fence != nullptr) {
+            if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+                stats.fenceWaits++;
+                while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+                    ;
+            }
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+        used = 0;
+    }
+
+    // offset is relative to the start of GetBuffer(), ready for glBindBufferRange
+    Allocation Allocate(unsigned int size) {
+        unsigned int alignedSize = align(size);
+        unsigned int start = used.fetch_add(alignedSize);
+        ASSERT(start + alignedSize <= frameSize, "Ring buffer frame is full, increase its frame size");
+        if (mapped != nullptr)
+            return { mapped + section * frameSize + start, section * frameSize + start };
+        return { staging.data() + start, start };
+    }
+
+    template<typename T>
+    unsigned int Push(const T& value) {
+        Allocation allocation = Allocate(sizeof(T));
+        std::memcpy(allocation.data, &value, sizeof(T));
+        return allocation.offset;
+    }
+
+    // makes this frame's allocations visible to the GPU; call before the draws that read them
+    void Flush() {
+        stats.usedBytes = used;
+        if (mapped != nullptr)
+            return;
+        glBindBuffer(target, buffer);
+        glBufferData(target, frameSize, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(target, 0, used, staging.data());
+        glBindBuffer(target, 0);
+    }
+
+    // call after the last draw that reads this frame's allocations
+    void EndFrame() {
+        if (mapped != nullptr)
+            fences[section] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    unsigned int GetBuffer() const {
+        return buffer;
+    }
+
+    const Stats& GetStats() const {
+        return stats;
+    }
+
+private:
+    GLenum target;
+    unsigned int buffer = 0;
+    unsigned int alignment = 16;
+    unsigned int frameSize = 0;
+    unsigned char* mapped = nullptr;
+    std::vector<unsigned char> staging;
+    GLsync fences[FRAMES] = {};
+    int section = 0;
+    std::atomic<unsigned int> used{0};
+    Stats stats;
+
+    unsigned int align(unsigned int size) const {
+        return (size + alignment - 1) / alignment * alignment;
+    }
+
+    static bool hasExtension(const char* name) {
+        int count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (int i = 0; i < count; i++) {
+            const char* extension = (const char*) glGetStringi(GL_EXTENSIONS, i);
+            if (extension != nullptr && std::strcmp(extension, name) == 0)
+                return true;
+        }
+        return false;
+    }
+};
+
+#endif //PROJECT_BASE_RINGBUFFER_H
@@ -0,0 +1,387 @@
+#ifndef PROJECT_BASE_SCENE_H
+#define PROJECT_BASE_SCENE_H
+
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <glm/glm.hpp>
+
+#include <rg/Error.h>
+#include <rg/Bounds.h>
+#include <rg/Frustum.h>
+#include <rg/FrustumCuller.h>
+#include <rg/OcclusionCuller.h>
+#include <rg/BVH.h>
+#include <rg/TransformHierarchy.h>
+
+class Model;
+
+// An entity is an index into the component arrays plus a generation, so a handle to a
+// destroyed entity never aliases the entity that reuses its slot.
+typedef unsigned int Entity;
+
+const Entity NULL_ENTITY = 0xffffffffu;
+const unsigned int ENTITY_INDEX_BITS = 20;
+const unsigned int ENTITY_INDEX_MASK = (1u << ENTITY_INDEX_BITS) - 1;
+
+inline unsigned int entityIndex(Entity entity) {
+    return entity & ENTITY_INDEX_MASK;
+}
+
+// Components of one type, packed without holes so systems walk them linearly. The sparse
+// array maps an entity index to the component's position; removal moves the last
+// component into the hole, so the order is not stable.
+template<typename Component>
+class ComponentArray {
+public:
+    Component& Add(Entity entity, const Component& component = Component()) {
+        ASSERT(!Has(entity), "Entity already has this component");
+        unsigned int index = entityIndex(entity);
+        if (index >= sparse.size())
+            sparse.resize(index + 1, -1);
+        sparse[index] = (int) components.size();
+        components.push_back(component);
+        entities.push_back(entity);
+        return components.back();
+    }
+
+    void Remove(Entity entity) {
+        if (!Has(entity))
+            return;
+        int dense = sparse[entityIndex(entity)];
+        int last = (int) components.size() - 1;
+        if (dense != last) {
+            components[dense] = components[last];
+            entities[dense] = entities[last];
+            sparse[entityIndex(entities[dense])] = dense;
+        }
+        components.pop_back();
+        entities.pop_back();
+        sparse[entityIndex(entity)] = -1;
+    }
+
+    bool Has(Entity entity) const {
+        unsigned int index = entityIndex(entity);
+        return index < sparse.size() && sparse[index] >= 0 && entities[sparse[index]] == entity;
+    }
+
+    Component& Get(Entity entity) {
+        ASSERT(Has(entity), "Entity doesn't have this component");
+        return components[sparse[entityIndex(entity)]];
+    }
+
+    const Component& Get(Entity entity) const {
+        ASSERT(Has(entity), "Entity doesn't have this component");
+        return components[sparse[entityIndex(entity)]];
+    }
+
+    int Size() const {
+        return (int) components.size();
+    }
+
+    Component& operator[](int i) {
+        return components[i];
+    }
+
+    const Component& operator[](int i) const {
+        return components[i];
+    }
+
+    Entity GetEntity(int i) const {
+        return entities[i];
+    }
+
+private:
+    std::vector<Component> components;
+    std::vector<Entity> entities;
+    std::vector<int> sparse;
+};
+
+// node in Scene::hierarchy, which owns the local and world matrices
+struct Transform {
+    int node = TransformHierarchy::NO_PARENT;
+};
+
+struct MeshRenderer {
+    enum Pass { LIT, EMISSIVE };
+
+    // null for objects that only take part in culling
+    Model* model = nullptr;
+    AABB localBounds;
+    Pass pass = LIT;
+    // moves often; cached shadow maps draw it every frame instead of being invalidated by it
+    bool dynamic = false;
+
+    // written by the scene systems
+    int node = TransformHierarchy::NO_PARENT;
+    AABB worldBounds;
+    int proxy = DynamicBVH::NULL_NODE;
+    bool visible = true;
+    // bit i is set if pointLights[i] reaches the object
+    unsigned int lightMask = 0;
+    // the object's first triangle in the lightmap baker's triangle buffer, -1 if not baked
+    int lightmapTriangle = -1;
+};
+
+struct PointLight {
+    glm::vec3 position;
+    glm::vec3 ambient;
+    glm::vec3 diffuse;
+    glm::vec3 specular;
+
+    float constant;
+    float linear;
+    float quadratic;
+
+    bool on = true;
+    // a global light reaches everything and is not range tested
+    bool global = false;
+    float range = 0.0f;
+};
+
+// distance at which the light's strongest term drops below a just-visible intensity
+inline float lightRange(const PointLight& light, float threshold = 5.0f / 256.0f) {
+    glm::vec3 strongest = glm::max(glm::max(light.ambient, light.diffuse), light.specular);
+    float intensity = std::max(strongest.x, std::max(strongest.y, strongest.z));
+    float c = light.constant - intensity / threshold;
+    if (light.quadratic <= 0.0f)
+        return light.linear > 0.0f ? -c / light.linear : FLT_MAX;
+    return (-light.linear + std::sqrt(light.linear * light.linear - 4.0f * light.quadratic * c)) / (2.0f * light.quadratic);
+}
+
+// textured quad
+struct Sprite {
+    unsigned int texture = 0;
+};
+
+// Entities, their components and the systems that run over them. Every system is a
+// linear pass over one component array; the BVH holds one proxy per mesh renderer with
+// the entity as user data.
+class Scene {
+public:
+    TransformHierarchy hierarchy;
+    ComponentArray<Transform> transforms;
+    ComponentArray<MeshRenderer> meshRenderers;
+    ComponentArray<PointLight> pointLights;
+    ComponentArray<Sprite> sprites;
+    DynamicBVH bvh;
+
+    Entity CreateEntity() {
+        unsigned int index;
+        if (!freeIndices.empty()) {
+            index = freeIndices.back();
+            freeIndices.pop_back();
+        } else {
+            index = (unsigned int) generations.size();
+            ASSERT(index < ENTITY_INDEX_MASK, "Too many entities");
+            generations.push_back(0);
+        }
+        return (generations[index] << ENTITY_INDEX_BITS) | index;
+    }
+
+    // children have to be destroyed before their parent
+    void DestroyEntity(Entity entity) {
+        if (!IsAlive(entity))
+            return;
+        if (meshRenderers.Has(entity) && meshRenderers.Get(entity).proxy != DynamicBVH::NULL_NODE)
+            bvh.Remove(meshRenderers.Get(entity).proxy);
+        if (meshRenderers.Has(entity)) {
+            staticChanged(meshRenderers.Get(entity));
+            if (meshRenderers.Get(entity).model != nullptr)
+                destroyedBounds.push_back(meshRenderers.Get(entity).worldBounds);
+        }
+        if (transforms.Has(entity)) {
+            int node = transforms.Get(entity).node;
+            hierarchy.Destroy(node);
+            nodeEntities[node] = NULL_ENTITY;
+        }
+        transforms.Remove(entity);
+        meshRenderers.Remove(entity);
+        pointLights.Remove(entity);
+        sprites.Remove(entity);
+        unsigned int index = entityIndex(entity);
+        generations[index] = (generations[index] + 1) & (0xffffffffu >> ENTITY_INDEX_BITS);
+        freeIndices.push_back(index);
+    }
+
+    bool IsAlive(Entity entity) const {
+        unsigned int index = entityIndex(entity);
+        return entity != NULL_ENTITY && index < generations.size() && (entity >> ENTITY_INDEX_BITS) == generations[index];
+    }
+
+    int EntityCount() const {
+        return (int) (generations.size() - freeIndices.size());
+    }
+
+    // the parent needs a transform already; rotation is a quaternion (w, x, y, z)
+    Transform& AddTransform(Entity entity, Entity parent = NULL_ENTITY, const glm::vec3& position = glm::vec3(0.0f),
+                            const glm::quat& rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f), const glm::vec3& scale = glm::vec3(1.0f)) {
+        int parentNode = parent == NULL_ENTITY ? TransformHierarchy::NO_PARENT : transforms.Get(parent).node;
+        Transform transform;
+        transform.node = hierarchy.Create(parentNode, position, rotation, scale);
+        if (transform.node >= (int) nodeEntities.size())
+            nodeEntities.resize(transform.node + 1, NULL_ENTITY);
+        nodeEntities[transform.node] = entity;
+        return transforms.Add(entity, transform);
+    }
+
+    // the entity needs a transform already; world bounds and the BVH proxy follow in UpdateTransforms
+    MeshRenderer& AddMeshRenderer(Entity entity, Model* model, const AABB& localBounds, MeshRenderer::Pass pass = MeshRenderer::LIT) {
+        MeshRenderer renderer;
+        renderer.model = model;
+        renderer.localBounds = localBounds;
+        renderer.pass = pass;
+        renderer.node = transforms.Get(entity).node;
+        hierarchy.Invalidate(renderer.node);
+        return meshRenderers.Add(entity, renderer);
+    }
+
+    const glm::mat4& GetWorldMatrix(Entity entity) const {
+        return hierarchy.GetWorldMatrix(transforms.Get(entity).node);
+    }
+
+    glm::vec3 GetWorldPosition(Entity entity) const {
+        return hierarchy.GetWorldPosition(transforms.Get(entity).node);
+    }
+
+    // recomputes dirty world matrices, then the bounds and proxies of the renderers that moved;
+    // parallelFor(count, task) has to call task(i) once for every i in [0, count)
+    template<typename ParallelFor>
+    void UpdateTransforms(ParallelFor parallelFor) {
+        hierarchy.Update();
+        const std::vector<int>& changed = hierarchy.GetChanged();
+        previousBounds.resize(changed.size());
+        // bounds are independent per renderer, only the BVH has to be updated serially
+        parallelFor((int) changed.size(), [&](int i) {
+            Entity entity = nodeEntities[changed[i]];
+            if (meshRenderers.Has(entity)) {
+                MeshRenderer& renderer = meshRenderers.Get(entity);
+                previousBounds[i] = renderer.worldBounds;
+                renderer.worldBounds = renderer.localBounds.Transformed(hierarchy.GetWorldMatrix(changed[i]));
+            }
+        });
+        movedBounds.swap(destroyedBounds);
+        destroyedBounds.clear();
+        for (int i = 0; i < (int) changed.size(); i++) {
+            Entity entity = nodeEntities[changed[i]];
+            if (!meshRenderers.Has(entity))
+                continue;
+            MeshRenderer& renderer = meshRenderers.Get(entity);
+            staticChanged(renderer);
+            if (renderer.model != nullptr) {
+                if (!previousBounds[i].IsEmpty())
+                    movedBounds.push_back(previousBounds[i]);
+                movedBounds.push_back(renderer.worldBounds);
+            }
+            if (renderer.proxy == DynamicBVH::NULL_NODE)
+                renderer.proxy = bvh.Insert(renderer.worldBounds, (int) entity);
+            else
+                bvh.Move(renderer.proxy, renderer.worldBounds);
+        }
+    }
+
+    // changes whenever a static renderer with a mesh is added, moved or destroyed
+    unsigned int GetStaticVersion() const {
+        return staticVersion;
+    }
+
+    // where renderers with a mesh were and are, for all that moved, appeared or were destroyed
+    // up to the last UpdateTransforms
+    const std::vector<AABB>& GetMovedBounds() const {
+        return movedBounds;
+    }
+
+    void UpdateTransforms() {
+        UpdateTransforms([](int count, const std::function<void(int)>& task) {
+            for (int i = 0; i < count; i++)
+                task(i);
+        });
+    }
+
+    // sets MeshRenderer::visible; walks the BVH if useBVH, otherwise tests every renderer with the SIMD culler
+    FrustumCuller::Stats CullFrustum(const Frustum& frustum, bool useBVH) {
+        int count = meshRenderers.Size();
+        if (!useBVH) {
+            frustumCuller.Clear();
+            for (int i = 0; i < count; i++)
+                frustumCuller.Add(meshRenderers[i].worldBounds);
+            frustumCuller.Cull(frustum);
+            for (int i = 0; i < count; i++)
+                meshRenderers[i].visible = frustumCuller.IsVisible(i);
+            return frustumCuller.GetStats();
+        }
+
+        FrustumCuller::Stats stats;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < count; i++)
+            meshRenderers[i].visible = false;
+        bvh.QueryFrustum(frustum, [&](int entity) {
+            meshRenderers.Get((Entity) entity).visible = true;
+            stats.visible++;
+        });
+        auto end = std::chrono::high_resolution_clock::now();
+        stats.total = count;
+        stats.milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+        return stats;
+    }
+
+    void ShowAll() {
+        for (int i = 0; i < meshRenderers.Size(); i++)
+            meshRenderers[i].visible = true;
+    }
+
+    // tests the visible renderers that have a mesh against occluders already rasterized into culler;
+    // the occluders themselves are skipped, they would hide behind their own front faces
+    void CullOcclusion(OcclusionCuller& culler, const std::vector<Entity>& occluders) {
+        for (int i = 0; i < meshRenderers.Size(); i++) {
+            MeshRenderer& renderer = meshRenderers[i];
+            if (!renderer.visible || renderer.model == nullptr)
+                continue;
+            if (std::find(occluders.begin(), occluders.end(), meshRenderers.GetEntity(i)) != occluders.end())
+                continue;
+            renderer.visible = culler.TestAABB(renderer.worldBounds);
+        }
+    }
+
+    // world positions and ranges of the lights, then the light mask of every renderer they reach
+    void GatherLights() {
+        ASSERT(pointLights.Size() <= 32, "Light masks hold at most 32 lights");
+        for (int i = 0; i < meshRenderers.Size(); i++)
+            meshRenderers[i].lightMask = 0;
+        unsigned int globalMask = 0;
+        for (int i = 0; i < pointLights.Size(); i++) {
+            PointLight& light = pointLights[i];
+            light.position = GetWorldPosition(pointLights.GetEntity(i));
+            light.range = lightRange(light);
+            if (light.global) {
+                globalMask |= 1u << i;
+                continue;
+            }
+            bvh.QuerySphere(BoundingSphere(light.position, light.range), [&](int entity) {
+                meshRenderers.Get((Entity) entity).lightMask |= 1u << i;
+            });
+        }
+        if (globalMask != 0) {
+            for (int i = 0; i < meshRenderers.Size(); i++)
+                meshRenderers[i].lightMask |= globalMask;
+        }
+    }
+
+private:
+    std::vector<unsigned int> generations;
+    std::vector<unsigned int> freeIndices;
+    std::vector<Entity> nodeEntities;
+    FrustumCuller frustumCuller;
+    unsigned int staticVersion = 0;
+    std::vector<AABB> previousBounds;
+    std::vector<AABB> movedBounds;
+    std::vector<AABB> destroyedBounds;
+
+    void staticChanged(const MeshRenderer& renderer) {
+        if (!renderer.dynamic && renderer.model != nullptr)
+            staticVersion++;
+    }
+};
+
+#endif //PROJECT_BASE_SCENE_H
@@ -0,0 +1,118 @@
+#ifndef PROJECT_BASE_SHADERPREPROCESSOR_H
+#define PROJECT_BASE_SHADERPREPROCESSOR_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <initializer_list>
+
+// A set of #defines that picks one variant of a shader. Kept sorted, so the same set gives
+// the same key whatever order it was built in.
+class ShaderDefines {
+public:
+    ShaderDefines() = default;
+
+    ShaderDefines(std::initializer_list<std::pair<const std::string, int>> values) {
+        for (const auto& value : values)
+            Set(value.first, value.second);
+    }
+
+    ShaderDefines& Set(const std::string& name, int value) {
+        return Set(name, std::to_string(value));
+    }
+
+    ShaderDefines& Set(const std::string& name, const std::string& value) {
+        values[name] = value;
+        return *this;
+    }
+
+    bool Empty() const {
+        return values.empty();
+    }
+
+    // NAME=value pairs separated by ';', empty for no defines
+    std::string Key() const {
+        std::string key;
+        for (const auto& value : values)
+            key += value.first + "=" + value.second + ";";
+        return key;
+    }
+
+    // one #define line per value
+    std::string Source() const {
+        std::string source;
+        for (const auto& value : values)
+            source += "#define " + value.first + " " + value.second + "\n";
+        return source;
+    }
+
+private:
+    std::map<std::string, std::string> values;
+};
+
+// Expands #include "file" in GLSL sources, relative to the including file, and inserts a
+// define set right after #version. Every file is included once per stage, however many
+// times it is asked for. #line directives keep the driver's messages pointing at the
+// original files: source string i is files[i], 0 being the stage's own file.
+class ShaderPreprocessor {
+public:
+    // false if a file could not be read; source then holds what was read before it
+    static bool Load(const std::string& path, const ShaderDefines& defines, std::string& source,
+                     std::vector<std::string>& files) {
+        source.clear();
+        files.assign(1, path);
+        return expand(path, 0, &defines, source, files);
+    }
+
+private:
+    static std::string directory(const std::string& path) {
+        size_t slash = path.find_last_of("/\\");
+        return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+    }
+
+    // defines is only given for the stage's own file, it goes after that file's #version
+    static bool expand(const std::string& path, int fileIndex, const ShaderDefines* defines, std::string& source,
+                       std::vector<std::string>& files) {
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
+            return false;
+        }
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(file, line)) {
+            lineNumber++;
+            size_t start = line.find_first_not_of(" \t");
+            std::string directive = start == std::string::npos ? std::string() : line.substr(start);
+            if (defines != nullptr && directive.compare(0, 8, "#version") == 0) {
+                source += line + "\n" + defines->Source();
+                source += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileIndex) + "\n";
+                continue;
+            }
+            if (directive.compare(0, 8, "#include") != 0) {
+                source += line + "\n";
+                continue;
+            }
+            size_t open = directive.find('"');
+            size_t close = directive.find('"', open + 1);
+            if (open == std::string::npos || close == std::string::npos) {
+                std::cout << "ERROR::SHADER::BAD_INCLUDE " << path << ":" << lineNumber << std::endl;
+                return false;
+            }
+            std::string included = directory(path) + directive.substr(open + 1, close - open - 1);
+            if (std::find(files.begin(), files.end(), included) == files.end()) {
+                files.push_back(included);
+                source += "#line 1 " + std::to_string(files.size() - 1) + "\n";
+                if (!expand(included, files.size() - 1, nullptr, source, files))
+                    return false;
+            }
+            source += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileIndex) + "\n";
+        }
+        return true;
+    }
+};
+
+#endif //PROJECT_BASE_SHADERPREPROCESSOR_H
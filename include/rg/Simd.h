@@ -0,0 +1,62 @@
+#ifndef PROJECT_BASE_SIMD_H
+#define PROJECT_BASE_SIMD_H
+
+#include <immintrin.h>
+
+// Thin wrappers over the widest float vector the build enables: 8 lanes of AVX when
+// compiled with RG_ENABLE_AVX2, 4 lanes of SSE otherwise. Kernels written against
+// these functions loop in steps of simd::WIDTH and work with either.
+namespace simd {
+
+#if defined(__AVX__)
+    const int WIDTH = 8;
+    typedef __m256 Float;
+
+    inline Float set1(float a) { return _mm256_set1_ps(a); }
+    inline Float zero() { return _mm256_setzero_ps(); }
+    inline Float laneOffsets() { return _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f); }
+    inline Float load(const float* p) { return _mm256_loadu_ps(p); }
+    inline void store(float* p, Float a) { _mm256_storeu_ps(p, a); }
+    inline Float add(Float a, Float b) { return _mm256_add_ps(a, b); }
+    inline Float sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+    inline Float mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+    inline Float div(Float a, Float b) { return _mm256_div_ps(a, b); }
+    inline Float min(Float a, Float b) { return _mm256_min_ps(a, b); }
+    inline Float max(Float a, Float b) { return _mm256_max_ps(a, b); }
+    inline Float cmpge(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+    inline Float cmpgt(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    inline Float cmplt(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    inline Float andMask(Float a, Float b) { return _mm256_and_ps(a, b); }
+    inline Float orMask(Float a, Float b) { return _mm256_or_ps(a, b); }
+    // lanes of a where mask is set, lanes of b elsewhere
+    inline Float select(Float mask, Float a, Float b) { return _mm256_blendv_ps(b, a, mask); }
+    inline int movemask(Float a) { return _mm256_movemask_ps(a); }
+#else
+    const int WIDTH = 4;
+    typedef __m128 Float;
+
+    inline Float set1(float a) { return _mm_set1_ps(a); }
+    inline Float zero() { return _mm_setzero_ps(); }
+    inline Float laneOffsets() { return _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f); }
+    inline Float load(const float* p) { return _mm_loadu_ps(p); }
+    inline void store(float* p, Float a) { _mm_storeu_ps(p, a); }
+    inline Float add(Float a, Float b) { return _mm_add_ps(a, b); }
+    inline Float sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+    inline Float mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+    inline Float div(Float a, Float b) { return _mm_div_ps(a, b); }
+    inline Float min(Float a, Float b) { return _mm_min_ps(a, b); }
+    inline Float max(Float a, Float b) { return _mm_max_ps(a, b); }
+    inline Float cmpge(Float a, Float b) { return _mm_cmpge_ps(a, b); }
+    inline Float cmpgt(Float a, Float b) { return _mm_cmpgt_ps(a, b); }
+    inline Float cmplt(Float a, Float b) { return _mm_cmplt_ps(a, b); }
+    inline Float andMask(Float a, Float b) { return _mm_and_ps(a, b); }
+    inline Float orMask(Float a, Float b) { return _mm_or_ps(a, b); }
+    // lanes of a where mask is set, lanes of b elsewhere
+    inline Float select(Float mask, Float a, Float b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+    inline int movemask(Float a) { return _mm_movemask_ps(a); }
+#endif
+
+    const int ALL_LANES = (1 << WIDTH) - 1;
+}
+
+#endif //PROJECT_BASE_SIMD_H
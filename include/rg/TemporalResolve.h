@@ -0,0 +1,151 @@
+#ifndef PROJECT_BASE_TEMPORALRESOLVE_H
+#define PROJECT_BASE_TEMPORALRESOLVE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <rg/Error.h>
+#include <rg/GLState.h>
+#include <rg/RenderTargetPool.h>
+
+// Temporal upsampling: the scene is rendered below display resolution with a projection
+// that moves by a different sub pixel offset every frame (a Halton 2, 3 sequence), and
+// the resolve accumulates those samples in a display sized history. Every frame the
+// history is reprojected with the camera motion (world positions reconstructed from
+// depth), clamped to the current frame's 3x3 neighborhood so stale colors can't ghost,
+// and blended with the new sample.
+//
+// The resolve program is temporalResolve.fs on fullscreen.vs; it reads the current color
+// from unit 0, its depth from unit 1 and the history from unit 2, and writes the new
+// history into whatever framebuffer is bound.
+class TemporalResolve {
+public:
+    static const int JITTER_PHASES = 8;
+
+    explicit TemporalResolve(RenderTargetPool& pool) : pool(pool) {
+        glGenVertexArrays(1, &emptyVAO);
+    }
+
+    ~TemporalResolve() {
+        release();
+        glDeleteVertexArrays(1, &emptyVAO);
+    }
+
+    TemporalResolve(const TemporalResolve&) = delete;
+    TemporalResolve& operator=(const TemporalResolve&) = delete;
+
+    void SetProgram(unsigned int program) {
+        this->program = program;
+        glState().UseProgram(program);
+        glUniform1i(glGetUniformLocation(program, "current"), 0);
+        glUniform1i(glGetUniformLocation(program, "depth"), 1);
+        glUniform1i(glGetUniformLocation(program, "history"), 2);
+        jitterLocation = glGetUniformLocation(program, "jitter");
+        inverseViewProjectionLocation = glGetUniformLocation(program, "inverseViewProjection");
+        previousViewProjectionLocation = glGetUniformLocation(program, "previousViewProjection");
+        historyValidLocation = glGetUniformLocation(program, "historyValid");
+        feedbackLocation = glGetUniformLocation(program, "feedback");
+    }
+
+    // how much of the history each frame keeps
+    void SetFeedback(float feedback) {
+        this->feedback = feedback;
+    }
+
+    // drops the history, for example after a camera cut or when the resolve was off
+    void Reset() {
+        historyValid = false;
+    }
+
+    // starts a frame rendered at render size and resolved at display size; viewProjection
+    // is the frame's matrix without jitter
+    void BeginFrame(int displayWidth, int displayHeight, int renderWidth, int renderHeight, const glm::mat4& viewProjection) {
+        if (displayWidth != width || displayHeight != height) {
+            release();
+            width = displayWidth;
+            height = displayHeight;
+            for (unsigned int& texture : history)
+                texture = pool.Acquire({ width, height, GL_RGBA16F, 1 });
+            historyValid = false;
+        }
+        this->renderWidth = renderWidth;
+        this->renderHeight = renderHeight;
+        frame++;
+        previousViewProjection = historyValid ? currentViewProjection : viewProjection;
+        currentViewProjection = viewProjection;
+        jitter = glm::vec2(halton(frame % JITTER_PHASES + 1, 2), halton(frame % JITTER_PHASES + 1, 3)) - 0.5f;
+    }
+
+    // moves the projection by this frame's jitter, a fraction of a render pixel
+    glm::mat4 Jitter(glm::mat4 projection) const {
+        projection[2][0] += jitter.x * 2.0f / renderWidth;
+        projection[2][1] += jitter.y * 2.0f / renderHeight;
+        return projection;
+    }
+
+    // texture the resolve writes this frame; it becomes next frame's history
+    unsigned int GetOutput() const {
+        return history[frame % 2];
+    }
+
+    unsigned int GetHistory() const {
+        return history[(frame + 1) % 2];
+    }
+
+    void Resolve(unsigned int current, unsigned int depth) {
+        ASSERT(program != 0, "Temporal resolve program is not set");
+        GLStateCache& state = glState();
+        state.UseProgram(program);
+        state.BindVertexArray(emptyVAO);
+        state.BindTexture(0, GL_TEXTURE_2D, current);
+        state.BindTexture(1, GL_TEXTURE_2D, depth);
+        state.BindTexture(2, GL_TEXTURE_2D, GetHistory());
+        glUniform2f(jitterLocation, jitter.x / renderWidth, jitter.y / renderHeight);
+        glUniformMatrix4fv(inverseViewProjectionLocation, 1, GL_FALSE, glm::value_ptr(glm::inverse(currentViewProjection)));
+        glUniformMatrix4fv(previousViewProjectionLocation, 1, GL_FALSE, glm::value_ptr(previousViewProjection));
+        glUniform1i(historyValidLocation, historyValid);
+        glUniform1f(feedbackLocation, feedback);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        historyValid = true;
+    }
+
+private:
+    RenderTargetPool& pool;
+    unsigned int history[2] = {};
+    int width = 0, height = 0;
+    int renderWidth = 1, renderHeight = 1;
+    unsigned long long frame = 0;
+    bool historyValid = false;
+    float feedback = 0.9f;
+    glm::vec2 jitter = glm::vec2(0.0f);
+    glm::mat4 currentViewProjection = glm::mat4(1.0f);
+    glm::mat4 previousViewProjection = glm::mat4(1.0f);
+    unsigned int emptyVAO = 0;
+    unsigned int program = 0;
+    int jitterLocation = -1;
+    int inverseViewProjectionLocation = -1;
+    int previousViewProjectionLocation = -1;
+    int historyValidLocation = -1;
+    int feedbackLocation = -1;
+
+    static float halton(int index, int base) {
+        float result = 0.0f, fraction = 1.0f;
+        while (index > 0) {
+            fraction /= base;
+            result += fraction * (index % base);
+            index /= base;
+        }
+        return result;
+    }
+
+    void release() {
+        for (unsigned int& texture : history) {
+            if (texture != 0)
+                pool.Release(texture);
+            texture = 0;
+        }
+    }
+};
+
+#endif //PROJECT_BASE_TEMPORALRESOLVE_H
@@ -0,0 +1,163 @@
+#ifndef PROJECT_BASE_TEXTUREARRAYPACKER_H
+#define PROJECT_BASE_TEXTUREARRAYPACKER_H
+
+#include <vector>
+#include <unordered_map>
+#include <glad/glad.h>
+
+#include <rg/Error.h>
+
+// where a packed texture ended up; array is an index into the packer's arrays
+struct TextureLayer {
+    int array = -1;
+    int layer = -1;
+};
+
+// Packs 2D textures of the same size and color space into layers of GL_TEXTURE_2D_ARRAY
+// textures, so draws that use different materials of one size bind the same array and
+// only differ by the layer index they pass along.
+//
+// Add only records the texture; Build reads every texture back once and copies it into
+// its layer. Textures are stored as RGBA8 (or sRGB8_ALPHA8 if the source was sRGB and the
+// texture holds color) with regenerated mipmaps. Once the layers are resolved,
+// DeleteSources frees the source textures, nothing samples them after packing.
+class TextureArrayPacker {
+public:
+    struct Stats {
+        unsigned int textures = 0;
+        unsigned int arrays = 0;
+        unsigned long long bytes = 0;
+        // size of the source textures DeleteSources freed
+        unsigned long long freedBytes = 0;
+    };
+
+    // data textures (normal and specular maps) pass linear, they are stored as RGBA8 even if
+    // the source was uploaded as sRGB, so the sampler doesn't convert them
+    TextureLayer Add(unsigned int texture, bool linear = false) {
+        ASSERT(!built, "Textures have to be added before Build");
+        auto found = layers.find(texture);
+        if (found != layers.end())
+            return found->second;
+
+        int width = 0, height = 0, internalFormat = 0;
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+        bool srgb = !linear && (internalFormat == GL_SRGB8 || internalFormat == GL_SRGB8_ALPHA8
+                    || internalFormat == GL_SRGB || internalFormat == GL_SRGB_ALPHA);
+
+        int maxLayers = 256;
+        glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+        int array = 0;
+        while (array < (int) arrays.size()) {
+            const Array& candidate = arrays[array];
+            if (candidate.width == width && candidate.height == height && candidate.srgb == srgb
+                && (int) candidate.textures.size() < maxLayers)
+                break;
+            array++;
+        }
+        if (array == (int) arrays.size()) {
+            Array created;
+            created.width = width;
+            created.height = height;
+            created.srgb = srgb;
+            arrays.push_back(created);
+        }
+
+        // single channel sources hold a byte per texel, the rest are stored as four
+        int texelBytes = internalFormat == GL_RED || internalFormat == GL_R8 ? 1 : 4;
+        arrays[array].sourceBytes += (unsigned long long) width * height * texelBytes * 4 / 3;
+
+        TextureLayer layer;
+        layer.array = array;
+        layer.layer = arrays[array].textures.size();
+        arrays[array].textures.push_back(texture);
+        layers[texture] = layer;
+        return layer;
+    }
+
+    // layer of a texture given to Add, or an invalid layer
+    TextureLayer Find(unsigned int texture) const {
+        ASSERT(!sourcesDeleted, "Source texture names may be reused after DeleteSources");
+        auto found = layers.find(texture);
+        return found == layers.end() ? TextureLayer() : found->second;
+    }
+
+    void Build() {
+        ASSERT(!built, "Build can only run once");
+        built = true;
+        std::vector<unsigned char> pixels;
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (Array& array : arrays) {
+            GLenum format = array.srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+            glGenTextures(1, &array.id);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, array.id);
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, format, array.width, array.height, array.textures.size(), 0,
+                         GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            pixels.resize((size_t) array.width * array.height * 4);
+            for (unsigned int layer = 0; layer < array.textures.size(); layer++) {
+                glBindTexture(GL_TEXTURE_2D, array.textures[layer]);
+                glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, array.width, array.height, 1,
+                                GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+            }
+            glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+            stats.textures += array.textures.size();
+            stats.bytes += (unsigned long long) array.width * array.height * 4 * array.textures.size() * 4 / 3;
+        }
+        stats.arrays = arrays.size();
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // deletes every texture given to Add; layers have to be looked up with Find before this
+    void DeleteSources() {
+        ASSERT(built, "Sources are only deleted after Build");
+        if (sourcesDeleted)
+            return;
+        sourcesDeleted = true;
+        for (const Array& array : arrays) {
+            glDeleteTextures(array.textures.size(), array.textures.data());
+            stats.freedBytes += array.sourceBytes;
+        }
+    }
+
+    unsigned int GetArray(int array) const {
+        return array < 0 ? 0 : arrays[array].id;
+    }
+
+    int ArrayCount() const {
+        return arrays.size();
+    }
+
+    const Stats& GetStats() const {
+        return stats;
+    }
+
+private:
+    struct Array {
+        int width = 0;
+        int height = 0;
+        bool srgb = false;
+        std::vector<unsigned int> textures;
+        unsigned long long sourceBytes = 0;
+        unsigned int id = 0;
+    };
+
+    std::vector<Array> arrays;
+    std::unordered_map<unsigned int, TextureLayer> layers;
+    bool built = false;
+    bool sourcesDeleted = false;
+    Stats stats;
+};
+
+#endif //PROJECT_BASE_TEXTUREARRAYPACKER_H
@@ -0,0 +1,181 @@
+#ifndef PROJECT_BASE_TRANSFORMHIERARCHY_H
+#define PROJECT_BASE_TRANSFORMHIERARCHY_H
+
+#include <vector>
+#include <immintrin.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <rg/Error.h>
+
+// Local translation/rotation/scale of every node, stored as parallel arrays, with world
+// matrices derived from them. Parents are created before their children, so the arrays
+// are always in topological order and a single forward pass sees every parent before its
+// children. Setters only mark a node dirty when the value really changes, and Update
+// starts at the first dirty node; if nothing moved, it returns immediately.
+//
+// Destroyed slots are reused by later roots, or by children whose parent comes before the
+// slot, so reuse never breaks the ordering.
+class TransformHierarchy {
+public:
+    static const int NO_PARENT = -1;
+
+    int Create(int parent = NO_PARENT, const glm::vec3& position = glm::vec3(0.0f),
+               const glm::quat& rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f), const glm::vec3& scale = glm::vec3(1.0f)) {
+        ASSERT(parent < (int) parents.size(), "Parent has to be created before its children");
+        int node;
+        if (!freeNodes.empty() && freeNodes.back() > parent) {
+            node = freeNodes.back();
+            freeNodes.pop_back();
+            parents[node] = parent;
+            positions[node] = position;
+            rotations[node] = rotation;
+            scales[node] = scale;
+        } else {
+            node = (int) parents.size();
+            parents.push_back(parent);
+            positions.push_back(position);
+            rotations.push_back(rotation);
+            scales.push_back(scale);
+            worldMatrices.push_back(glm::mat4(1.0f));
+            dirty.push_back(1);
+        }
+        markDirty(node);
+        return node;
+    }
+
+    // children have to be destroyed before their parent
+    void Destroy(int node) {
+        parents[node] = NO_PARENT;
+        dirty[node] = 0;
+        freeNodes.push_back(node);
+    }
+
+    // forces the node into the next Update, e.g. when something new depends on its matrix
+    void Invalidate(int node) {
+        markDirty(node);
+    }
+
+    void SetPosition(int node, const glm::vec3& position) {
+        if (positions[node] != position) {
+            positions[node] = position;
+            markDirty(node);
+        }
+    }
+
+    void SetRotation(int node, const glm::quat& rotation) {
+        const glm::quat& current = rotations[node];
+        if (current.x != rotation.x || current.y != rotation.y || current.z != rotation.z || current.w != rotation.w) {
+            rotations[node] = rotation;
+            markDirty(node);
+        }
+    }
+
+    void SetScale(int node, const glm::vec3& scale) {
+        if (scales[node] != scale) {
+            scales[node] = scale;
+            markDirty(node);
+        }
+    }
+
+    const glm::vec3& GetPosition(int node) const {
+        return positions[node];
+    }
+
+    const glm::mat4& GetWorldMatrix(int node) const {
+        return worldMatrices[node];
+    }
+
+    glm::vec3 GetWorldPosition(int node) const {
+        return glm::vec3(worldMatrices[node][3]);
+    }
+
+    int GetParent(int node) const {
+        return parents[node];
+    }
+
+    int Size() const {
+        return (int) parents.size();
+    }
+
+    // nodes whose world matrix changed in the last Update, in topological order
+    const std::vector<int>& GetChanged() const {
+        return changed;
+    }
+
+    // recomputes the world matrices of dirty nodes and of everything below them
+    void Update() {
+        changed.clear();
+        if (firstDirty == CLEAN)
+            return;
+        int count = (int) parents.size();
+        for (int node = firstDirty; node < count; node++) {
+            int parent = parents[node];
+            if (!dirty[node] && (parent == NO_PARENT || !dirty[parent]))
+                continue;
+            // a child of a dirty parent becomes dirty too, so its own children follow
+            dirty[node] = 1;
+            glm::mat4 local = composeLocal(node);
+            if (parent == NO_PARENT)
+                worldMatrices[node] = local;
+            else
+                multiply(worldMatrices[parent], local, worldMatrices[node]);
+            changed.push_back(node);
+        }
+        for (int node : changed)
+            dirty[node] = 0;
+        firstDirty = CLEAN;
+    }
+
+private:
+    static const int CLEAN = 0x7fffffff;
+
+    std::vector<int> parents;
+    std::vector<glm::vec3> positions;
+    std::vector<glm::quat> rotations;
+    std::vector<glm::vec3> scales;
+    std::vector<glm::mat4> worldMatrices;
+    std::vector<unsigned char> dirty;
+    std::vector<int> changed;
+    std::vector<int> freeNodes;
+    int firstDirty = CLEAN;
+
+    void markDirty(int node) {
+        dirty[node] = 1;
+        if (node < firstDirty)
+            firstDirty = node;
+    }
+
+    // translate * rotate * scale
+    glm::mat4 composeLocal(int node) const {
+        glm::mat3 rotation = glm::mat3_cast(rotations[node]);
+        const glm::vec3& scale = scales[node];
+        glm::mat4 local(1.0f);
+        local[0] = glm::vec4(rotation[0] * scale.x, 0.0f);
+        local[1] = glm::vec4(rotation[1] * scale.y, 0.0f);
+        local[2] = glm::vec4(rotation[2] * scale.z, 0.0f);
+        local[3] = glm::vec4(positions[node], 1.0f);
+        return local;
+    }
+
+    // out = a * b for column major matrices, one SSE register per column
+    static void multiply(const glm::mat4& a, const glm::mat4& b, glm::mat4& out) {
+        const float* pa = &a[0][0];
+        const float* pb = &b[0][0];
+        float* po = &out[0][0];
+        __m128 column0 = _mm_loadu_ps(pa);
+        __m128 column1 = _mm_loadu_ps(pa + 4);
+        __m128 column2 = _mm_loadu_ps(pa + 8);
+        __m128 column3 = _mm_loadu_ps(pa + 12);
+        for (int column = 0; column < 4; column++) {
+            const float* bColumn = pb + 4 * column;
+            __m128 result = _mm_mul_ps(column0, _mm_set1_ps(bColumn[0]));
+            result = _mm_add_ps(result, _mm_mul_ps(column1, _mm_set1_ps(bColumn[1])));
+            result = _mm_add_ps(result, _mm_mul_ps(column2, _mm_set1_ps(bColumn[2])));
+            result = _mm_add_ps(result, _mm_mul_ps(column3, _mm_set1_ps(bColumn[3])));
+            _mm_storeu_ps(po + 4 * column, result);
+        }
+    }
+};
+
+#endif //PROJECT_BASE_TRANSFORMHIERARCHY_H
@@ -0,0 +1,317 @@
+#ifndef PROJECT_BASE_TRIANGLEBVH_H
+#define PROJECT_BASE_TRIANGLEBVH_H
+
+#include <vector>
+#include <cfloat>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+#include <rg/Bounds.h>
+#include <rg/Error.h>
+#include <rg/Simd.h>
+
+// Static bounding volume hierarchy over triangles, for ray casts on the CPU. Built once
+// top down with a binned surface area heuristic; leaves hold at most simd::WIDTH triangles,
+// stored as one packet of structure of arrays (first vertex and both edges per axis), so a
+// ray is tested against a whole leaf with one Moller-Trumbore kernel. Unused lanes hold
+// degenerate triangles, which never hit.
+//
+// Every triangle carries a group (the object it came from); occlusion queries can ignore
+// one group, like a lamp's own housing around its light.
+class TriangleBVH {
+public:
+    static const int BINS = 12;
+    static const int MAX_STACK = 128;
+
+    struct Hit {
+        int triangle = -1;
+        float distance = FLT_MAX;
+    };
+
+    // positions are three per triangle
+    void Build(const std::vector<glm::vec3>& positions, const std::vector<int>& groups) {
+        ASSERT(positions.size() == groups.size() * 3, "One group per triangle");
+        int count = (int) groups.size();
+        nodes.clear();
+        packets.clear();
+        triangles.resize(count);
+        std::vector<AABB> bounds(count);
+        std::vector<glm::vec3> centroids(count);
+        for (int i = 0; i < count; i++) {
+            triangles[i] = i;
+            const glm::vec3* v = &positions[i * 3];
+            bounds[i] = AABB(glm::min(glm::min(v[0], v[1]), v[2]), glm::max(glm::max(v[0], v[1]), v[2]));
+            centroids[i] = (v[0] + v[1] + v[2]) / 3.0f;
+        }
+        if (count == 0)
+            return;
+        nodes.reserve(2 * count / simd::WIDTH + 1);
+        build(0, count, bounds, centroids, positions, groups);
+    }
+
+    int NodeCount() const {
+        return (int) nodes.size();
+    }
+
+    // closest triangle the ray hits within maxDistance; direction doesn't have to be normalized,
+    // distances are in units of its length
+    Hit Intersect(const glm::vec3& origin, const glm::vec3& direction, float maxDistance) const {
+        Hit hit;
+        hit.distance = maxDistance;
+        traverse(origin, direction, -1, false, hit);
+        return hit;
+    }
+
+    // true if anything but the ignored group lies between origin and origin + direction * maxDistance
+    bool Occluded(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, int ignoredGroup = -1) const {
+        Hit hit;
+        hit.distance = maxDistance;
+        return traverse(origin, direction, ignoredGroup, true, hit);
+    }
+
+private:
+    struct Node {
+        AABB box;
+        // leaves: the packet; inner nodes: the second child, the first follows the node
+        int index = 0;
+        // triangles of a leaf, 0 for inner nodes
+        int count = 0;
+        // split axis, the first child holds the lower centroids
+        int axis = 0;
+    };
+
+    struct Packet {
+        float v0[3][simd::WIDTH];
+        float edge1[3][simd::WIDTH];
+        float edge2[3][simd::WIDTH];
+        // as floats, so lanes compare without leaving the float registers
+        float group[simd::WIDTH];
+        int triangle[simd::WIDTH];
+    };
+
+    std::vector<Node> nodes;
+    std::vector<Packet> packets;
+    std::vector<int> triangles;
+
+    static float surfaceArea(const AABB& box) {
+        glm::vec3 d = box.max - box.min;
+        return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    static AABB combine(const AABB& a, const AABB& b) {
+        return AABB(glm::min(a.min, b.min), glm::max(a.max, b.max));
+    }
+
+    static AABB emptyBox() {
+        return AABB(glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX));
+    }
+
+    int build(int begin, int end, const std::vector<AABB>& bounds, const std::vector<glm::vec3>& centroids,
+              const std::vector<glm::vec3>& positions, const std::vector<int>& groups) {
+        int index = (int) nodes.size();
+        nodes.emplace_back();
+        AABB box = emptyBox();
+        AABB centroidBox = emptyBox();
+        for (int i = begin; i < end; i++) {
+            box = combine(box, bounds[triangles[i]]);
+            centroidBox = combine(centroidBox, AABB(centroids[triangles[i]], centroids[triangles[i]]));
+        }
+        nodes[index].box = box;
+
+        int count = end - begin;
+        int axis = 0;
+        int split = -1;
+        if (count > simd::WIDTH)
+            split = findSplit(begin, end, bounds, centroids, centroidBox, axis);
+        if (split < 0) {
+            // the heuristic found no split cheaper than a leaf; halve leaves that don't fit a packet
+            if (count <= simd::WIDTH) {
+                nodes[index].index = addPacket(begin, end, positions, groups);
+                nodes[index].count = count;
+                return index;
+            }
+            glm::vec3 extent = centroidBox.max - centroidBox.min;
+            axis = extent.x > extent.y && extent.x > extent.z ? 0 : (extent.y > extent.z ? 1 : 2);
+            std::nth_element(triangles.begin() + begin, triangles.begin() + begin + count / 2, triangles.begin() + end,
+                             [&](int a, int b) { return centroids[a][axis] < centroids[b][axis]; });
+            split = begin + count / 2;
+        }
+        nodes[index].axis = axis;
+        build(begin, split, bounds, centroids, positions, groups);
+        int second = build(split, end, bounds, centroids, positions, groups);
+        nodes[index].index = second;
+        return index;
+    }
+
+    // partitions the range at the cheapest of the bin boundaries on every axis; -1 if a leaf is cheaper
+    int findSplit(int begin, int end, const std::vector<AABB>& bounds, const std::vector<glm::vec3>& centroids,
+                  const AABB& centroidBox, int& bestAxis) {
+        float bestCost = (float) (end - begin);
+        int bestBin = -1;
+        for (int axis = 0; axis < 3; axis++) {
+            float low = centroidBox.min[axis];
+            float extent = centroidBox.max[axis] - low;
+            if (extent <= 0.0f)
+                continue;
+            AABB binBoxes[BINS];
+            int binCounts[BINS] = {};
+            std::fill(binBoxes, binBoxes + BINS, emptyBox());
+            for (int i = begin; i < end; i++) {
+                int bin = std::min(BINS - 1, (int) ((centroids[triangles[i]][axis] - low) / extent * BINS));
+                binBoxes[bin] = combine(binBoxes[bin], bounds[triangles[i]]);
+                binCounts[bin]++;
+            }
+            // areas and counts to the right of every boundary, then sweep from the left
+            float rightAreas[BINS];
+            int rightCounts[BINS];
+            AABB right = emptyBox();
+            int rightCount = 0;
+            for (int bin = BINS - 1; bin > 0; bin--) {
+                right = combine(right, binBoxes[bin]);
+                rightCount += binCounts[bin];
+                rightAreas[bin] = rightCount > 0 ? surfaceArea(right) : 0.0f;
+                rightCounts[bin] = rightCount;
+            }
+            float parentArea = std::max(surfaceArea(combine(right, binBoxes[0])), 1e-12f);
+            AABB left = emptyBox();
+            int leftCount = 0;
+            for (int bin = 0; bin < BINS - 1; bin++) {
+                left = combine(left, binBoxes[bin]);
+                leftCount += binCounts[bin];
+                if (leftCount == 0 || rightCounts[bin + 1] == 0)
+                    continue;
+                // traversal costs about one packet test, a leaf one per triangle
+                float cost = 1.0f + (surfaceArea(left) * leftCount + rightAreas[bin + 1] * rightCounts[bin + 1]) / parentArea;
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestBin = bin;
+                    bestAxis = axis;
+                }
+            }
+        }
+        if (bestBin < 0)
+            return -1;
+        float low = centroidBox.min[bestAxis];
+        float extent = centroidBox.max[bestAxis] - low;
+        auto middle = std::partition(triangles.begin() + begin, triangles.begin() + end, [&](int triangle) {
+            return std::min(BINS - 1, (int) ((centroids[triangle][bestAxis] - low) / extent * BINS)) <= bestBin;
+        });
+        return (int) (middle - triangles.begin());
+    }
+
+    int addPacket(int begin, int end, const std::vector<glm::vec3>& positions, const std::vector<int>& groups) {
+        Packet packet = {};
+        for (int lane = 0; lane < simd::WIDTH; lane++) {
+            packet.triangle[lane] = -1;
+            packet.group[lane] = -1.0f;
+            if (begin + lane >= end)
+                continue;
+            int triangle = triangles[begin + lane];
+            const glm::vec3* v = &positions[triangle * 3];
+            for (int axis = 0; axis < 3; axis++) {
+                packet.v0[axis][lane] = v[0][axis];
+                packet.edge1[axis][lane] = v[1][axis] - v[0][axis];
+                packet.edge2[axis][lane] = v[2][axis] - v[0][axis];
+            }
+            packet.group[lane] = (float) groups[triangle];
+            packet.triangle[lane] = triangle;
+        }
+        packets.push_back(packet);
+        return (int) packets.size() - 1;
+    }
+
+    static bool rayHitsBox(const glm::vec3& origin, const glm::vec3& inverseDirection, const AABB& box, float maxDistance) {
+        glm::vec3 t1 = (box.min - origin) * inverseDirection;
+        glm::vec3 t2 = (box.max - origin) * inverseDirection;
+        glm::vec3 tMin = glm::min(t1, t2);
+        glm::vec3 tMax = glm::max(t1, t2);
+        float entry = std::max(std::max(tMin.x, tMin.y), std::max(tMin.z, 0.0f));
+        float exit = std::min(std::min(tMax.x, tMax.y), std::min(tMax.z, maxDistance));
+        return entry <= exit;
+    }
+
+    // Moller-Trumbore against every lane of the packet; returns the lanes hit closer than
+    // maxDistance and their distances
+    static int intersectPacket(const Packet& packet, const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+                               int ignoredGroup, float* distances) {
+        const simd::Float epsilon = simd::set1(1e-8f);
+        const simd::Float zero = simd::zero();
+        const simd::Float one = simd::set1(1.0f);
+        simd::Float dx = simd::set1(direction.x), dy = simd::set1(direction.y), dz = simd::set1(direction.z);
+        simd::Float e1x = simd::load(packet.edge1[0]), e1y = simd::load(packet.edge1[1]), e1z = simd::load(packet.edge1[2]);
+        simd::Float e2x = simd::load(packet.edge2[0]), e2y = simd::load(packet.edge2[1]), e2z = simd::load(packet.edge2[2]);
+        // p = direction x edge2
+        simd::Float px = simd::sub(simd::mul(dy, e2z), simd::mul(dz, e2y));
+        simd::Float py = simd::sub(simd::mul(dz, e2x), simd::mul(dx, e2z));
+        simd::Float pz = simd::sub(simd::mul(dx, e2y), simd::mul(dy, e2x));
+        simd::Float determinant = simd::add(simd::add(simd::mul(e1x, px), simd::mul(e1y, py)), simd::mul(e1z, pz));
+        simd::Float valid = simd::orMask(simd::cmpgt(determinant, epsilon), simd::cmplt(determinant, simd::sub(zero, epsilon)));
+        simd::Float inverse = simd::div(one, simd::select(valid, determinant, one));
+        // t = origin - v0
+        simd::Float tx = simd::sub(simd::set1(origin.x), simd::load(packet.v0[0]));
+        simd::Float ty = simd::sub(simd::set1(origin.y), simd::load(packet.v0[1]));
+        simd::Float tz = simd::sub(simd::set1(origin.z), simd::load(packet.v0[2]));
+        simd::Float u = simd::mul(simd::add(simd::add(simd::mul(tx, px), simd::mul(ty, py)), simd::mul(tz, pz)), inverse);
+        // q = t x edge1
+        simd::Float qx = simd::sub(simd::mul(ty, e1z), simd::mul(tz, e1y));
+        simd::Float qy = simd::sub(simd::mul(tz, e1x), simd::mul(tx, e1z));
+        simd::Float qz = simd::sub(simd::mul(tx, e1y), simd::mul(ty, e1x));
+        simd::Float v = simd::mul(simd::add(simd::add(simd::mul(dx, qx), simd::mul(dy, qy)), simd::mul(dz, qz)), inverse);
+        simd::Float t = simd::mul(simd::add(simd::add(simd::mul(e2x, qx), simd::mul(e2y, qy)), simd::mul(e2z, qz)), inverse);
+        simd::Float hit = simd::andMask(valid, simd::andMask(simd::cmpge(u, zero), simd::cmpge(v, zero)));
+        hit = simd::andMask(hit, simd::cmpge(one, simd::add(u, v)));
+        hit = simd::andMask(hit, simd::andMask(simd::cmpgt(t, zero), simd::cmplt(t, simd::set1(maxDistance))));
+        if (ignoredGroup >= 0) {
+            simd::Float group = simd::load(packet.group);
+            simd::Float ignored = simd::set1((float) ignoredGroup);
+            hit = simd::andMask(hit, simd::orMask(simd::cmplt(group, ignored), simd::cmpgt(group, ignored)));
+        }
+        simd::store(distances, t);
+        return simd::movemask(hit);
+    }
+
+    // closest hit into hit, or any hit for occlusion; returns true if anything was hit
+    bool traverse(const glm::vec3& origin, const glm::vec3& direction, int ignoredGroup, bool anyHit, Hit& hit) const {
+        if (nodes.empty())
+            return false;
+        glm::vec3 inverseDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+        int stack[MAX_STACK];
+        int size = 0;
+        stack[size++] = 0;
+        float distances[simd::WIDTH];
+        bool found = false;
+        while (size > 0) {
+            int index = stack[--size];
+            const Node& node = nodes[index];
+            if (!rayHitsBox(origin, inverseDirection, node.box, hit.distance))
+                continue;
+            if (node.count > 0) {
+                const Packet& packet = packets[node.index];
+                int lanes = intersectPacket(packet, origin, direction, hit.distance, ignoredGroup, distances);
+                if (lanes == 0)
+                    continue;
+                if (anyHit)
+                    return true;
+                for (int lane = 0; lane < simd::WIDTH; lane++) {
+                    if ((lanes & (1 << lane)) && distances[lane] < hit.distance) {
+                        hit.distance = distances[lane];
+                        hit.triangle = packet.triangle[lane];
+                        found = true;
+                    }
+                }
+                continue;
+            }
+            ASSERT(size + 2 <= MAX_STACK, "Triangle BVH too deep");
+            // the near child is popped first, so it shortens the ray for the far one
+            int first = index + 1;
+            int second = node.index;
+            if (direction[node.axis] < 0.0f)
+                std::swap(first, second);
+            stack[size++] = second;
+            stack[size++] = first;
+        }
+        return found;
+    }
+};
+
+#endif //PROJECT_BASE_TRIANGLEBVH_H
@@ -0,0 +1,26 @@
+#version 330 core
+out vec2 FragColor;
+
+uniform sampler2D luminance;
+uniform sampler2D previousExposure;
+// the 1x1 level of the luminance chain
+uniform int luminanceLevel;
+uniform float key;
+uniform vec2 exposureRange;
+// blend factors towards a brighter and a darker scene this frame
+uniform vec2 adaptation;
+uniform bool reset;
+
+void main()
+{
+    float averageLuminance = exp2(texelFetch(luminance, ivec2(0), luminanceLevel).r);
+    float target = log2(clamp(key / averageLuminance, exposureRange.x, exposureRange.y));
+    if (reset) {
+        FragColor = vec2(exp2(target), averageLuminance);
+        return;
+    }
+    float previous = log2(max(texelFetch(previousExposure, ivec2(0), 0).r, 1e-5));
+    // a lower exposure means the scene got brighter
+    float rate = target < previous ? adaptation.x : adaptation.y;
+    FragColor = vec2(exp2(mix(previous, target, rate)), averageLuminance);
+}
@@ -0,0 +1,15 @@
+#version 330 core
+out float FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D image;
+
+void main()
+{
+    vec3 color = texture(image, TexCoords).rgb;
+    float luminance = dot(color, vec3(0.2126, 0.7152, 0.0722));
+    // log2 keeps the sun from outweighing the rest of the frame in the mip average;
+    // the clamp keeps black pixels finite
+    FragColor = clamp(log2(max(luminance, 1e-5)), -16.0, 16.0);
+}
@@ -0,0 +1,19 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D image;
+
+// 5 bilinear taps over a 4x4 texel block of the larger level: the center one sits
+// between 2x2 texels, the corner ones one texel away diagonally
+void main()
+{
+    vec2 texel = 1.0 / textureSize(image, 0);
+    vec3 result = texture(image, TexCoords).rgb * 4.0;
+    result += texture(image, TexCoords + vec2(-texel.x, -texel.y)).rgb;
+    result += texture(image, TexCoords + vec2( texel.x, -texel.y)).rgb;
+    result += texture(image, TexCoords + vec2(-texel.x,  texel.y)).rgb;
+    result += texture(image, TexCoords + vec2( texel.x,  texel.y)).rgb;
+    FragColor = vec4(result / 8.0, 1.0);
+}
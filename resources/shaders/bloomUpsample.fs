@@ -0,0 +1,21 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D image;
+
+// 8 bilinear taps in a tent around the pixel, sampling the smaller level
+void main()
+{
+    vec2 texel = 1.0 / textureSize(image, 0);
+    vec3 result = texture(image, TexCoords + vec2(-texel.x, 0.0)).rgb;
+    result += texture(image, TexCoords + vec2( texel.x, 0.0)).rgb;
+    result += texture(image, TexCoords + vec2(0.0, -texel.y)).rgb;
+    result += texture(image, TexCoords + vec2(0.0,  texel.y)).rgb;
+    result += texture(image, TexCoords + vec2(-texel.x, -texel.y) * 0.5).rgb * 2.0;
+    result += texture(image, TexCoords + vec2( texel.x, -texel.y) * 0.5).rgb * 2.0;
+    result += texture(image, TexCoords + vec2(-texel.x,  texel.y) * 0.5).rgb * 2.0;
+    result += texture(image, TexCoords + vec2( texel.x,  texel.y) * 0.5).rgb * 2.0;
+    FragColor = vec4(result / 12.0, 1.0);
+}
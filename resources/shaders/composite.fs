@@ -0,0 +1,48 @@
+#version 330 core
+// Variant defines:
+// BLOOM: adds the bloom pyramid's output
+// AUTO_EXPOSURE: takes the exposure adapted on the GPU instead of the uniform
+// LUMA_IN_ALPHA: writes perceptual luma to alpha for the anti-aliasing passes
+// LINEAR_OUTPUT: the LUT's output is linear and encoded to sRGB on write
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D scene;
+#if BLOOM
+uniform sampler2D bloomBlur;
+#endif
+#if AUTO_EXPOSURE
+uniform sampler2D exposureTexture;
+#else
+uniform float exposure;
+#endif
+// tonemapping and color grading, indexed by log2 of the exposed color (see ColorGradingLut.h)
+uniform sampler3D gradingLut;
+uniform vec2 lutTransform;
+
+void main()
+{
+    vec3 hdrColor = texture(scene, TexCoords).rgb;
+#if BLOOM
+    hdrColor += texture(bloomBlur, TexCoords).rgb; // additive blending
+#endif
+#if AUTO_EXPOSURE
+    float sceneExposure = texelFetch(exposureTexture, ivec2(0), 0).r;
+#else
+    float sceneExposure = exposure;
+#endif
+    // coordinates outside the LUT clamp to its edge texels
+    vec3 coord = log2(max(hdrColor * sceneExposure, vec3(1e-10))) * lutTransform.x + lutTransform.y;
+    vec3 color = texture(gradingLut, coord).rgb;
+#if LUMA_IN_ALPHA
+    float luma = dot(color, vec3(0.299, 0.587, 0.114));
+#if LINEAR_OUTPUT
+    // close enough to the sRGB curve for finding edges
+    luma = sqrt(luma);
+#endif
+    FragColor = vec4(color, luma);
+#else
+    FragColor = vec4(color, 1.0);
+#endif
+}
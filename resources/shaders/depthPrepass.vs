@@ -0,0 +1,14 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+#include "include/frameData.glsl"
+#include "include/drawData.glsl"
+
+// the same expression as mainLightning.vs and sun.vs, so the depth matches exactly
+invariant gl_Position;
+
+void main()
+{
+    vec3 position = vec3(model * vec4(aPos, 1.0));
+    gl_Position = projection * view * vec4(position, 1.0);
+}
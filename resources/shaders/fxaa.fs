@@ -0,0 +1,123 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+// tonemapped color with perceptual luma in alpha
+uniform sampler2D image;
+
+// local contrast below either threshold is left alone
+#define EDGE_THRESHOLD 0.125
+#define EDGE_THRESHOLD_MIN 0.0312
+#define SEARCH_STEPS 10
+#define SUBPIXEL_QUALITY 0.75
+
+// step lengths of the edge search, growing once the ends are far
+const float STEP[SEARCH_STEPS] = float[](1.0, 1.0, 1.0, 1.0, 1.5, 2.0, 2.0, 2.0, 4.0, 8.0);
+
+float lumaAt(vec2 uv)
+{
+    return textureLod(image, uv, 0.0).a;
+}
+
+void main()
+{
+    vec2 texel = 1.0 / vec2(textureSize(image, 0));
+    vec4 center = textureLod(image, TexCoords, 0.0);
+    float lumaCenter = center.a;
+    float lumaDown = textureLodOffset(image, TexCoords, 0.0, ivec2(0, -1)).a;
+    float lumaUp = textureLodOffset(image, TexCoords, 0.0, ivec2(0, 1)).a;
+    float lumaLeft = textureLodOffset(image, TexCoords, 0.0, ivec2(-1, 0)).a;
+    float lumaRight = textureLodOffset(image, TexCoords, 0.0, ivec2(1, 0)).a;
+
+    float lumaMin = min(lumaCenter, min(min(lumaDown, lumaUp), min(lumaLeft, lumaRight)));
+    float lumaMax = max(lumaCenter, max(max(lumaDown, lumaUp), max(lumaLeft, lumaRight)));
+    float range = lumaMax - lumaMin;
+    if (range < max(EDGE_THRESHOLD_MIN, lumaMax * EDGE_THRESHOLD)) {
+        FragColor = center;
+        return;
+    }
+
+    float lumaDownLeft = textureLodOffset(image, TexCoords, 0.0, ivec2(-1, -1)).a;
+    float lumaUpRight = textureLodOffset(image, TexCoords, 0.0, ivec2(1, 1)).a;
+    float lumaUpLeft = textureLodOffset(image, TexCoords, 0.0, ivec2(-1, 1)).a;
+    float lumaDownRight = textureLodOffset(image, TexCoords, 0.0, ivec2(1, -1)).a;
+    float lumaDownUp = lumaDown + lumaUp;
+    float lumaLeftRight = lumaLeft + lumaRight;
+    float lumaLeftCorners = lumaDownLeft + lumaUpLeft;
+    float lumaDownCorners = lumaDownLeft + lumaDownRight;
+    float lumaRightCorners = lumaDownRight + lumaUpRight;
+    float lumaUpCorners = lumaUpRight + lumaUpLeft;
+
+    // a horizontal edge changes luma along y
+    float edgeHorizontal = abs(-2.0 * lumaLeft + lumaLeftCorners) + abs(-2.0 * lumaCenter + lumaDownUp) * 2.0
+            + abs(-2.0 * lumaRight + lumaRightCorners);
+    float edgeVertical = abs(-2.0 * lumaUp + lumaUpCorners) + abs(-2.0 * lumaCenter + lumaLeftRight) * 2.0
+            + abs(-2.0 * lumaDown + lumaDownCorners);
+    bool horizontal = edgeHorizontal >= edgeVertical;
+
+    // which side of the pixel the edge is on
+    float luma1 = horizontal ? lumaDown : lumaLeft;
+    float luma2 = horizontal ? lumaUp : lumaRight;
+    float gradient1 = luma1 - lumaCenter;
+    float gradient2 = luma2 - lumaCenter;
+    bool steepest1 = abs(gradient1) >= abs(gradient2);
+    float gradientScaled = 0.25 * max(abs(gradient1), abs(gradient2));
+    float stepLength = horizontal ? texel.y : texel.x;
+    float lumaLocalAverage;
+    if (steepest1) {
+        stepLength = -stepLength;
+        lumaLocalAverage = 0.5 * (luma1 + lumaCenter);
+    } else {
+        lumaLocalAverage = 0.5 * (luma2 + lumaCenter);
+    }
+
+    // walk both ways along the edge, half a pixel towards it, until luma leaves the edge
+    vec2 edgeUV = TexCoords;
+    if (horizontal)
+        edgeUV.y += 0.5 * stepLength;
+    else
+        edgeUV.x += 0.5 * stepLength;
+    vec2 direction = horizontal ? vec2(texel.x, 0.0) : vec2(0.0, texel.y);
+    vec2 uv1 = edgeUV;
+    vec2 uv2 = edgeUV;
+    float lumaEnd1 = 0.0;
+    float lumaEnd2 = 0.0;
+    bool reached1 = false;
+    bool reached2 = false;
+    for (int i = 0; i < SEARCH_STEPS && !(reached1 && reached2); i++) {
+        if (!reached1) {
+            uv1 -= direction * STEP[i];
+            lumaEnd1 = lumaAt(uv1) - lumaLocalAverage;
+            reached1 = abs(lumaEnd1) >= gradientScaled;
+        }
+        if (!reached2) {
+            uv2 += direction * STEP[i];
+            lumaEnd2 = lumaAt(uv2) - lumaLocalAverage;
+            reached2 = abs(lumaEnd2) >= gradientScaled;
+        }
+    }
+
+    float distance1 = horizontal ? TexCoords.x - uv1.x : TexCoords.y - uv1.y;
+    float distance2 = horizontal ? uv2.x - TexCoords.x : uv2.y - TexCoords.y;
+    bool closer1 = distance1 < distance2;
+    float distanceFinal = min(distance1, distance2);
+    float pixelOffset = 0.5 - distanceFinal / (distance1 + distance2);
+    // only move towards the edge when the nearer end agrees with the center's side
+    bool centerSmaller = lumaCenter < lumaLocalAverage;
+    bool correctVariation = ((closer1 ? lumaEnd1 : lumaEnd2) < 0.0) != centerSmaller;
+    float finalOffset = correctVariation ? pixelOffset : 0.0;
+
+    // thin features and lone pixels have no walkable edge; blend them by local contrast
+    float lumaAverage = (2.0 * (lumaDownUp + lumaLeftRight) + lumaLeftCorners + lumaRightCorners) / 12.0;
+    float subpixel = clamp(abs(lumaAverage - lumaCenter) / range, 0.0, 1.0);
+    subpixel = (-2.0 * subpixel + 3.0) * subpixel * subpixel;
+    finalOffset = max(finalOffset, subpixel * subpixel * SUBPIXEL_QUALITY);
+
+    vec2 finalUV = TexCoords;
+    if (horizontal)
+        finalUV.y += finalOffset * stepLength;
+    else
+        finalUV.x += finalOffset * stepLength;
+    FragColor = textureLod(image, finalUV, 0.0);
+}
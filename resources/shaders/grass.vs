@@ -5,8 +5,8 @@ layout (location = 1) in vec2 aTex;
 
 out vec2 TexCoords;
 
-uniform mat4 projection;
-uniform mat4 view;
+#include "include/frameData.glsl"
+
 uniform mat4 model;
 
 void main() {
@@ -0,0 +1,13 @@
+// std140 mirror of DrawData in RenderQueue.h
+
+// bit i of lightMask is set if pointLights[i] is on and reaches this object,
+// a negative layer means the mesh has no texture of that type,
+// lightmapBase is the mesh's first triangle in the lightmap's triangle buffer or -1
+layout (std140) uniform DrawData {
+    mat4 model;
+    uint lightMask;
+    int diffuseLayer;
+    int specularLayer;
+    int normalLayer;
+    int lightmapBase;
+};
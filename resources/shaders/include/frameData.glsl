@@ -0,0 +1,30 @@
+// std140 mirror of FrameData in RenderQueue.h; MAX_ sizes have to match it
+
+struct PointLight {
+    vec4 position;
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+    // constant, linear, quadratic, shadow slot or -1
+    vec4 attenuation;
+};
+
+#define MAX_POINT_LIGHTS 8
+#define MAX_SHADOW_CASCADES 4
+#define MAX_SHADOWED_POINT_LIGHTS 4
+layout (std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    vec4 viewPosition;
+    PointLight pointLights[MAX_POINT_LIGHTS];
+    int pointLightCount;
+    // bit i is set if pointLights[i] is baked into the lightmap's layer i
+    uint bakedLightMask;
+    // world to shadow map space of the sun's cascades, none while its shadows are off
+    mat4 sunShadowMatrices[MAX_SHADOW_CASCADES];
+    int sunShadowCascades;
+    // world to shadow atlas space of the cube faces of the shadowed point lights, six per slot
+    mat4 pointShadowMatrices[MAX_SHADOWED_POINT_LIGHTS * 6];
+    // atlas rectangles of the faces (min xy, max xy)
+    vec4 pointShadowRects[MAX_SHADOWED_POINT_LIGHTS * 6];
+};
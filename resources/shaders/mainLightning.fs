@@ -1,37 +1,130 @@
 #version 330 core
-out vec4 FragColor;
+// Variant defines:
+// POINT_LIGHT_COUNT: fixes the light loop's length, without it the count comes from FrameData
+// SUN_SHADOWS, POINT_SHADOWS: sample the shadow maps, on by default
+// NORMAL_MAPPING: perturbs the normal with the material's normal map, off by default
+// BLOOM_MRT: also writes the bloom pass's bright target, on by default
+// LIGHTMAP: takes the lights in bakedLightMask from the lightmap on baked meshes, off by default
+#ifndef SUN_SHADOWS
+#define SUN_SHADOWS 1
+#endif
+#ifndef POINT_SHADOWS
+#define POINT_SHADOWS 1
+#endif
+#ifndef NORMAL_MAPPING
+#define NORMAL_MAPPING 0
+#endif
+#ifndef BLOOM_MRT
+#define BLOOM_MRT 1
+#endif
+#ifndef LIGHTMAP
+#define LIGHTMAP 0
+#endif
 
-struct PointLight {
-    vec3 position;
-
-    vec3 specular;
-    vec3 diffuse;
-    vec3 ambient;
-
-    float constant;
-    float linear;
-    float quadratic;
-};
+layout (location = 0) out vec4 FragColor;
+#if BLOOM_MRT
+layout (location = 1) out vec4 BrightColor;
+#endif
 
+// material textures are layers of texture arrays, picked by the layers in DrawData
 struct Material {
-    sampler2D texture_diffuse1;
-    sampler2D texture_specular1;
+    sampler2DArray diffuseArray;
+    sampler2DArray specularArray;
+#if NORMAL_MAPPING
+    sampler2DArray normalArray;
+#endif
 
     float shininess;
 };
 in vec2 TexCoords;
 in vec3 Normal;
 in vec3 FragPos;
+#if NORMAL_MAPPING
+in vec3 Tangent;
+in vec3 Bitangent;
+#endif
+
+#include "include/frameData.glsl"
+#include "include/drawData.glsl"
+
+#ifdef POINT_LIGHT_COUNT
+#define LIGHT_COUNT POINT_LIGHT_COUNT
+#else
+#define LIGHT_COUNT pointLightCount
+#endif
 
-#define NR_POINT_LIGHTS 3
-uniform PointLight pointLights[NR_POINT_LIGHTS];
 uniform Material material;
-uniform bool streetLampOn1, streetLampOn2;
+#if SUN_SHADOWS
+uniform sampler2DArrayShadow sunShadowMap;
+#endif
+#if POINT_SHADOWS
+uniform sampler2DShadow pointShadowAtlas;
+#endif
+#if LIGHTMAP
+// one layer per baked light
+uniform sampler2DArray lightmap;
+// two texels per baked triangle, the rows of its world to lightmap transform
+uniform samplerBuffer lightmapTriangles;
+
+vec2 CalcLightmapCoord(vec3 fragPos) {
+    int texel = (lightmapBase + gl_PrimitiveID) * 2;
+    vec4 u = texelFetch(lightmapTriangles, texel);
+    vec4 v = texelFetch(lightmapTriangles, texel + 1);
+    return vec2(dot(u.xyz, fragPos) + u.w, dot(v.xyz, fragPos) + v.w);
+}
+#endif
+
+#if SUN_SHADOWS
+// fraction of the sun's light that reaches fragPos, from the first cascade that covers it
+float CalcSunShadow(vec3 fragPos, vec3 normal) {
+    // a small offset along the normal keeps surfaces from shadowing themselves
+    vec3 position = fragPos + normal * 0.05;
+    vec2 texel = 1.0 / vec2(textureSize(sunShadowMap, 0).xy);
+    for (int i = 0; i < sunShadowCascades; i++) {
+        vec3 coord = (sunShadowMatrices[i] * vec4(position, 1.0)).xyz;
+        if (any(lessThan(coord, vec3(0.0))) || any(greaterThan(coord, vec3(1.0))))
+            continue;
+        // four bilinear comparisons, 4x4 texels
+        float lit = 0.0;
+        for (int y = -1; y <= 1; y += 2)
+            for (int x = -1; x <= 1; x += 2)
+                lit += texture(sunShadowMap, vec4(coord.xy + vec2(x, y) * texel, float(i), coord.z));
+        return lit * 0.25;
+    }
+    return 1.0;
+}
+#endif
+
+#if POINT_SHADOWS
+// fraction of a point light that reaches fragPos, from the cube face its direction falls on
+float CalcPointShadow(int slot, vec3 lightPosition, vec3 fragPos, vec3 normal) {
+    vec3 position = fragPos + normal * 0.02;
+    vec3 direction = position - lightPosition;
+    vec3 distance = abs(direction);
+    int face;
+    if (distance.x >= distance.y && distance.x >= distance.z)
+        face = direction.x > 0.0 ? 0 : 1;
+    else if (distance.y >= distance.z)
+        face = direction.y > 0.0 ? 2 : 3;
+    else
+        face = direction.z > 0.0 ? 4 : 5;
+    int index = slot * 6 + face;
+    vec4 coord = pointShadowMatrices[index] * vec4(position, 1.0);
+    coord.xyz /= coord.w;
+    vec4 rect = pointShadowRects[index];
+    vec2 texel = 1.0 / vec2(textureSize(pointShadowAtlas, 0));
+    // taps stay inside the face's tile
+    float lit = 0.0;
+    for (int y = -1; y <= 1; y += 2)
+        for (int x = -1; x <= 1; x += 2)
+            lit += texture(pointShadowAtlas, vec3(clamp(coord.xy + vec2(x, y) * 0.5 * texel, rect.xy, rect.zw), coord.z));
+    return lit * 0.25;
+}
+#endif
 
-uniform vec3 viewPosition;
 // calculates the color when using a point light.
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir) {
-    vec3 lightDir = normalize(light.position - fragPos);
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 albedo, float specularStrength, float shadow) {
+    vec3 lightDir = normalize(light.position.xyz - fragPos);
     // diffuse shading
     float diff = max(dot(normal, lightDir), 0.0);
     // specular shading
@@ -39,26 +132,74 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir) {
     float spec = pow(max(dot(normal, halfwayDir), 0.0), material.shininess);
 
     // attenuation
-    float distance = length(light.position - fragPos);
-    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+    float distance = length(light.position.xyz - fragPos);
+    float attenuation = 1.0 / (light.attenuation.x + light.attenuation.y * distance + light.attenuation.z * (distance * distance));
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords).xxx);
+    vec3 ambient = light.ambient.rgb * albedo;
+    vec3 diffuse = light.diffuse.rgb * diff * albedo;
+    vec3 specular = light.specular.rgb * spec * specularStrength;
     ambient *= attenuation;
-    diffuse *= attenuation;
-    specular *= attenuation;
+    diffuse *= attenuation * shadow;
+    specular *= attenuation * shadow;
     return (ambient + diffuse + specular);
 }
 
 void main()
 {
     vec3 normal = normalize(Normal);
-    vec3 viewDir = normalize(viewPosition - FragPos);
+#if NORMAL_MAPPING
+    // only meshes with a normal map get this variant, normalLayer is always valid
+    vec3 tangent = normalize(Tangent - dot(Tangent, normal) * normal);
+    // the mesh's bitangent only gives the handedness, mirrored UVs flip it
+    vec3 bitangent = cross(normal, tangent);
+    if (dot(bitangent, Bitangent) < 0.0)
+        bitangent = -bitangent;
+    mat3 TBN = mat3(tangent, bitangent, normal);
+    normal = normalize(TBN * (texture(material.normalArray, vec3(TexCoords, float(normalLayer))).rgb * 2.0 - 1.0));
+#endif
+    vec3 viewDir = normalize(viewPosition.xyz - FragPos);
+    vec3 albedo = vec3(0.0f);
+    if (diffuseLayer >= 0)
+        albedo = texture(material.diffuseArray, vec3(TexCoords, float(diffuseLayer))).rgb;
+    float specularStrength = 0.0f;
+    if (specularLayer >= 0)
+        specularStrength = texture(material.specularArray, vec3(TexCoords, float(specularLayer))).r;
+
     vec3 result = vec3(0.0f, 0.0f, 0.0f);
-    result += CalcPointLight(pointLights[0], normal, FragPos, viewDir);
-    if (streetLampOn1) result += CalcPointLight(pointLights[1], normal, FragPos, viewDir);
-    if (streetLampOn2) result += CalcPointLight(pointLights[2], normal, FragPos, viewDir);
+    // baked lights come from the lightmap, the loop only evaluates the rest
+    uint baked = 0u;
+#if LIGHTMAP
+    if (lightmapBase >= 0) {
+        baked = bakedLightMask;
+        vec2 coord = CalcLightmapCoord(FragPos);
+        for (int i = 0; i < LIGHT_COUNT; i++)
+            if ((lightMask & baked & (1u << uint(i))) != 0u)
+                result += albedo * texture(lightmap, vec3(coord, float(i))).rgb;
+    }
+#endif
+
+    // pointLights[0] is the sun
+    float sunShadow = 1.0;
+#if SUN_SHADOWS
+    if ((baked & 1u) == 0u)
+        sunShadow = CalcSunShadow(FragPos, normal);
+#endif
+    for (int i = 0; i < LIGHT_COUNT; i++) {
+        if ((lightMask & ~baked & (1u << uint(i))) == 0u)
+            continue;
+        float shadow = 1.0;
+        if (i == 0)
+            shadow = sunShadow;
+#if POINT_SHADOWS
+        else if (pointLights[i].attenuation.w >= 0.0)
+            shadow = CalcPointShadow(int(pointLights[i].attenuation.w), pointLights[i].position.xyz, FragPos, normal);
+#endif
+        result += CalcPointLight(pointLights[i], normal, FragPos, viewDir, albedo, specularStrength, shadow);
+    }
 
     FragColor = vec4(result, 1.0);
-}
\ No newline at end of file
+#if BLOOM_MRT
+    // only emissive surfaces bloom
+    BrightColor = vec4(0.0, 0.0, 0.0, 1.0);
+#endif
+}
@@ -3,17 +3,35 @@ layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
 
+// NORMAL_MAPPING: the variant for meshes with a normal map
+#ifndef NORMAL_MAPPING
+#define NORMAL_MAPPING 0
+#endif
+
+#if NORMAL_MAPPING
+layout (location = 3) in vec3 aTangent;
+layout (location = 4) in vec3 aBitangent;
+out vec3 Tangent;
+out vec3 Bitangent;
+#endif
+
 out vec2 TexCoords;
 out vec3 Normal;
 out vec3 FragPos;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#include "include/frameData.glsl"
+#include "include/drawData.glsl"
+
+// depthPrepass.vs computes the same position, the lighting pass tests it with GL_EQUAL
+invariant gl_Position;
 
 void main() {
     FragPos = vec3(model * vec4(aPos, 1.0));
     Normal = aNormal;
+#if NORMAL_MAPPING
+    Tangent = aTangent;
+    Bitangent = aBitangent;
+#endif
     TexCoords = aTexCoords;    
     gl_Position = projection * view * vec4(FragPos, 1.0);
-}
\ No newline at end of file
+}
@@ -0,0 +1,34 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D image;
+// coverage from smaaWeights.fs
+uniform sampler2D weights;
+
+void main()
+{
+    ivec2 size = textureSize(image, 0);
+    ivec2 pixel = clamp(ivec2(TexCoords * vec2(size)), ivec2(0), size - 1);
+    vec4 center = texelFetch(image, pixel, 0);
+    vec4 own = texelFetch(weights, pixel, 0);
+    // the pixel above stores how much of it the edge between them covers of this one, and
+    // the pixel to the right the same
+    float up = pixel.y + 1 < size.y ? texelFetch(weights, pixel + ivec2(0, 1), 0).g : 0.0;
+    float right = pixel.x + 1 < size.x ? texelFetch(weights, pixel + ivec2(1, 0), 0).a : 0.0;
+    // down, up, left, right
+    vec4 w = vec4(own.r, up, own.b, right);
+    float total = dot(w, vec4(1.0));
+    if (total < 1e-5) {
+        FragColor = center;
+        return;
+    }
+    w /= max(total, 1.0);
+    vec3 color = center.rgb * max(1.0 - total, 0.0)
+            + texelFetch(image, max(pixel + ivec2(0, -1), ivec2(0)), 0).rgb * w.x
+            + texelFetch(image, min(pixel + ivec2(0, 1), size - 1), 0).rgb * w.y
+            + texelFetch(image, max(pixel + ivec2(-1, 0), ivec2(0)), 0).rgb * w.z
+            + texelFetch(image, min(pixel + ivec2(1, 0), size - 1), 0).rgb * w.w;
+    FragColor = vec4(color, center.a);
+}
@@ -0,0 +1,40 @@
+#version 330 core
+out vec4 FragColor;
+
+// tonemapped color with perceptual luma in alpha
+uniform sampler2D image;
+
+// luma step that makes an edge
+#define THRESHOLD 0.1
+// an edge much weaker than the strongest one around it is dropped
+#define LOCAL_CONTRAST_FACTOR 2.0
+
+float lumaAt(ivec2 pixel, ivec2 size)
+{
+    return texelFetch(image, clamp(pixel, ivec2(0), size - 1), 0).a;
+}
+
+// r: edge on the pixel's left side, g: edge on its bottom side
+void main()
+{
+    ivec2 size = textureSize(image, 0);
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float luma = lumaAt(pixel, size);
+    float lumaLeft = lumaAt(pixel + ivec2(-1, 0), size);
+    float lumaDown = lumaAt(pixel + ivec2(0, -1), size);
+    vec2 delta = abs(luma - vec2(lumaLeft, lumaDown));
+    vec2 edges = step(THRESHOLD, delta);
+    if (edges.x + edges.y == 0.0) {
+        FragColor = vec4(0.0);
+        return;
+    }
+
+    float lumaRight = lumaAt(pixel + ivec2(1, 0), size);
+    float lumaUp = lumaAt(pixel + ivec2(0, 1), size);
+    float lumaLeftLeft = lumaAt(pixel + ivec2(-2, 0), size);
+    float lumaDownDown = lumaAt(pixel + ivec2(0, -2), size);
+    float maxDelta = max(max(delta.x, delta.y), max(abs(luma - lumaRight), abs(luma - lumaUp)));
+    maxDelta = max(maxDelta, max(abs(lumaLeft - lumaLeftLeft), abs(lumaDown - lumaDownDown)));
+    edges *= step(maxDelta, LOCAL_CONTRAST_FACTOR * delta);
+    FragColor = vec4(edges, 0.0, 0.0);
+}
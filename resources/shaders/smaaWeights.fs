@@ -0,0 +1,102 @@
+#version 330 core
+// Variant defines:
+// MAX_DISTANCE: how far an edge is followed each way, even, see PostAntialiasing.h
+#ifndef MAX_DISTANCE
+#define MAX_DISTANCE 16
+#endif
+out vec4 FragColor;
+
+// r: edge on a pixel's left side, g: edge on its bottom side; filtered linearly
+uniform sampler2D edges;
+// coverage by crossing edges and distances to the ends (see PostAntialiasing.h)
+uniform sampler2D areaTexture;
+// pixels an edge continues for from the fetch the search stopped at (see PostAntialiasing.h)
+uniform sampler2D searchTexture;
+
+ivec2 size;
+
+vec2 edgesAt(ivec2 pixel)
+{
+    if (any(lessThan(pixel, ivec2(0))) || any(greaterThanEqual(pixel, size)))
+        return vec2(0.0);
+    return texelFetch(edges, pixel, 0).rg;
+}
+
+// pixels the edge in channel continues for from pixel in direction, up to limit. across
+// points to the other side of the edge, where the crossing edges below or left of it are;
+// the search texture's r is for directions towards lower coordinates, g for higher ones
+int search(ivec2 pixel, ivec2 direction, ivec2 across, int channel, bool backward, int limit)
+{
+    int distance = 0;
+    for (int i = 0; i < MAX_DISTANCE / 2; i++) {
+        // 3/4 the next pixel and 1/4 the one after it, 7/8 the edge's row and 1/8 the one across
+        vec2 position = vec2(pixel + direction * (2 * i + 1)) + 0.5 + vec2(direction) * 0.25 + vec2(across) * 0.125;
+        vec2 fetched = texture(edges, position / vec2(size)).rg * 32.0;
+        // edge and crossing sums in 32nds
+        vec2 sums = channel == 1 ? fetched.yx : fetched.xy;
+        // both pixels carry the edge and no crossing edge touches them
+        if (sums.x > 27.5 && sums.y < 0.5) {
+            distance += 2;
+            continue;
+        }
+        vec2 continued = texelFetch(searchTexture, ivec2(sums + 0.5), 0).rg;
+        distance += int((backward ? continued.r : continued.g) * 2.0 + 0.5);
+        break;
+    }
+    return min(distance, limit);
+}
+
+// 1 for a crossing edge on the pixel's side of the edge, -1 for the other, 0 for none or both
+int crossing(float near, float far)
+{
+    return int(near > 0.5) - int(far > 0.5);
+}
+
+// x: how much of the near pixel the far side covers, y: the opposite
+vec2 area(int startCrossing, int endCrossing, int start, int end)
+{
+    // an edge followed as far as the search goes has no known end
+    if (start == MAX_DISTANCE)
+        startCrossing = 0;
+    if (end == MAX_DISTANCE)
+        endCrossing = 0;
+    ivec2 coord = ivec2((startCrossing + 1) * (MAX_DISTANCE + 1) + start, (endCrossing + 1) * (MAX_DISTANCE + 1) + end);
+    return texelFetch(areaTexture, coord, 0).rg;
+}
+
+// rg: the bottom edge's coverage of this pixel and of the one below, ba: the left edge's
+// coverage of this pixel and of the one to its left
+void main()
+{
+    size = textureSize(edges, 0);
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec2 e = edgesAt(pixel);
+    vec4 weights = vec4(0.0);
+
+    if (e.g > 0.5) {
+        // a crossing edge on the pixel's own left side ends the edge there
+        bool crossed = edgesAt(pixel).r > 0.5 || edgesAt(pixel + ivec2(0, -1)).r > 0.5;
+        int left = crossed ? 0 : search(pixel, ivec2(-1, 0), ivec2(0, -1), 1, true, pixel.x);
+        int right = search(pixel, ivec2(1, 0), ivec2(0, -1), 1, false, size.x - 1 - pixel.x);
+        // vertical edges at the left side of the first pixel and the right side of the last
+        int startX = pixel.x - left;
+        int endX = pixel.x + right + 1;
+        int startCrossing = crossing(edgesAt(ivec2(startX, pixel.y)).r, edgesAt(ivec2(startX, pixel.y - 1)).r);
+        int endCrossing = crossing(edgesAt(ivec2(endX, pixel.y)).r, edgesAt(ivec2(endX, pixel.y - 1)).r);
+        weights.rg = area(startCrossing, endCrossing, left, right);
+    }
+
+    if (e.r > 0.5) {
+        bool crossed = edgesAt(pixel).g > 0.5 || edgesAt(pixel + ivec2(-1, 0)).g > 0.5;
+        int down = crossed ? 0 : search(pixel, ivec2(0, -1), ivec2(-1, 0), 0, true, pixel.y);
+        int up = search(pixel, ivec2(0, 1), ivec2(-1, 0), 0, false, size.y - 1 - pixel.y);
+        // horizontal edges at the bottom side of the first pixel and the top side of the last
+        int startY = pixel.y - down;
+        int endY = pixel.y + up + 1;
+        int startCrossing = crossing(edgesAt(ivec2(pixel.x, startY)).g, edgesAt(ivec2(pixel.x - 1, startY)).g);
+        int endCrossing = crossing(edgesAt(ivec2(pixel.x, endY)).g, edgesAt(ivec2(pixel.x - 1, endY)).g);
+        weights.ba = area(startCrossing, endCrossing, down, up);
+    }
+
+    FragColor = weights;
+}
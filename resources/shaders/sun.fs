@@ -1,6 +1,13 @@
 #version 330 core
+// BLOOM_MRT: also writes the bloom pass's bright target, on by default
+#ifndef BLOOM_MRT
+#define BLOOM_MRT 1
+#endif
+
 layout (location = 0) out vec4 FragColor;
+#if BLOOM_MRT
 layout (location = 1) out vec4 BrightColor;
+#endif
 
 in vec2 texCoords;
 in vec3 Normal;
@@ -13,9 +20,11 @@ void main()
 {
     FragColor = vec4(lightColor, 1.0);
 
+#if BLOOM_MRT
     float brightness = dot(FragColor.rgb, vec3(0.2126, 0.7152, 0.0722));
     if(brightness > 1.0)
         BrightColor = vec4(FragColor.rgb, 1.0);
     else
         BrightColor = vec4(0.0, 0.0, 0.0, 1.0);
+#endif
 }
\ No newline at end of file
@@ -7,9 +7,11 @@ out vec2 texCoords;
 out vec3 Normal;
 out vec3 FragPos;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#include "include/frameData.glsl"
+#include "include/drawData.glsl"
+
+// depthPrepass.vs computes the same position, the lighting pass tests it with GL_EQUAL
+invariant gl_Position;
 
 void main()
 {
@@ -17,4 +19,4 @@ void main()
     Normal = aNormal;
     texCoords = aTexCoords;
     gl_Position = projection * view * vec4(FragPos, 1.0);
-}
\ No newline at end of file
+}
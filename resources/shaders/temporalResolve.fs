@@ -0,0 +1,61 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D current;
+uniform sampler2D depth;
+uniform sampler2D history;
+
+// this frame's projection offset in uv of the current color, as added to projection[2].xy
+uniform vec2 jitter;
+uniform mat4 inverseViewProjection;
+uniform mat4 previousViewProjection;
+uniform bool historyValid;
+uniform float feedback;
+
+float luminance(vec3 color)
+{
+    return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+void main()
+{
+    // the offset scales with -z_view = w, so the jittered frame shows the point at TexCoords
+    // moved by minus the jitter
+    vec2 currentUV = TexCoords - jitter;
+    vec3 color = texture(current, currentUV).rgb;
+
+    ivec2 size = textureSize(current, 0);
+    ivec2 center = ivec2(currentUV * vec2(size));
+    vec3 low = color;
+    vec3 high = color;
+    for (int y = -1; y <= 1; y++) {
+        for (int x = -1; x <= 1; x++) {
+            vec3 neighbor = texelFetch(current, clamp(center + ivec2(x, y), ivec2(0), size - 1), 0).rgb;
+            low = min(low, neighbor);
+            high = max(high, neighbor);
+        }
+    }
+
+    if (!historyValid) {
+        FragColor = vec4(color, 1.0);
+        return;
+    }
+
+    // where this pixel's surface was last frame
+    float sceneDepth = texture(depth, currentUV).r;
+    vec4 world = inverseViewProjection * vec4(vec3(TexCoords, sceneDepth) * 2.0 - 1.0, 1.0);
+    vec4 previous = previousViewProjection * vec4(world.xyz / world.w, 1.0);
+    vec2 previousUV = previous.xy / previous.w * 0.5 + 0.5;
+    if (any(lessThan(previousUV, vec2(0.0))) || any(greaterThan(previousUV, vec2(1.0)))) {
+        FragColor = vec4(color, 1.0);
+        return;
+    }
+
+    vec3 previousColor = clamp(texture(history, previousUV).rgb, low, high);
+    // weighting by inverse luminance keeps single bright samples from flickering
+    float currentWeight = (1.0 - feedback) / (1.0 + luminance(color));
+    float historyWeight = feedback / (1.0 + luminance(previousColor));
+    FragColor = vec4((color * currentWeight + previousColor * historyWeight) / (currentWeight + historyWeight), 1.0);
+}
@@ -13,6 +13,23 @@
 #include <learnopengl/shader.h>
 #include <learnopengl/camera.h>
 #include <learnopengl/model.h>
+#include <rg/Scene.h>
+#include <rg/JobSystem.h>
+#include <rg/RenderQueue.h>
+#include <rg/BloomChain.h>
+#include <rg/RenderGraph.h>
+#include <rg/RenderTargetPool.h>
+#include <rg/RenderTargetFormats.h>
+#include <rg/ColorGradingLut.h>
+#include <rg/FrameGovernor.h>
+#include <rg/TemporalResolve.h>
+#include <rg/AutoExposure.h>
+#include <rg/CascadedShadowMap.h>
+#include <rg/PointShadowAtlas.h>
+#include <rg/FragmentCounter.h>
+#include <rg/PostAntialiasing.h>
+#include <rg/GpuTimer.h>
+#include <rg/LightmapBaker.h>
 #include <iostream>
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
@@ -21,7 +38,8 @@ void scroll_callback(GLFWwindow *window, double xoffset, double yoffset);
 void processInput(GLFWwindow *window);
 void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods);
 unsigned int loadTexture(char const* path);
-unsigned int loadCubemap(vector<std::string> faces);
+unsigned int loadCubemap(vector<std::string> faces, JobSystem& jobs);
+std::vector<AABB> generateStressBoxes(int count);
 
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
@@ -36,21 +54,6 @@ float lastFrame = 0.0f;
 bool bloom = true;
 bool bloomKeyPressed = false;
 float exposure = 0.5f;
-void renderQuad();
-
-bool streetLampOn1 = true;
-bool streetLampOn2 = true;
-
-struct PointLight {
-    glm::vec3 position;
-    glm::vec3 ambient;
-    glm::vec3 diffuse;
-    glm::vec3 specular;
-
-    float constant;
-    float linear;
-    float quadratic;
-};
 
 struct ProgramState {
     glm::vec3 clearColor = glm::vec3(0);
@@ -59,7 +62,54 @@ struct ProgramState {
     bool CameraMouseMovementUpdateEnabled = true;
     glm::vec3 modelPosition = glm::vec3(0.0f);
     float modelScale = 0.05f;
-    PointLight pointLight;
+    bool FrustumCullingEnabled = true;
+    bool BVHCullingEnabled = true;
+    int CullingStressObjects = 0;
+    FrustumCuller::Stats cullingStats;
+    int bvhNodes = 0;
+    int bvhHeight = 0;
+    int entityCount = 0;
+    int workerThreads = 0;
+    RenderQueue::Stats renderQueueStats;
+    bool DepthPrepassEnabled = true;
+    FragmentCounter::Stats fragmentStats;
+    RenderGraph::Stats renderGraphStats;
+    RenderTargetPool::Stats renderTargetStats;
+    bool packedHdrSupported = false;
+    bool srgbBackbuffer = false;
+    ColorGradingLut::Settings grading;
+    int antialiasing = PostAntialiasing::SMAA;
+    std::vector<GpuTimer::Scope> gpuScopes;
+    unsigned long long shadowMapBytes = 0;
+    unsigned long long shadowMapBytesAt24Bit = 0;
+    RingBuffer::Stats ringBufferStats;
+    GLStateCache::Stats glStateStats;
+    TextureArrayPacker::Stats textureArrayStats;
+    int bloomLevels = 5;
+    bool GovernorEnabled = true;
+    float governorTargetMilliseconds = 16.6f;
+    float renderScale = 1.0f;
+    FrameGovernor::Stats governorStats;
+    bool ComputePostEnabled = true;
+    bool computePostSupported = false;
+    bool TemporalUpsamplingEnabled = true;
+    float temporalRenderScale = 0.7f;
+    bool SunShadowsEnabled = true;
+    CascadedShadowMap::Stats shadowStats;
+    bool LampShadowsEnabled = true;
+    int lampShadowBudget = 6;
+    PointShadowAtlas::Stats lampShadowStats;
+    bool AutoExposureEnabled = true;
+    float exposureKey = 0.18f;
+    AutoExposure::Stats exposureStats;
+    std::string pickedObject;
+    float pickedDistance = 0.0f;
+    bool OcclusionCullingEnabled = true;
+    OcclusionCuller::Stats occlusionStats;
+    bool LightmapsEnabled = true;
+    bool lightmapRebake = false;
+    bool lightmapCurrent = false;
+    LightmapBaker::Stats lightmapStats;
     ProgramState()
             : camera(glm::vec3(160.0f, 25.0f, -38.0f)) {}
 };
@@ -70,11 +120,19 @@ void DrawImGui(ProgramState *programState);
 
 int main() {
     glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    // 4.3 for compute post processing, everything else runs on 3.3
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    // lets the composite write linear color and the hardware encode it
+    glfwWindowHint(GLFW_SRGB_CAPABLE, GLFW_TRUE);
 
     GLFWwindow *window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
+    if (window == NULL) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
+    }
     if (window == NULL) {
         std::cout << "Failed to create GLFW window" << std::endl;
         glfwTerminate();
@@ -94,6 +152,17 @@ int main() {
 
     programState = new ProgramState;
 
+    JobSystem jobs;
+    programState->workerThreads = jobs.WorkerCount();
+    // splits task(0..count-1) into a few ranges per thread and helps run them until all are done
+    auto parallelFor = [&jobs](int count, const std::function<void(int)>& task) {
+        int grainSize = count / (4 * (jobs.WorkerCount() + 1)) + 1;
+        jobs.Wait(jobs.ParallelFor(count, grainSize, [&task](int begin, int end) {
+            for (int i = begin; i < end; i++)
+                task(i);
+        }));
+    };
+
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
     ImGuiIO &io = ImGui::GetIO();
@@ -152,8 +221,18 @@ int main() {
     Shader platformShader("resources/shaders/grass.vs", "resources/shaders/grass.fs");
     Shader skyboxShader("resources/shaders/skybox.vs", "resources/shaders/skybox.fs");
     Shader sunShader("resources/shaders/sun.vs", "resources/shaders/sun.fs");
-    Shader blurShader("resources/shaders/blur.vs", "resources/shaders/blur.fs");
-    Shader bloomShader("resources/shaders/bloom.vs", "resources/shaders/bloom.fs");
+    Shader depthPrepassShader("resources/shaders/depthPrepass.vs", "resources/shaders/shadowDepth.fs");
+    Shader shadowDepthShader("resources/shaders/shadowDepth.vs", "resources/shaders/shadowDepth.fs");
+    Shader bloomDownsampleShader("resources/shaders/fullscreen.vs", "resources/shaders/bloomDownsample.fs");
+    Shader bloomUpsampleShader("resources/shaders/fullscreen.vs", "resources/shaders/bloomUpsample.fs");
+    Shader compositeShader("resources/shaders/fullscreen.vs", "resources/shaders/composite.fs");
+    Shader autoExposureLuminanceShader("resources/shaders/fullscreen.vs", "resources/shaders/autoExposureLuminance.fs");
+    Shader autoExposureAdaptShader("resources/shaders/fullscreen.vs", "resources/shaders/autoExposureAdapt.fs");
+    Shader temporalResolveShader("resources/shaders/fullscreen.vs", "resources/shaders/temporalResolve.fs");
+    Shader fxaaShader("resources/shaders/fullscreen.vs", "resources/shaders/fxaa.fs");
+    Shader smaaEdgesShader("resources/shaders/fullscreen.vs", "resources/shaders/smaaEdges.fs");
+    Shader smaaWeightsShader("resources/shaders/fullscreen.vs", "resources/shaders/smaaWeights.fs");
+    Shader smaaBlendShader("resources/shaders/fullscreen.vs", "resources/shaders/smaaBlend.fs");
 
     Model buildingModel("resources/objects/building2/Building.obj");
     buildingModel.SetShaderTextureNamePrefix("material.");
@@ -169,13 +248,14 @@ int main() {
     glm::vec3 streetLampPosition2 = glm::vec3(20.0, 0.0, 50.0);
     glm::vec3 streetLampLightOffset = glm::vec3(10.0, 20.0, 0.0);
 
-    PointLight& sunPointLight = programState->pointLight;
+    PointLight sunPointLight;
     sunPointLight.ambient = glm::vec3(70.0);
     sunPointLight.diffuse = glm::vec3(5.0f);
     sunPointLight.specular = glm::vec3(1.0f);
     sunPointLight.constant = 1.0f;
     sunPointLight.linear = 0.09f;
     sunPointLight.quadratic = 0.032f;
+    sunPointLight.global = true;
 
     PointLight streetLampPointLight;
     streetLampPointLight.ambient = glm::vec3(5.0f);
@@ -223,50 +303,64 @@ int main() {
         "resources/cubemaps/cloudy2/pz.png",
         "resources/cubemaps/cloudy2/nz.png"
     };
-    unsigned int cubemapTexture = loadCubemap(faces);
-
-    unsigned int hdrFBO;
-    glGenFramebuffers(1, &hdrFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
-    unsigned int colorBuffers[2];
-    glGenTextures(2, colorBuffers);
-    for (unsigned int i = 0; i < 2; i++) {
-        glBindTexture(GL_TEXTURE_2D, colorBuffers[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, colorBuffers[i], 0);
+    unsigned int cubemapTexture = loadCubemap(faces, jobs);
+
+    // trades render resolution first, then bloom radius, for frame time. The pool matches
+    // target sizes exactly, so the render scale moves in coarse steps whose targets can be
+    // reused instead of allocating a new set of scene and bloom targets at every step
+    const float renderScaleStep = 0.125f;
+    FrameGovernor* governor = new FrameGovernor();
+    int renderScaleKnob = governor->AddKnob("Render scale", 0.5f, 1.0f, renderScaleStep);
+    int bloomLevelsKnob = governor->AddKnob("Bloom levels", 2.0f, programState->bloomLevels, 1.0f);
+
+    // every off screen target comes from one pool sized after the window
+    RenderTargetPool* targetPool = new RenderTargetPool();
+    targetPool->SetDisplaySize(SCR_WIDTH, SCR_HEIGHT);
+    RenderGraph* renderGraph = new RenderGraph(*targetPool, (GLADloadproc) glfwGetProcAddress);
+
+    // HDR targets without alpha in 4 bytes a pixel where the context can render to them
+    RenderTargetFormats formats;
+    const GLenum hdrFormat = formats.GetHdrColor();
+    programState->packedHdrSupported = formats.IsPackedHdrSupported();
+    // the LUT encodes to sRGB itself where the backbuffer can't
+    const bool srgbBackbuffer = formats.IsBackbufferSrgb();
+    programState->srgbBackbuffer = srgbBackbuffer;
+    ColorGradingLut* gradingLut = new ColorGradingLut(!srgbBackbuffer);
+    const GLenum ldrFormat = srgbBackbuffer ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+
+    // half resolution pyramid of the bright buffer
+    BloomChain* bloomChain = new BloomChain(*targetPool, SCR_WIDTH, SCR_HEIGHT, programState->bloomLevels, hdrFormat);
+    bloomChain->SetPrograms(bloomDownsampleShader.ID, bloomUpsampleShader.ID);
+    ComputePost computePost((GLADloadproc) glfwGetProcAddress);
+    if (computePost.IsSupported()) {
+        ShaderDefines imageFormat;
+        imageFormat.Set("IMAGE_FORMAT", RenderTargetFormats::ImageFormat(hdrFormat));
+        unsigned int downsampleKernel = computePost.CreateProgram("resources/shaders/bloomDownsample.comp", imageFormat);
+        unsigned int upsampleKernel = computePost.CreateProgram("resources/shaders/bloomUpsample.comp", imageFormat);
+        bloomChain->SetComputePrograms(&computePost, downsampleKernel, upsampleKernel);
+        programState->computePostSupported = downsampleKernel != 0 && upsampleKernel != 0;
     }
-
-    unsigned int rboDepth;
-    glGenRenderbuffers(1, &rboDepth);
-    glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, SCR_WIDTH, SCR_HEIGHT);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
-    unsigned int attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
-    glDrawBuffers(2, attachments);
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        std::cout << "Framebuffer not complete!" << std::endl;
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    unsigned int pingpongFBO[2];
-    unsigned int pingpongColorbuffers[2];
-    glGenFramebuffers(2, pingpongFBO);
-    glGenTextures(2, pingpongColorbuffers);
-    for (unsigned int i = 0; i < 2; i++) {
-        glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[i]);
-        glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pingpongColorbuffers[i], 0);
-        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-            std::cout << "Framebuffer not complete!" << std::endl;
+    AutoExposure* autoExposure = new AutoExposure();
+    autoExposure->SetPrograms(autoExposureLuminanceShader.ID, autoExposureAdaptShader.ID);
+    if (computePost.IsSupported()) {
+        ShaderDefines luminanceSize({ { "LUMINANCE_SIZE", AutoExposure::LUMINANCE_SIZE } });
+        unsigned int reduceKernel = computePost.CreateProgram("resources/shaders/autoExposureLuminance.comp", luminanceSize);
+        autoExposure->SetComputeProgram(&computePost, reduceKernel);
     }
+    bool autoExposureEnabled = false;
+
+    // accumulates jittered frames rendered below display resolution
+    TemporalResolve* temporalResolve = new TemporalResolve(*targetPool);
+    temporalResolve->SetProgram(temporalResolveShader.ID);
+    bool temporalUpsampling = false;
+
+    // FXAA or SMAA on the tonemapped image, each pass timed on the GPU
+    PostAntialiasing* antialiasing = new PostAntialiasing();
+    antialiasing->SetPrograms(fxaaShader.ID, smaaEdgesShader.ID,
+                              smaaWeightsShader.variant({ { "MAX_DISTANCE", PostAntialiasing::MAX_DISTANCE } }), smaaBlendShader.ID);
+    GpuTimer* gpuTimer = new GpuTimer();
+    int fxaaScope = gpuTimer->AddScope("FXAA");
+    int smaaScope = gpuTimer->AddScope("SMAA");
 
     unsigned int skyboxVAO, skyboxVBO;
     glGenVertexArrays(1, &skyboxVAO);
@@ -277,176 +371,551 @@ int main() {
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
 
-    blurShader.use();
-    blurShader.setInt("image", 0);
-    bloomShader.use();
-    bloomShader.setInt("scene", 0);
-    bloomShader.setInt("bloomBlur", 1);
+    bloomDownsampleShader.use();
+    bloomDownsampleShader.setInt("image", 0);
+    bloomUpsampleShader.use();
+    bloomUpsampleShader.setInt("image", 0);
+    compositeShader.setSampler("scene", 0);
+    compositeShader.setSampler("bloomBlur", 1);
+    compositeShader.setSampler("exposureTexture", 2);
+    compositeShader.setSampler("gradingLut", 3);
+    // the LUT transform is constant
+    compositeShader.setupVariants([](unsigned int program) {
+        glm::vec2 lutTransform = ColorGradingLut::GetTransform();
+        glUniform2f(glGetUniformLocation(program, "lutTransform"), lutTransform.x, lutTransform.y);
+    });
+    // composite variants by their four defines' bits, with the manual exposure's location
+    // looked up when the variant is first used
+    struct CompositeVariant {
+        unsigned int program = 0;
+        int exposureLocation = -1;
+    };
+    CompositeVariant compositeVariants[16];
+    // units 0 to 2 hold the material arrays; variants drop the samplers they don't use
+    pointLightShader.setSampler("sunShadowMap", 3);
+    pointLightShader.setSampler("pointShadowAtlas", 4);
+    pointLightShader.setSampler("lightmap", 5);
+    pointLightShader.setSampler("lightmapTriangles", 6);
+    pointLightShader.setupVariants([](unsigned int program) {
+        glUniform1f(glGetUniformLocation(program, "material.shininess"), 32.0f);
+    });
+    sunShader.setupVariants([](unsigned int program) {
+        glUniform3f(glGetUniformLocation(program, "lightColor"), 10.0f, 10.0f, 10.0f);
+    });
+    // the composite's fullscreen triangle needs no vertex buffer
+    unsigned int fullscreenVAO;
+    glGenVertexArrays(1, &fullscreenVAO);
 
     srand(glfwGetTime());
     const int streetLampOnPercent = 1;
 
+    // the building and the lamps stand on the platform, the lamp lights hang off the lamps
+    Scene scene;
+    Entity platform = scene.CreateEntity();
+    scene.AddTransform(platform);
+    scene.AddMeshRenderer(platform, &platformModel, platformModel.bounds);
+
+    Entity building = scene.CreateEntity();
+    scene.AddTransform(building, platform, programState->modelPosition, glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(programState->modelScale));
+    scene.AddMeshRenderer(building, &buildingModel, buildingModel.bounds);
+
+    glm::vec3 streetLampPositions[2] = { streetLampPosition1, streetLampPosition2 };
+    Entity streetLamps[2];
+    for (int i = 0; i < 2; i++) {
+        streetLamps[i] = scene.CreateEntity();
+        scene.AddTransform(streetLamps[i], platform, streetLampPositions[i], glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(10.0f));
+        scene.AddMeshRenderer(streetLamps[i], &streetLampModel, streetLampModel.bounds);
+    }
+
+    // the sun's light comes first, the main shader always applies pointLights[0]
+    Entity sun = scene.CreateEntity();
+    scene.AddTransform(sun, NULL_ENTITY, sunPosition, glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(4.0f));
+    scene.AddMeshRenderer(sun, &sunModel, sunModel.bounds, MeshRenderer::EMISSIVE);
+    scene.pointLights.Add(sun, sunPointLight);
+
+    Entity streetLampLights[2];
+    for (int i = 0; i < 2; i++) {
+        streetLampLights[i] = scene.CreateEntity();
+        // the offset is given in world units, the lamp is scaled by 10
+        scene.AddTransform(streetLampLights[i], streetLamps[i], streetLampLightOffset / 10.0f);
+        scene.pointLights.Add(streetLampLights[i], streetLampPointLight);
+    }
+
+    Entity crack = scene.CreateEntity();
+    scene.AddTransform(crack, platform, glm::vec3(14.0f, 0.3f, -49.0f),
+                       glm::angleAxis(glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f)), glm::vec3(12.0f));
+    scene.sprites.Add(crack).texture = crackTex;
+
+    Entity sunflower = scene.CreateEntity();
+    scene.AddTransform(sunflower, platform, glm::vec3(22.0f, 1.5f, -52.5f),
+                       glm::angleAxis(glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f)), glm::vec3(2.5f));
+    scene.sprites.Add(sunflower).texture = sunflowerTex;
+
+    const Entity namedEntities[] = { building, platform, streetLamps[0], streetLamps[1], sun };
+    const char* entityNames[] = { "Building", "Platform", "Street lamp 1", "Street lamp 2", "Sun" };
+    const std::vector<Entity> occluders = { building };
+
+    // the building is the only big occluder; its mesh is already low-poly enough to rasterize as is
+    std::vector<glm::vec3> buildingOccluderPositions;
+    std::vector<unsigned int> buildingOccluderIndices;
+    for (const Mesh& mesh : buildingModel.meshes) {
+        unsigned int firstVertex = buildingOccluderPositions.size();
+        for (const Vertex& vertex : mesh.vertices)
+            buildingOccluderPositions.push_back(vertex.Position);
+        for (unsigned int index : mesh.indices)
+            buildingOccluderIndices.push_back(firstVertex + index);
+    }
+
+    OcclusionCuller occlusionCuller;
+
+    // the sun is far enough away to shadow like a directional light aimed at the platform
+    const int sunShadowSize = 2048;
+    CascadedShadowMap* sunShadows = new CascadedShadowMap(sunShadowSize, 3, formats.GetDepth(RenderTargetFormats::ORTHOGRAPHIC_SHADOW_DEPTH));
+    sunShadows->SetProgram(shadowDepthShader.ID);
+    sunShadows->SetDistance(250.0f);
+    // the lamps' cube faces, sized by how much of the screen they light
+    const int lampShadowSize = 2048;
+    PointShadowAtlas* lampShadows = new PointShadowAtlas(lampShadowSize, formats.GetDepth(RenderTargetFormats::PERSPECTIVE_SHADOW_DEPTH));
+    lampShadows->SetProgram(shadowDepthShader.ID);
+    // the static and the final cascade arrays, and the atlas
+    unsigned long long sunShadowTexels = 2ull * sunShadowSize * sunShadowSize * sunShadows->GetCascadeCount();
+    unsigned long long lampShadowTexels = (unsigned long long) lampShadowSize * lampShadowSize;
+    programState->shadowMapBytes = sunShadowTexels * RenderTargetPool::BytesPerPixel(sunShadows->GetDepthFormat())
+                                   + lampShadowTexels * RenderTargetPool::BytesPerPixel(lampShadows->GetDepthFormat());
+    programState->shadowMapBytesAt24Bit = (sunShadowTexels + lampShadowTexels) * RenderTargetPool::BytesPerPixel(GL_DEPTH_COMPONENT24);
+    bool lampShadowsEnabled = false;
+    std::vector<Entity> stressEntities;
+
+    // per frame and per draw uniforms, three frames in flight
+    RingBuffer* uniformRing = new RingBuffer(GL_UNIFORM_BUFFER, 1 << 20, (GLADloadproc) glfwGetProcAddress);
+    // the programs of the lit and emissive passes are picked every frame
+    RenderQueue renderQueue;
+    RenderQueue::BindUniformBlocks(platformShader.ID);
+    RenderQueue::BindUniformBlocks(depthPrepassShader.ID);
+    // shaded fragments of the queue's draws, with and without the depth pre-pass
+    FragmentCounter* fragmentCounter = new FragmentCounter();
+    // material textures of the same size share one texture array
+    TextureArrayPacker texturePacker;
+    for (const Model* model : { &buildingModel, &platformModel, &streetLampModel, &sunModel })
+        RenderQueue::AddTextures(*model, texturePacker);
+    texturePacker.Build();
+    for (const Model* model : { &buildingModel, &platformModel, &streetLampModel, &sunModel })
+        renderQueue.Prepare(*model, texturePacker);
+    // the models are only drawn through the queue, the sprites have their own textures
+    texturePacker.DeleteSources();
+    programState->textureArrayStats = texturePacker.GetStats();
+
+    // the static renderers' light from every light, baked once the scene stands; static
+    // surfaces fall back to the light loop while the map is stale
+    LightmapBaker* lightmapBaker = new LightmapBaker();
+    LightmapBaker::Settings lightmapSettings;
+    scene.UpdateTransforms(parallelFor);
+    scene.GatherLights();
+    lightmapBaker->Bake(scene, lightmapSettings, parallelFor);
+    programState->lightmapStats = lightmapBaker->GetStats();
+
+    // everything above bound objects directly while creating them
+    glState().Invalidate();
+
     while (!glfwWindowShouldClose(window)) {
+        governor->SetEnabled(programState->GovernorEnabled);
+        governor->SetTarget(programState->governorTargetMilliseconds);
+        governor->BeginFrame();
+        glState().ResetStats();
         float currentFrame = glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
-        streetLampOn1 = rand() % 100 > streetLampOnPercent;
-        streetLampOn2 = rand() % 100 > streetLampOnPercent;
+        for (Entity light : streetLampLights)
+            scene.pointLights.Get(light).on = rand() % 100 > streetLampOnPercent;
 
         processInput(window);
 
         glClearColor(programState->clearColor.r, programState->clearColor.g, programState->clearColor.b, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        targetPool->SetDisplaySize(framebufferWidth, framebufferHeight);
+        int displayWidth = targetPool->GetDisplayWidth();
+        int displayHeight = targetPool->GetDisplayHeight();
+        // the scene renders at the governed scale, further lowered while temporal upsampling
+        // recovers the detail, and the composite upscales it
+        float renderScale = governor->GetValue(renderScaleKnob);
+        if (programState->TemporalUpsamplingEnabled)
+            renderScale *= programState->temporalRenderScale;
+        // the temporal scale is a free slider, the product snaps to the governor's steps
+        programState->renderScale = std::max(renderScaleStep, std::round(renderScale / renderScaleStep) * renderScaleStep);
+        int renderWidth = std::max(1, (int) (displayWidth * programState->renderScale));
+        int renderHeight = std::max(1, (int) (displayHeight * programState->renderScale));
 
         glm::mat4 view = programState->camera.GetViewMatrix();
-        glm::mat4 projection = glm::perspective(glm::radians(programState->camera.Zoom), (float) SCR_WIDTH / (float) SCR_HEIGHT, 0.1f, 1200.0f);
-        pointLightShader.use();
-        glEnable(GL_CULL_FACE);
-
-        pointLightShader.setVec3("pointLights[0].position", sunPosition);
-        pointLightShader.setVec3("pointLights[0].ambient", sunPointLight.ambient);
-        pointLightShader.setVec3("pointLights[0].diffuse", sunPointLight.diffuse);
-        pointLightShader.setVec3("pointLights[0].specular", sunPointLight.specular);
-        pointLightShader.setFloat("pointLights[0].constant", sunPointLight.constant);
-        pointLightShader.setFloat("pointLights[0].linear", sunPointLight.linear);
-        pointLightShader.setFloat("pointLights[0].quadratic", sunPointLight.quadratic);
-
-        pointLightShader.setVec3("pointLights[1].position", streetLampPosition1 + streetLampLightOffset);
-        pointLightShader.setVec3("pointLights[1].ambient", streetLampPointLight.ambient);
-        pointLightShader.setVec3("pointLights[1].diffuse", streetLampPointLight.diffuse);
-        pointLightShader.setVec3("pointLights[1].specular", streetLampPointLight.specular);
-        pointLightShader.setFloat("pointLights[1].constant", streetLampPointLight.constant);
-        pointLightShader.setFloat("pointLights[1].linear", streetLampPointLight.linear);
-        pointLightShader.setFloat("pointLights[1].quadratic", streetLampPointLight.quadratic);
-
-        pointLightShader.setVec3("pointLights[2].position", streetLampPosition2 + streetLampLightOffset);
-        pointLightShader.setVec3("pointLights[2].ambient", streetLampPointLight.ambient);
-        pointLightShader.setVec3("pointLights[2].diffuse", streetLampPointLight.diffuse);
-        pointLightShader.setVec3("pointLights[2].specular", streetLampPointLight.specular);
-        pointLightShader.setFloat("pointLights[2].constant", streetLampPointLight.constant);
-        pointLightShader.setFloat("pointLights[2].linear", streetLampPointLight.linear);
-        pointLightShader.setFloat("pointLights[2].quadratic", streetLampPointLight.quadratic);
-
-        pointLightShader.setVec3("viewPosition", programState->camera.Position);
-        pointLightShader.setFloat("material.shininess", 32.0f);
-        pointLightShader.setMat4("projection", projection);
-        pointLightShader.setMat4("view", view);
-        pointLightShader.setBool("streetLampOn1", streetLampOn1);
-        pointLightShader.setBool("streetLampOn2", streetLampOn2);
-
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, programState->modelPosition);
-        model = glm::scale(model, glm::vec3(programState->modelScale));
-//        model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-        pointLightShader.setMat4("model", model);
-        buildingModel.Draw(pointLightShader);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0, 0.0, 0.0));
-        model = glm::scale(model, glm::vec3(1.0f));
-//        model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-        pointLightShader.setMat4("model", model);
-        platformModel.Draw(pointLightShader);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, streetLampPosition1);
-        model = glm::scale(model, glm::vec3(10.0f));
-//        model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-        pointLightShader.setMat4("model", model);
-        streetLampModel.Draw(pointLightShader);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, streetLampPosition2);
-        model = glm::scale(model, glm::vec3(10.0f));
-//        model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-        pointLightShader.setMat4("model", model);
-        streetLampModel.Draw(pointLightShader);
-
-        sunShader.use();
-        model = glm::translate(model, sunPosition);
-        model = glm::scale(model, glm::vec3(4.0f));
-//        model = glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        sunShader.setVec3("lightColor",  glm::vec3(10.0f));
-        sunShader.setMat4("model", model);
-        sunShader.setMat4("view", view);
-        sunShader.setMat4("projection", projection);
-        sunModel.Draw(sunShader);
-
-        glDisable(GL_CULL_FACE);
-
-        platformShader.use();
-
-        glBindTexture(GL_TEXTURE_2D, crackTex);
-        glActiveTexture(crackTex);
-        glBindVertexArray(grassVAO);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(14.0f,  0.3f, -49.0f));
-        model = glm::scale(model, glm::vec3(12.0f));
-        model = glm::rotate(model, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-        platformShader.setMat4("model", model);
-        platformShader.setMat4("view", view);
-        platformShader.setMat4("projection", projection);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-
-        glBindTexture(GL_TEXTURE_2D, sunflowerTex);
-        glActiveTexture(sunflowerTex);
-        glBindVertexArray(grassVAO);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(22.0f,  1.5f, -52.5f));
-        model = glm::scale(model, glm::vec3(2.5f));
-        model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        platformShader.setMat4("model", model);
-        platformShader.setMat4("view", view);
-        platformShader.setMat4("projection", projection);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-
-        glDepthFunc(GL_LEQUAL);
-        glDepthMask(GL_FALSE);
-        skyboxShader.use();
-        skyboxShader.setMat4("view", glm::mat4(glm::mat3(programState->camera.GetViewMatrix())));
-        skyboxShader.setMat4("projection", projection);
-        skyboxShader.setInt("bloom", bloom);
-        bloomShader.setFloat("exposure", exposure);
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-        glDepthMask(GL_TRUE);
-        glDepthFunc(GL_LESS);
-
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        bool horizontal = true, first_iteration = true;
-        unsigned int amount = 10;
-        blurShader.use();
-        for (unsigned int i = 0; i < amount; i++)
-        {
-            glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[horizontal]);
-            blurShader.setInt("horizontal", horizontal);
-            glBindTexture(GL_TEXTURE_2D, first_iteration ? colorBuffers[1] : pingpongColorbuffers[!horizontal]);  // bind texture of other framebuffer (or scene if first iteration)
-            renderQuad();
-            horizontal = !horizontal;
-            if (first_iteration)
-                first_iteration = false;
+        glm::mat4 projection = glm::perspective(glm::radians(programState->camera.Zoom), (float) displayWidth / (float) displayHeight, 0.1f, 1200.0f);
+
+        int buildingNode = scene.transforms.Get(building).node;
+        scene.hierarchy.SetPosition(buildingNode, programState->modelPosition);
+        scene.hierarchy.SetScale(buildingNode, glm::vec3(programState->modelScale));
+
+        if ((int) stressEntities.size() != programState->CullingStressObjects) {
+            for (Entity entity : stressEntities)
+                scene.DestroyEntity(entity);
+            stressEntities.clear();
+            // culling-only entities, a unit box scaled to each stress box
+            for (const AABB& box : generateStressBoxes(programState->CullingStressObjects)) {
+                Entity entity = scene.CreateEntity();
+                scene.AddTransform(entity, NULL_ENTITY, box.Center(), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), box.Extents());
+                scene.AddMeshRenderer(entity, nullptr, AABB(glm::vec3(-1.0f), glm::vec3(1.0f)));
+                stressEntities.push_back(entity);
+            }
+        }
+        scene.UpdateTransforms(parallelFor);
+        programState->entityCount = scene.EntityCount();
+        if (programState->lightmapRebake) {
+            programState->lightmapRebake = false;
+            scene.GatherLights();
+            lightmapBaker->Bake(scene, lightmapSettings, parallelFor);
+            programState->lightmapStats = lightmapBaker->GetStats();
+        }
+        bool lightmapped = programState->LightmapsEnabled && lightmapBaker->IsCurrent(scene);
+        programState->lightmapCurrent = lightmapBaker->IsCurrent(scene);
+
+        // frustum culling, occluder rasterization, light gathering and picking only read the
+        // scene's transforms, so they run side by side; occlusion tests wait for the first two
+        glm::mat4 viewProjection = projection * view;
+        // culling works with the unjittered matrix, only rendering moves by the jitter
+        if (programState->TemporalUpsamplingEnabled && !temporalUpsampling)
+            temporalResolve->Reset();
+        temporalUpsampling = programState->TemporalUpsamplingEnabled;
+        glm::mat4 renderProjection = projection;
+        if (temporalUpsampling) {
+            temporalResolve->BeginFrame(displayWidth, displayHeight, renderWidth, renderHeight, viewProjection);
+            renderProjection = temporalResolve->Jitter(projection);
+        }
+        JobSystem::Handle frustumJob = jobs.Schedule([&]() {
+            FrustumCuller::Stats& cullingStats = programState->cullingStats;
+            if (programState->FrustumCullingEnabled) {
+                cullingStats = scene.CullFrustum(Frustum::FromMatrix(viewProjection), programState->BVHCullingEnabled);
+            } else {
+                scene.ShowAll();
+                cullingStats = FrustumCuller::Stats();
+                cullingStats.total = cullingStats.visible = scene.meshRenderers.Size();
+            }
+        });
+        JobSystem::Handle rasterJob = jobs.Schedule([&]() {
+            if (!programState->OcclusionCullingEnabled)
+                return;
+            occlusionCuller.BeginFrame(viewProjection);
+            occlusionCuller.AddOccluder(buildingOccluderPositions, buildingOccluderIndices, scene.GetWorldMatrix(building));
+            occlusionCuller.Rasterize(parallelFor);
+        });
+        JobSystem::Handle occlusionJob = jobs.Schedule([&]() {
+            if (programState->OcclusionCullingEnabled) {
+                scene.CullOcclusion(occlusionCuller, occluders);
+                programState->occlusionStats = occlusionCuller.GetStats();
+            } else {
+                programState->occlusionStats = OcclusionCuller::Stats();
+            }
+        }, { frustumJob, rasterJob });
+        // light assignment: each street lamp only lights the objects inside its range
+        JobSystem::Handle lightJob = jobs.Schedule([&]() {
+            scene.GatherLights();
+        });
+        JobSystem::Handle pickJob = jobs.Schedule([&]() {
+            float pickedDistance;
+            int picked = scene.bvh.RayCast(programState->camera.Position, programState->camera.Front, 1200.0f, pickedDistance);
+            if (picked < 0) {
+                programState->pickedObject = "nothing";
+            } else {
+                programState->pickedObject = "entity " + std::to_string(entityIndex((Entity) picked));
+                for (unsigned int i = 0; i < sizeof(namedEntities) / sizeof(namedEntities[0]); i++)
+                    if (namedEntities[i] == (Entity) picked)
+                        programState->pickedObject = entityNames[i];
+            }
+            programState->pickedDistance = pickedDistance;
+        });
+        programState->bvhNodes = scene.bvh.NodeCount();
+        programState->bvhHeight = scene.bvh.Height();
+        // workers turn the visible renderers into packets while this thread sets the per frame uniforms
+        unsigned int lightsOn = 0;
+        for (int i = 0; i < scene.pointLights.Size(); i++)
+            lightsOn |= (unsigned int) scene.pointLights[i].on << i;
+        bool sunShadowsEnabled = programState->SunShadowsEnabled;
+        // the atlas misses whatever moved while it was off
+        if (programState->LampShadowsEnabled && !lampShadowsEnabled)
+            lampShadows->Invalidate();
+        lampShadowsEnabled = programState->LampShadowsEnabled;
+        // packets take the programs specialized for this frame's lights, shadows and bloom; each
+        // define set compiles the first time it is used
+        ShaderDefines litDefines;
+        litDefines.Set("POINT_LIGHT_COUNT", scene.pointLights.Size())
+                  .Set("SUN_SHADOWS", sunShadowsEnabled)
+                  .Set("POINT_SHADOWS", lampShadowsEnabled)
+                  .Set("BLOOM_MRT", bloom)
+                  .Set("LIGHTMAP", lightmapped);
+        unsigned int litProgram = pointLightShader.variant(litDefines);
+        unsigned int normalMappedProgram = pointLightShader.variant(ShaderDefines(litDefines).Set("NORMAL_MAPPING", 1));
+        unsigned int emissiveProgram = sunShader.variant({ { "BLOOM_MRT", bloom } });
+        renderQueue.SetProgram(MeshRenderer::LIT, litProgram, normalMappedProgram);
+        renderQueue.SetProgram(MeshRenderer::EMISSIVE, emissiveProgram);
+        uniformRing->BeginFrame();
+        JobSystem::Handle packetJob = jobs.Schedule([&]() {
+            renderQueue.Build(scene, lightsOn, *uniformRing, jobs.WorkerCount() + 1, parallelFor);
+        }, { occlusionJob, lightJob });
+        jobs.Wait({ lightJob, pickJob });
+
+        FrameData frameData = {};
+        // the cascades follow the unjittered camera; only stale ones are drawn in the graph
+        if (sunShadowsEnabled) {
+            sunShadows->SetLight(glm::normalize(scene.GetWorldPosition(platform) - scene.GetWorldPosition(sun)));
+            sunShadows->Prepare(scene, view, glm::radians(programState->camera.Zoom), (float) displayWidth / (float) displayHeight, 0.1f);
+            ASSERT(sunShadows->GetCascadeCount() <= FrameData::MAX_SHADOW_CASCADES, "Too many shadow cascades for FrameData");
+            frameData.sunShadowCascades = sunShadows->GetCascadeCount();
+            for (int i = 0; i < sunShadows->GetCascadeCount(); i++)
+                frameData.sunShadowMatrices[i] = sunShadows->GetMatrix(i);
         }
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (lampShadowsEnabled) {
+            lampShadows->SetBudget(programState->lampShadowBudget);
+            lampShadows->Prepare(scene, programState->camera.Position, projection[1][1] * displayHeight * 0.5f);
+            ASSERT(lampShadows->GetSlotCount() <= FrameData::MAX_SHADOWED_POINT_LIGHTS, "Too many shadowed lights for FrameData");
+            for (int slot = 0; slot < lampShadows->GetSlotCount(); slot++) {
+                for (int face = 0; face < PointShadowAtlas::FACES; face++) {
+                    frameData.pointShadowMatrices[slot * PointShadowAtlas::FACES + face] = lampShadows->GetMatrix(slot, face);
+                    frameData.pointShadowRects[slot * PointShadowAtlas::FACES + face] = lampShadows->GetRect(slot, face);
+                }
+            }
+        }
+        frameData.view = view;
+        frameData.projection = renderProjection;
+        frameData.viewPosition = glm::vec4(programState->camera.Position, 1.0f);
+        ASSERT(scene.pointLights.Size() <= FrameData::MAX_POINT_LIGHTS, "Too many point lights for FrameData");
+        frameData.pointLightCount = scene.pointLights.Size();
+        frameData.bakedLightMask = lightmapped ? lightmapBaker->GetLightMask() : 0u;
+        for (int i = 0; i < scene.pointLights.Size(); i++) {
+            const PointLight& light = scene.pointLights[i];
+            LightData& data = frameData.pointLights[i];
+            data.position = glm::vec4(light.position, 1.0f);
+            data.ambient = glm::vec4(light.ambient, 0.0f);
+            data.diffuse = glm::vec4(light.diffuse, 0.0f);
+            data.specular = glm::vec4(light.specular, 0.0f);
+            data.attenuation = glm::vec4(light.constant, light.linear, light.quadratic, lampShadowsEnabled ? lampShadows->GetSlot(i) : -1);
+        }
+        unsigned int frameDataOffset = uniformRing->Push(frameData);
+
+        jobs.Wait(packetJob);
+        uniformRing->Flush();
+        bloomChain->Resize(renderWidth, renderHeight);
+        int bloomLevels = programState->bloomLevels;
+        if (programState->GovernorEnabled)
+            bloomLevels = std::min(bloomLevels, (int) governor->GetValue(bloomLevelsKnob));
+        bloomChain->SetLevels(bloomLevels);
+        bloomChain->SetComputeEnabled(programState->ComputePostEnabled);
+
+        renderGraph->Reset();
+        RenderGraph::Resource backbuffer = renderGraph->ImportTexture("backbuffer", 0, { framebufferWidth, framebufferHeight, GL_RGBA8, 1 });
+        renderGraph->MarkOutput(backbuffer);
+        RenderGraph::Resource hdrColor = renderGraph->CreateTexture("hdr color", { renderWidth, renderHeight, hdrFormat, 1 });
+        RenderGraph::Resource depth = renderGraph->CreateTexture("depth", { renderWidth, renderHeight, formats.GetDepth(RenderTargetFormats::SCENE_DEPTH), 1 });
+        RenderGraph::Resource bloomColor = renderGraph->ImportTexture("bloom", bloomChain->GetOutput(), { renderWidth / 2, renderHeight / 2, hdrFormat, 1 });
+
+        RenderGraph::Resource sunShadowMap = renderGraph->ImportTexture("sun shadow map", sunShadows->GetTexture(), { sunShadowSize, sunShadowSize, sunShadows->GetDepthFormat(), 1 });
+        renderGraph->AddPass("sun shadows", {}, { sunShadowMap }, [&]() {
+            sunShadows->Render(scene);
+        }, RenderGraph::NO_FRAMEBUFFER);
+
+        RenderGraph::Resource lampShadowAtlas = renderGraph->ImportTexture("lamp shadow atlas", lampShadows->GetTexture(), { lampShadowSize, lampShadowSize, lampShadows->GetDepthFormat(), 1 });
+        renderGraph->AddPass("lamp shadows", {}, { lampShadowAtlas }, [&]() {
+            lampShadows->Render(scene);
+        }, RenderGraph::NO_FRAMEBUFFER);
+
+        std::vector<RenderGraph::Resource> sceneReads = { depth };
+        if (sunShadowsEnabled)
+            sceneReads.push_back(sunShadowMap);
+        if (lampShadowsEnabled)
+            sceneReads.push_back(lampShadowAtlas);
+        // the bright target only exists while bloom is on, the programs write it as a second output
+        std::vector<RenderGraph::Resource> sceneWrites = { hdrColor, depth };
+        RenderGraph::Resource brightColor = -1;
+        if (bloom) {
+            brightColor = renderGraph->CreateTexture("bright color", { renderWidth, renderHeight, hdrFormat, 1 });
+            sceneWrites.insert(sceneWrites.begin() + 1, brightColor);
+        }
+        renderGraph->AddPass("scene", sceneReads, sceneWrites, [&]() {
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            glState().BindUniformBufferRange(RenderQueue::FRAME_DATA_BINDING, uniformRing->GetBuffer(), frameDataOffset, sizeof(FrameData));
+            if (sunShadowsEnabled)
+                glState().BindTexture(3, GL_TEXTURE_2D_ARRAY, renderGraph->GetTexture(sunShadowMap));
+            if (lampShadowsEnabled)
+                glState().BindTexture(4, GL_TEXTURE_2D, renderGraph->GetTexture(lampShadowAtlas));
+            if (lightmapped) {
+                glState().BindTexture(5, GL_TEXTURE_2D_ARRAY, lightmapBaker->GetTexture());
+                glState().BindTexture(6, GL_TEXTURE_BUFFER, lightmapBaker->GetTriangleTexture());
+            }
+            glState().SetCullFace(true);
+            // with the pre-pass only the front most fragment of every pixel runs the light loop
+            bool prepass = programState->DepthPrepassEnabled;
+            if (prepass) {
+                glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+                renderQueue.SubmitDepth(*uniformRing, depthPrepassShader.ID);
+                glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+                glState().DepthFunc(GL_EQUAL);
+                glState().DepthMask(false);
+            }
+            fragmentCounter->Begin((unsigned long long) renderWidth * renderHeight, prepass);
+            renderQueue.Submit(*uniformRing);
+            fragmentCounter->End();
+            if (prepass) {
+                glState().DepthFunc(GL_LESS);
+                glState().DepthMask(true);
+            }
+            glState().SetCullFace(false);
+
+            platformShader.use();
+            glState().BindVertexArray(grassVAO);
+            for (int i = 0; i < scene.sprites.Size(); i++) {
+                glState().BindTexture(0, GL_TEXTURE_2D, scene.sprites[i].texture);
+                platformShader.setMat4("model", scene.GetWorldMatrix(scene.sprites.GetEntity(i)));
+                glDrawArrays(GL_TRIANGLES, 0, 6);
+            }
 
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        bloomShader.use();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, colorBuffers[0]);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[!horizontal]);
-        bloomShader.setInt("bloom", bloom);
-        bloomShader.setFloat("exposure", exposure);
-        renderQuad();
+            glState().DepthFunc(GL_LEQUAL);
+            glState().DepthMask(false);
+            skyboxShader.use();
+            skyboxShader.setMat4("view", glm::mat4(glm::mat3(programState->camera.GetViewMatrix())));
+            skyboxShader.setMat4("projection", renderProjection);
+            skyboxShader.setInt("bloom", bloom);
+            glState().BindVertexArray(skyboxVAO);
+            glState().BindTexture(0, GL_TEXTURE_CUBE_MAP, cubemapTexture);
+            glDrawArrays(GL_TRIANGLES, 0, 36);
+            glState().DepthMask(true);
+            glState().DepthFunc(GL_LESS);
+        });
+
+        if (bloom) {
+            renderGraph->AddPass("bloom", { brightColor }, { bloomColor }, [&]() {
+                bloomChain->Render(renderGraph->GetTexture(brightColor));
+            }, RenderGraph::NO_FRAMEBUFFER);
+        }
+
+        // the resolve writes this frame's history, which the composite then reads in place of
+        // the scene color
+        RenderGraph::Resource sceneColor = hdrColor;
+        if (temporalUpsampling) {
+            RenderGraph::Resource history = renderGraph->ImportTexture("taa history", temporalResolve->GetHistory(), { displayWidth, displayHeight, GL_RGBA16F, 1 });
+            sceneColor = renderGraph->ImportTexture("taa output", temporalResolve->GetOutput(), { displayWidth, displayHeight, GL_RGBA16F, 1 });
+            renderGraph->AddPass("temporal resolve", { hdrColor, depth, history }, { sceneColor }, [&]() {
+                temporalResolve->Resolve(renderGraph->GetTexture(hdrColor), renderGraph->GetTexture(depth));
+            });
+        }
+
+        // metered on the scene before bloom is added; the composite reads the adapted value
+        // from its 1x1 target, the CPU only sees it through the delayed readback
+        if (programState->AutoExposureEnabled && !autoExposureEnabled)
+            autoExposure->Reset();
+        autoExposureEnabled = programState->AutoExposureEnabled;
+        autoExposure->GetSettings().key = programState->exposureKey;
+        autoExposure->SetComputeEnabled(programState->ComputePostEnabled);
+        RenderGraph::Resource exposureTarget = renderGraph->ImportTexture("exposure", autoExposure->GetOutput(), { 1, 1, GL_RG32F, 1 });
+        renderGraph->AddPass("exposure", { sceneColor }, { exposureTarget }, [&]() {
+            autoExposure->Render(renderGraph->GetTexture(sceneColor), deltaTime);
+        }, RenderGraph::NO_FRAMEBUFFER);
+
+        // bloom, exposure, tonemapping and grading in one pass; the curves are one LUT fetch
+        gradingLut->SetSettings(programState->grading);
+        // with anti-aliasing the composite writes an LDR target the AA passes read, in sRGB where
+        // the backbuffer is so the encoding on write stays the same
+        PostAntialiasing::Mode antialiasingMode = (PostAntialiasing::Mode) programState->antialiasing;
+        bool antialiased = antialiasingMode != PostAntialiasing::NONE;
+        RenderGraph::Resource compositeTarget = backbuffer;
+        if (antialiased)
+            compositeTarget = renderGraph->CreateTexture("ldr color", { displayWidth, displayHeight, ldrFormat, 1 });
+        CompositeVariant& compositeVariant = compositeVariants[(bloom ? 1 : 0) | (autoExposureEnabled ? 2 : 0)
+                                                               | (antialiased ? 4 : 0) | (srgbBackbuffer ? 8 : 0)];
+        if (compositeVariant.program == 0) {
+            compositeVariant.program = compositeShader.variant({ { "BLOOM", bloom }, { "AUTO_EXPOSURE", autoExposureEnabled },
+                                                                 { "LUMA_IN_ALPHA", antialiased }, { "LINEAR_OUTPUT", srgbBackbuffer } });
+            compositeVariant.exposureLocation = glGetUniformLocation(compositeVariant.program, "exposure");
+        }
+        auto composite = [&]() {
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            glState().UseProgram(compositeVariant.program);
+            glState().BindTexture(0, GL_TEXTURE_2D, renderGraph->GetTexture(sceneColor));
+            if (bloom)
+                glState().BindTexture(1, GL_TEXTURE_2D, renderGraph->GetTexture(bloomColor));
+            if (autoExposureEnabled)
+                glState().BindTexture(2, GL_TEXTURE_2D, renderGraph->GetTexture(exposureTarget));
+            else
+                glUniform1f(compositeVariant.exposureLocation, exposure);
+            glState().BindTexture(3, GL_TEXTURE_3D, gradingLut->GetTexture());
+            glState().BindVertexArray(fullscreenVAO);
+            // only the composite and the AA pass after it write linear color, the UI is already encoded
+            if (srgbBackbuffer)
+                glEnable(GL_FRAMEBUFFER_SRGB);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            if (srgbBackbuffer)
+                glDisable(GL_FRAMEBUFFER_SRGB);
+        };
+        // unread targets cull the passes producing them
+        std::vector<RenderGraph::Resource> compositeReads = { sceneColor };
+        if (bloom)
+            compositeReads.push_back(bloomColor);
+        if (autoExposureEnabled)
+            compositeReads.push_back(exposureTarget);
+        renderGraph->AddPass("composite", compositeReads, { compositeTarget }, composite);
+
+        if (antialiasingMode == PostAntialiasing::FXAA) {
+            renderGraph->AddPass("fxaa", { compositeTarget }, { backbuffer }, [&]() {
+                gpuTimer->Begin(fxaaScope);
+                if (srgbBackbuffer)
+                    glEnable(GL_FRAMEBUFFER_SRGB);
+                antialiasing->Fxaa(renderGraph->GetTexture(compositeTarget));
+                if (srgbBackbuffer)
+                    glDisable(GL_FRAMEBUFFER_SRGB);
+                gpuTimer->End(fxaaScope);
+            });
+        } else if (antialiasingMode == PostAntialiasing::SMAA) {
+            // every pass writes all of its pixels, no clears needed
+            RenderGraph::Resource smaaEdges = renderGraph->CreateTexture("smaa edges", { displayWidth, displayHeight, GL_RG8, 1 });
+            RenderGraph::Resource smaaWeights = renderGraph->CreateTexture("smaa weights", { displayWidth, displayHeight, GL_RGBA8, 1 });
+            renderGraph->AddPass("smaa edges", { compositeTarget }, { smaaEdges }, [&]() {
+                gpuTimer->Begin(smaaScope);
+                antialiasing->SmaaEdges(renderGraph->GetTexture(compositeTarget));
+            });
+            renderGraph->AddPass("smaa weights", { smaaEdges }, { smaaWeights }, [&]() {
+                antialiasing->SmaaWeights(renderGraph->GetTexture(smaaEdges));
+            });
+            renderGraph->AddPass("smaa blend", { compositeTarget, smaaWeights }, { backbuffer }, [&]() {
+                if (srgbBackbuffer)
+                    glEnable(GL_FRAMEBUFFER_SRGB);
+                antialiasing->SmaaBlend(renderGraph->GetTexture(compositeTarget), renderGraph->GetTexture(smaaWeights));
+                if (srgbBackbuffer)
+                    glDisable(GL_FRAMEBUFFER_SRGB);
+                gpuTimer->End(smaaScope);
+            });
+        }
+
+        if (programState->ImGuiEnabled) {
+            renderGraph->AddPass("ui", { backbuffer }, { backbuffer }, [&]() {
+                DrawImGui(programState);
+                glState().Invalidate();
+            });
+        }
 
-        if (programState->ImGuiEnabled)
-            DrawImGui(programState);
+        renderGraph->Execute();
+        programState->renderQueueStats = renderQueue.GetStats();
+        programState->fragmentStats = fragmentCounter->GetStats();
+        programState->shadowStats = sunShadows->GetStats();
+        programState->lampShadowStats = lampShadows->GetStats();
+        programState->ringBufferStats = uniformRing->GetStats();
+        programState->renderGraphStats = renderGraph->GetStats();
+        programState->exposureStats = autoExposure->GetStats();
+        targetPool->EndFrame();
+        programState->renderTargetStats = targetPool->GetStats();
+        programState->glStateStats = glState().GetStats();
+
+        gpuTimer->EndFrame();
+        programState->gpuScopes = gpuTimer->GetScopes();
+        governor->EndFrame();
+        programState->governorStats = governor->GetStats();
+        uniformRing->EndFrame();
 
         glfwSwapBuffers(window);
         glfwPollEvents();
@@ -455,6 +924,20 @@ int main() {
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
 
+    delete renderGraph;
+    delete governor;
+    delete temporalResolve;
+    delete autoExposure;
+    delete antialiasing;
+    delete gpuTimer;
+    delete lightmapBaker;
+    delete gradingLut;
+    delete sunShadows;
+    delete lampShadows;
+    delete fragmentCounter;
+    delete bloomChain;
+    delete targetPool;
+    delete uniformRing;
     delete programState;
     glfwTerminate();
     return 0;
@@ -473,6 +956,109 @@ void DrawImGui(ProgramState *programState) {
     ImGui::Checkbox("Camera mouse update", &programState->CameraMouseMovementUpdateEnabled);
     ImGui::End();
 
+    ImGui::Begin("Culling");
+    const FrustumCuller::Stats& stats = programState->cullingStats;
+    ImGui::Checkbox("Frustum culling", &programState->FrustumCullingEnabled);
+    ImGui::Checkbox("Use BVH", &programState->BVHCullingEnabled);
+    ImGui::SliderInt("Stress objects", &programState->CullingStressObjects, 0, 100000);
+    ImGui::Text("Visible: %u / %u", stats.visible, stats.total);
+    ImGui::Text("Cull time: %.3f ms", stats.milliseconds);
+    ImGui::Text("Entities: %d, worker threads: %d", programState->entityCount, programState->workerThreads);
+    ImGui::Text("BVH nodes: %d, height: %d", programState->bvhNodes, programState->bvhHeight);
+    ImGui::Text("Looking at: %s (%.1f)", programState->pickedObject.c_str(), programState->pickedDistance);
+    const OcclusionCuller::Stats& occlusion = programState->occlusionStats;
+    ImGui::Checkbox("Occlusion culling", &programState->OcclusionCullingEnabled);
+    ImGui::Text("Occluder triangles: %u", occlusion.occluderTriangles);
+    ImGui::Text("Occluded: %u / %u", occlusion.occluded, occlusion.tested);
+    ImGui::Text("Raster: %.3f ms, test: %.3f ms", occlusion.rasterMilliseconds, occlusion.testMilliseconds);
+    ImGui::End();
+
+    ImGui::Begin("Render queue");
+    const RenderQueue::Stats& queue = programState->renderQueueStats;
+    ImGui::Text("Packets: %u", queue.packets);
+    const GLStateCache::Stats& state = programState->glStateStats;
+    ImGui::Text("GL state calls: %u issued, %u elided", state.issued, state.elided);
+    ImGui::Text("Build: %.3f ms, submit: %.3f ms", queue.buildMilliseconds, queue.submitMilliseconds);
+    const FragmentCounter::Stats& fragments = programState->fragmentStats;
+    ImGui::Checkbox("Depth pre-pass", &programState->DepthPrepassEnabled);
+    ImGui::Text("%s per pixel: %.2f (without pre-pass %.2f, with %.2f)", fragments.invocations ? "Shader invocations" : "Samples passed",
+                fragments.overdraw, fragments.overdrawWithoutPrepass, fragments.overdrawWithPrepass);
+    const TextureArrayPacker::Stats& arrays = programState->textureArrayStats;
+    ImGui::Text("Texture arrays: %u textures in %u arrays, %.1f MB, %.1f MB of sources freed", arrays.textures, arrays.arrays,
+                arrays.bytes / (1024.0 * 1024.0), arrays.freedBytes / (1024.0 * 1024.0));
+    const RingBuffer::Stats& ring = programState->ringBufferStats;
+    ImGui::Text("Uniform ring: %s, %u / %u bytes", ring.persistent ? "persistent" : "orphaned", ring.usedBytes, ring.capacityBytes);
+    ImGui::Text("Fence waits: %u", ring.fenceWaits);
+    const CascadedShadowMap::Stats& shadows = programState->shadowStats;
+    ImGui::Checkbox("Sun shadows", &programState->SunShadowsEnabled);
+    ImGui::Text("Cascades redrawn: %u / %u (%u total), deferred: %u", shadows.staticRenders, shadows.cascades, shadows.totalStaticRenders, shadows.deferred);
+    ImGui::Text("Dynamic casters: %u, shadow draws: %u", shadows.dynamicCasters, shadows.draws);
+    const PointShadowAtlas::Stats& lampShadowStats = programState->lampShadowStats;
+    ImGui::Checkbox("Lamp shadows", &programState->LampShadowsEnabled);
+    ImGui::SliderInt("Faces per frame", &programState->lampShadowBudget, 1, 12);
+    ImGui::Text("Lamp faces drawn: %u, pending: %u, draws: %u", lampShadowStats.facesDrawn, lampShadowStats.facesPending, lampShadowStats.draws);
+    ImGui::Text("Atlas: %u lights, %.0f%% used, %u repacks", lampShadowStats.lights, lampShadowStats.usage * 100.0f, lampShadowStats.repacks);
+    const LightmapBaker::Stats& lightmap = programState->lightmapStats;
+    ImGui::Checkbox("Lightmaps", &programState->LightmapsEnabled);
+    ImGui::SameLine();
+    if (ImGui::Button("Rebake"))
+        programState->lightmapRebake = true;
+    ImGui::Text("Lightmap: %s, %u lights, %.2f texels per unit", programState->lightmapCurrent ? "current" : "stale, static geometry moved",
+                lightmap.lights, lightmap.texelsPerUnit);
+    ImGui::Text("Baked %u triangles in %u charts, %u texels, %u BVH nodes", lightmap.triangles, lightmap.charts, lightmap.texels, lightmap.bvhNodes);
+    ImGui::Text("Bake: %.0f ms, %.1f M rays", lightmap.milliseconds, lightmap.rays / 1e6);
+    ImGui::End();
+
+    ImGui::Begin("Post processing");
+    const RenderGraph::Stats& graph = programState->renderGraphStats;
+    ImGui::Text("Passes: %u, culled: %u", graph.passes - graph.culledPasses, graph.culledPasses);
+    const RenderTargetPool::Stats& targets = programState->renderTargetStats;
+    ImGui::Text("Transient targets: %u", graph.transientTargets);
+    const double megabyte = 1024.0 * 1024.0;
+    ImGui::Text("HDR format: %s", programState->packedHdrSupported ? "R11F_G11F_B10F" : "RGBA16F (packed format not renderable)");
+    ImGui::Text("Target textures: %u (%u retired), %.1f MB, %.1f MB at RGBA16F", targets.textures, targets.retired,
+                targets.bytes / megabyte, targets.rgba16fBytes / megabyte);
+    ImGui::Text("Target traffic: %.1f MB per frame, %.1f MB at RGBA16F", graph.trafficBytes / megabyte, graph.rgba16fTrafficBytes / megabyte);
+    ImGui::Text("Shadow maps: %.1f MB, %.1f MB at 24 bit", programState->shadowMapBytes / megabyte, programState->shadowMapBytesAt24Bit / megabyte);
+    ImGui::Text("Allocations: %u, deletions: %u", targets.allocations, targets.deletions);
+    ImGui::Text("Bloom: %s (space)", bloom ? "on" : "off");
+    ImGui::SliderInt("Bloom levels", &programState->bloomLevels, 1, BloomChain::MAX_LEVELS);
+    if (programState->computePostSupported)
+        ImGui::Checkbox("Compute shaders", &programState->ComputePostEnabled);
+    else
+        ImGui::Text("Compute shaders: not supported, using fragment passes");
+    ColorGradingLut::Settings& grading = programState->grading;
+    ImGui::Text("Output: %s", programState->srgbBackbuffer ? "sRGB framebuffer" : "encoded by the LUT");
+    ImGui::SliderFloat("Contrast", &grading.contrast, 0.5f, 1.5f);
+    ImGui::SliderFloat("Saturation", &grading.saturation, 0.0f, 2.0f);
+    ImGui::SliderFloat("Temperature", &grading.temperature, -1.0f, 1.0f);
+    const char* antialiasingModes[] = { "None", "FXAA", "SMAA" };
+    ImGui::Combo("Anti-aliasing", &programState->antialiasing, antialiasingModes, 3);
+    ImGui::Checkbox("Auto exposure", &programState->AutoExposureEnabled);
+    if (programState->AutoExposureEnabled) {
+        const AutoExposure::Stats& metered = programState->exposureStats;
+        ImGui::SliderFloat("Exposure key", &programState->exposureKey, 0.05f, 0.5f);
+        ImGui::Text("Exposure: %.3f, mean luminance: %.3f", metered.exposure, metered.averageLuminance);
+        ImGui::Text("Readbacks: %u, skipped: %u", metered.readbacks, metered.skipped);
+    }
+    ImGui::Checkbox("Temporal upsampling", &programState->TemporalUpsamplingEnabled);
+    if (programState->TemporalUpsamplingEnabled)
+        ImGui::SliderFloat("Temporal render scale", &programState->temporalRenderScale, 0.5f, 1.0f);
+    ImGui::End();
+
+    ImGui::Begin("Frame governor");
+    const FrameGovernor::Stats& governor = programState->governorStats;
+    ImGui::Checkbox("Enabled", &programState->GovernorEnabled);
+    ImGui::SliderFloat("Target (ms)", &programState->governorTargetMilliseconds, 4.0f, 50.0f);
+    ImGui::Text("CPU: %.2f ms, GPU: %.2f ms (average %.2f)", governor.cpuMilliseconds, governor.gpuMilliseconds, governor.averageMilliseconds);
+    ImGui::Text("Render scale: %.2f", programState->renderScale);
+    ImGui::Text("Quality lowered %u times, raised %u times", governor.lowered, governor.raised);
+    for (const GpuTimer::Scope& scope : programState->gpuScopes) {
+        if (scope.ran)
+            ImGui::Text("%s: %.3f ms", scope.name.c_str(), scope.milliseconds);
+    }
+    ImGui::End();
+
     ImGui::Render();
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 }
@@ -492,7 +1078,7 @@ void processInput(GLFWwindow *window) {
 }
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height) {
-    glViewport(0, 0, width, height);
+    glState().Viewport(0, 0, width, height);
 }
 
 void mouse_callback(GLFWwindow *window, double xpos, double ypos) {
@@ -559,15 +1145,23 @@ unsigned int loadCubemap(vector<std::string> faces) {
 }
 */
 
-unsigned int loadCubemap(vector<std::string> faces) {
+unsigned int loadCubemap(vector<std::string> faces, JobSystem& jobs) {
+    // the faces are decoded in parallel, only the uploads have to stay on the GL thread
+    std::vector<unsigned char*> faceData(faces.size());
+    std::vector<int> faceWidths(faces.size()), faceHeights(faces.size()), faceChannels(faces.size());
+    jobs.Wait(jobs.ParallelFor(faces.size(), 1, [&](int begin, int end) {
+        for (int i = begin; i < end; i++)
+            faceData[i] = stbi_load(faces[i].c_str(), &faceWidths[i], &faceHeights[i], &faceChannels[i], 0);
+    }));
+
     unsigned int textureID;
     glGenTextures(1, &textureID);
     glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 
-    int width, height, nrChannels;
     for (unsigned int i = 0; i < faces.size(); i++)
     {
-        unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
+        unsigned char *data = faceData[i];
+        int width = faceWidths[i], height = faceHeights[i], nrChannels = faceChannels[i];
         if (data) {
             GLenum internalFormat;
             GLenum dataFormat;
@@ -640,31 +1234,14 @@ unsigned int loadTexture(char const* path) {
     return textureID;
 }
 
-unsigned int quadVAO = 0;
-unsigned int quadVBO;
-void renderQuad()
-{
-    if (quadVAO == 0)
-    {
-        float quadVertices[] = {
-                // positions        // texture Coords
-                -1.0f,  1.0f, 0.0f, 0.0f, 1.0f,
-                -1.0f, -1.0f, 0.0f, 0.0f, 0.0f,
-                1.0f,  1.0f, 0.0f, 1.0f, 1.0f,
-                1.0f, -1.0f, 0.0f, 1.0f, 0.0f,
-        };
-        // setup plane VAO
-        glGenVertexArrays(1, &quadVAO);
-        glGenBuffers(1, &quadVBO);
-        glBindVertexArray(quadVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+// random boxes scattered around the scene, only fed to the culler to measure it at scale
+std::vector<AABB> generateStressBoxes(int count) {
+    std::vector<AABB> boxes;
+    boxes.reserve(count);
+    for (int i = 0; i < count; i++) {
+        glm::vec3 center(rand() % 1200 - 600.0f, rand() % 200 - 100.0f, rand() % 1200 - 600.0f);
+        glm::vec3 extents(1.0f + rand() % 10);
+        boxes.emplace_back(center - extents, center + extents);
     }
-    glBindVertexArray(quadVAO);
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-    glBindVertexArray(0);
-}
\ No newline at end of file
+    return boxes;
+}